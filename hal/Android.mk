@@ -16,6 +16,11 @@ endif
 
 LOCAL_SRC_FILES := \
 	audio_hw.c \
+	ring_buffer.c \
+	latency_stats.c \
+	clock_model.c \
+	pcm_tap.c \
+	proxy_capture.c \
 	voice.c \
 	platform_info.c \
 	$(AUDIO_PLATFORM)/platform.c
@@ -67,6 +72,7 @@ endif
 ifeq ($(strip $(AUDIO_FEATURE_ENABLED_SSR)),true)
     LOCAL_CFLAGS += -DSSR_ENABLED
     LOCAL_SRC_FILES += audio_extn/ssr.c
+    LOCAL_SRC_FILES += audio_extn/ssr_engine.c
     LOCAL_C_INCLUDES += $(TARGET_OUT_HEADERS)/mm-audio/surround_sound/
     LOCAL_C_INCLUDES += $(TARGET_OUT_HEADERS)/common/inc/
 endif
@@ -211,4 +217,21 @@ LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 
+# ---------------------------------------------------------------------------------
+#             Make the apps-test (audio-ssr-engine-test)
+# ---------------------------------------------------------------------------------
+
+ifeq ($(strip $(AUDIO_FEATURE_ENABLED_SSR)),true)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE            := audio-ssr-engine-test
+LOCAL_MODULE_TAGS       := optional
+LOCAL_SRC_FILES         := test/ssr_engine_test.c \
+                           audio_extn/ssr_engine.c
+LOCAL_C_INCLUDES        := $(LOCAL_PATH)/audio_extn
+LOCAL_SHARED_LIBRARIES  := liblog libcutils
+
+include $(BUILD_EXECUTABLE)
+endif
+
 endif
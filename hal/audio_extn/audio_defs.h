@@ -77,4 +77,21 @@
 
 #define AUDIO_PARAMETER_IS_HW_DECODER_SESSION_ALLOWED  "is_hw_dec_session_allowed"
 
+/* Query deep buffer ring statistics */
+#define AUDIO_PARAMETER_KEY_RING_UNDERRUNS "ring_underruns"
+#define AUDIO_PARAMETER_KEY_RING_FILL_FRAMES "ring_fill_frames"
+#define AUDIO_PARAMETER_KEY_RING_SIZE_FRAMES "ring_size_frames"
+
+/* Query hot path latency histograms, "name,count,p50,p90,p99,max|..." in us */
+#define AUDIO_PARAMETER_KEY_LATENCY_STATS "latency_stats"
+
+/* Query the offload session's fragment sizing and AP wakeups per minute */
+#define AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENT_SIZE "offload_fragment_size"
+#define AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENTS "offload_fragments"
+#define AUDIO_PARAMETER_KEY_OFFLOAD_WAKEUPS_PER_MIN "offload_wakeups_per_min"
+
+/* Query the frames read from an input and when the last one was captured */
+#define AUDIO_PARAMETER_KEY_CAPTURE_POSITION_FRAMES "capture_position_frames"
+#define AUDIO_PARAMETER_KEY_CAPTURE_POSITION_TIME_NS "capture_position_time_ns"
+
 #endif /* AUDIO_DEFS_H */
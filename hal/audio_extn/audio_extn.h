@@ -161,6 +161,7 @@ bool audio_extn_usb_is_proxy_inuse();
 #define audio_extn_ssr_update_enabled()               (0)
 #define audio_extn_ssr_get_enabled()                  (0)
 #define audio_extn_ssr_read(stream, buffer, bytes)    (0)
+#define audio_extn_ssr_dump(fd)                       (0)
 #else
 int32_t audio_extn_ssr_init(struct stream_in *in);
 int32_t audio_extn_ssr_deinit();
@@ -168,6 +169,7 @@ void audio_extn_ssr_update_enabled();
 bool audio_extn_ssr_get_enabled();
 int32_t audio_extn_ssr_read(struct audio_stream_in *stream,
                        void *buffer, size_t bytes);
+void audio_extn_ssr_dump(int fd);
 #endif
 
 #ifndef HW_VARIANTS_ENABLED
@@ -408,6 +410,13 @@ void audio_extn_utils_update_stream_app_type_cfg(void *platform,
 int audio_extn_utils_send_app_type_cfg(struct audio_usecase *usecase);
 void audio_extn_utils_send_audio_calibration(struct audio_device *adev,
                                              struct audio_usecase *usecase);
+void audio_extn_utils_send_audio_calibration_sync(snd_device_t snd_device,
+                                                  int app_type,
+                                                  int sample_rate);
+void audio_extn_utils_calibration_init(struct audio_device *adev);
+void audio_extn_utils_calibration_deinit(void);
+void audio_extn_utils_reset_calibration_cache(void);
+void audio_extn_utils_wait_for_calibration(void);
 #ifdef DS2_DOLBY_DAP_ENABLED
 #define LIB_DS2_DAP_HAL "vendor/lib/libhwdaphal.so"
 #define SET_HW_INFO_FUNC "dap_hal_set_hw_info"
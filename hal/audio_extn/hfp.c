@@ -107,7 +107,7 @@ static int32_t hfp_set_volume(struct audio_device *adev, float value)
     }
 
     ALOGD("%s: Setting HFP volume to %d \n", __func__, vol);
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -145,7 +145,7 @@ static int32_t start_hfp(struct audio_device *adev,
     uc_info->in_snd_device = SND_DEVICE_NONE;
     uc_info->out_snd_device = SND_DEVICE_NONE;
 
-    list_add_tail(&adev->usecase_list, &uc_info->list);
+    add_usecase_to_list(adev, uc_info);
 
     select_devices(adev, hfpmod.ucid);
 
@@ -350,7 +350,7 @@ static int32_t stop_hfp(struct audio_device *adev)
     disable_snd_device(adev, uc_info->out_snd_device);
     disable_snd_device(adev, uc_info->in_snd_device);
 
-    list_remove(&uc_info->list);
+    remove_usecase_from_list(adev, uc_info);
     free(uc_info);
 
     ALOGD("%s: exit: status(%d)", __func__, ret);
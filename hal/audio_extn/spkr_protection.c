@@ -348,7 +348,7 @@ static int spkr_calibrate(int t0)
     uc_info_rx->stream.out = adev->primary_output;
     uc_info_rx->out_snd_device = SND_DEVICE_OUT_SPEAKER_PROTECTED;
     disable_rx = true;
-    list_add_tail(&adev->usecase_list, &uc_info_rx->list);
+    add_usecase_to_list(adev, uc_info_rx);
     enable_snd_device(adev, SND_DEVICE_OUT_SPEAKER_PROTECTED);
     enable_audio_route(adev, uc_info_rx);
 
@@ -381,7 +381,7 @@ static int spkr_calibrate(int t0)
     uc_info_tx->out_snd_device = SND_DEVICE_NONE;
 
     disable_tx = true;
-    list_add_tail(&adev->usecase_list, &uc_info_tx->list);
+    add_usecase_to_list(adev, uc_info_tx);
     enable_snd_device(adev, SND_DEVICE_IN_CAPTURE_VI_FEEDBACK);
     enable_audio_route(adev, uc_info_tx);
 
@@ -475,8 +475,7 @@ exit:
             pcm_close(handle.pcm_tx);
         handle.pcm_tx = NULL;
         /* Clear TX calibration to handset mic */
-        platform_send_audio_calibration(adev->platform,
-        SND_DEVICE_IN_HANDSET_MIC,
+        audio_extn_utils_send_audio_calibration_sync(SND_DEVICE_IN_HANDSET_MIC,
         platform_get_default_app_type(adev->platform), 8000);
         if (!status.status) {
             protCfg.mode = MSM_SPKR_PROT_CALIBRATED;
@@ -502,12 +501,12 @@ exit:
             pthread_mutex_lock(&handle.spkr_calib_cancelack_mutex);
         }
         if (disable_rx) {
-            list_remove(&uc_info_rx->list);
+            remove_usecase_from_list(adev, uc_info_rx);
             disable_snd_device(adev, SND_DEVICE_OUT_SPEAKER_PROTECTED);
             disable_audio_route(adev, uc_info_rx);
         }
         if (disable_tx) {
-            list_remove(&uc_info_tx->list);
+            remove_usecase_from_list(adev, uc_info_tx);
             disable_snd_device(adev, SND_DEVICE_IN_CAPTURE_VI_FEEDBACK);
             disable_audio_route(adev, uc_info_tx);
         }
@@ -835,9 +834,12 @@ int audio_extn_spkr_prot_start_processing(snd_device_t snd_device)
         uc_info_tx->in_snd_device = SND_DEVICE_IN_CAPTURE_VI_FEEDBACK;
         uc_info_tx->out_snd_device = SND_DEVICE_NONE;
         handle.pcm_tx = NULL;
-        list_add_tail(&adev->usecase_list, &uc_info_tx->list);
+        add_usecase_to_list(adev, uc_info_tx);
         enable_snd_device(adev, SND_DEVICE_IN_CAPTURE_VI_FEEDBACK);
         enable_audio_route(adev, uc_info_tx);
+        /* select_devices() only stages the routes, the feedback backend
+         * must be routed before its pcm is started */
+        flush_route_transaction(adev);
 
         pcm_dev_tx_id = platform_get_pcm_device_id(uc_info_tx->id, PCM_CAPTURE);
         if (pcm_dev_tx_id < 0) {
@@ -862,14 +864,13 @@ int audio_extn_spkr_prot_start_processing(snd_device_t snd_device)
 
 exit:
    /* Clear VI feedback cal and replace with handset MIC  */
-   platform_send_audio_calibration(adev->platform,
-        SND_DEVICE_IN_HANDSET_MIC,
+   audio_extn_utils_send_audio_calibration_sync(SND_DEVICE_IN_HANDSET_MIC,
         platform_get_default_app_type(adev->platform), 8000);
     if (ret) {
         if (handle.pcm_tx)
             pcm_close(handle.pcm_tx);
         handle.pcm_tx = NULL;
-        list_remove(&uc_info_tx->list);
+        remove_usecase_from_list(adev, uc_info_tx);
         disable_snd_device(adev, SND_DEVICE_IN_CAPTURE_VI_FEEDBACK);
         disable_audio_route(adev, uc_info_tx);
         free(uc_info_tx);
@@ -896,7 +897,7 @@ void audio_extn_spkr_prot_stop_processing(snd_device_t snd_device)
         handle.pcm_tx = NULL;
         disable_snd_device(adev, SND_DEVICE_IN_CAPTURE_VI_FEEDBACK);
         if (uc_info_tx) {
-            list_remove(&uc_info_tx->list);
+            remove_usecase_from_list(adev, uc_info_tx);
             disable_audio_route(adev, uc_info_tx);
             free(uc_info_tx);
         }
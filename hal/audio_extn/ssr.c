@@ -31,13 +31,15 @@
 #include "audio_hw.h"
 #include "platform.h"
 #include "platform_api.h"
+#include "latency_stats.h"
+#include "ssr_engine.h"
 #include "surround_filters_interface.h"
 
 #ifdef SSR_ENABLED
-#define COEFF_ARRAY_SIZE            4
-#define FILT_SIZE                   ((512+1)* 6)  /* # ((FFT bins)/2+1)*numOutputs */
-#define SSR_CHANNEL_INPUT_NUM       4
-#define SSR_CHANNEL_OUTPUT_NUM      6
+#define COEFF_ARRAY_SIZE            SSR_ENGINE_INPUTS
+#define FILT_SIZE                   SSR_ENGINE_COEFF_SIZE  /* # ((FFT bins)/2+1)*numOutputs */
+#define SSR_CHANNEL_INPUT_NUM       SSR_ENGINE_INPUTS
+#define SSR_CHANNEL_OUTPUT_NUM      SSR_ENGINE_OUTPUTS
 #define SSR_PERIOD_COUNT            8
 #define SSR_PERIOD_SIZE             512
 #define SSR_INPUT_FRAME_SIZE        (SSR_PERIOD_SIZE * SSR_PERIOD_COUNT)
@@ -61,14 +63,21 @@ typedef int  (*surround_filters_set_channel_map_t)(void *, const int *);
 typedef void (*surround_filters_intl_process_t)(void *, Word16 *, Word16 *);
 
 struct ssr_module {
-    FILE                *fp_4ch;
-    FILE                *fp_6ch;
-    Word16             **real_coeffs;
-    Word16             **imag_coeffs;
-    void                *surround_obj;
-    Word16             *surround_raw_buffer;
+    struct pcm_tap      *tap_4ch;
+    struct pcm_tap      *tap_6ch;
+    struct ssr_engine   *engine;
+    int16_t             *surround_raw_buffer;
+    size_t               surround_raw_frames;
     bool                is_ssr_enabled;
 
+    /* time spent converting each read, see audio_extn_ssr_dump() */
+    struct latency_hist process_hist;
+
+    /* libsurround_proc, used instead of the engine unless audio.ssr.engine
+     * is set, it keeps the coefficients it was given */
+    void *surround_obj;
+    Word16 *real_coeffs[COEFF_ARRAY_SIZE];
+    Word16 *imag_coeffs[COEFF_ARRAY_SIZE];
     void *surround_filters_handle;
     surround_filters_init_t surround_filters_init;
     surround_filters_release_t surround_filters_release;
@@ -77,14 +86,14 @@ struct ssr_module {
 };
 
 static struct ssr_module ssrmod = {
-    .fp_4ch = NULL,
-    .fp_6ch = NULL,
-    .real_coeffs = NULL,
-    .imag_coeffs = NULL,
-    .surround_obj = NULL,
+    .tap_4ch = NULL,
+    .tap_6ch = NULL,
+    .engine = NULL,
     .surround_raw_buffer = NULL,
+    .surround_raw_frames = 0,
     .is_ssr_enabled = 0,
 
+    .surround_obj = NULL,
     .surround_filters_handle = NULL,
     .surround_filters_init = NULL,
     .surround_filters_release = NULL,
@@ -95,267 +104,213 @@ static struct ssr_module ssrmod = {
 /* Use AAC/DTS channel mapping as default channel mapping: C,FL,FR,Ls,Rs,LFE */
 static const int chan_map[] = { 1, 2, 4, 3, 0, 5};
 
-/* Rotine to read coeffs from File and updates real and imaginary
-   coeff array member variable */
-static int32_t ssr_read_coeffs_from_file()
-{
-    FILE    *flt1r;
-    FILE    *flt2r;
-    FILE    *flt3r;
-    FILE    *flt4r;
-    FILE    *flt1i;
-    FILE    *flt2i;
-    FILE    *flt3i;
-    FILE    *flt4i;
-    int i;
-
-    if ( (flt1r = fopen(SURROUND_FILE_1R, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter co-efficient "
-              "file %s", __func__, SURROUND_FILE_1R);
-        return -EINVAL;
-    }
-
-    if ( (flt2r = fopen(SURROUND_FILE_2R, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_2R);
-        return -EINVAL;
-    }
-
-    if ( (flt3r = fopen(SURROUND_FILE_3R, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_3R);
-        return  -EINVAL;
-    }
+/* how libsurround_proc is set up, the engine applies the same limits */
+static const struct ssr_engine_bands bands = {
+    /* sub_woofer channel assignment: default as first
+       microphone input channel */
+    .sub_woofer = 0,
+    /* frequency upper bound for sub_woofer:
+       frequency=(low_freq-1)/FFT_SIZE*samplingRate, default as 4 */
+    .low_freq = 4,
+    /* frequency upper bound for spatial processing:
+       frequency=(high_freq-1)/FFT_SIZE*samplingRate, default as 100 */
+    .high_freq = 100,
+    /* the filter output chan_map puts in the LFE slot */
+    .lfe_output = 5,
+};
 
-    if ( (flt4r = fopen(SURROUND_FILE_4R, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_4R);
-        return  -EINVAL;
-    }
+static const char * const real_coeff_files[COEFF_ARRAY_SIZE] = {
+    SURROUND_FILE_1R, SURROUND_FILE_2R, SURROUND_FILE_3R, SURROUND_FILE_4R
+};
 
-    if ( (flt1i = fopen(SURROUND_FILE_1I, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_1I);
-        return -EINVAL;
-    }
+static const char * const imag_coeff_files[COEFF_ARRAY_SIZE] = {
+    SURROUND_FILE_1I, SURROUND_FILE_2I, SURROUND_FILE_3I, SURROUND_FILE_4I
+};
 
-    if ( (flt2i = fopen(SURROUND_FILE_2I, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_2I);
-        return -EINVAL;
-    }
+static int32_t ssr_read_coeff_file(const char *path, int16_t *coeffs)
+{
+    FILE *fp;
+    size_t count;
 
-    if ( (flt3i = fopen(SURROUND_FILE_3I, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_3I);
+    if ((fp = fopen(path, "rb")) == NULL) {
+        ALOGE("%s: Cannot open filter co-efficient file %s", __func__, path);
         return -EINVAL;
     }
-
-    if ( (flt4i = fopen(SURROUND_FILE_4I, "rb")) == NULL ) {
-        ALOGE("%s: Cannot open filter "
-              "co-efficient file %s", __func__, SURROUND_FILE_4I);
+    count = fread(coeffs, sizeof(int16_t), FILT_SIZE, fp);
+    fclose(fp);
+    if (count != FILT_SIZE) {
+        ALOGE("%s: %s holds %zu of %d co-efficients", __func__, path,
+              count, FILT_SIZE);
         return -EINVAL;
     }
-    ALOGV("%s: readCoeffsFromFile all filter "
-          "files opened", __func__);
+    return 0;
+}
 
-    for (i=0; i<COEFF_ARRAY_SIZE; i++) {
-        ssrmod.real_coeffs[i] = (Word16 *)calloc(FILT_SIZE, sizeof(Word16));
-    }
-    for (i=0; i<COEFF_ARRAY_SIZE; i++) {
-        ssrmod.imag_coeffs[i] = (Word16 *)calloc(FILT_SIZE, sizeof(Word16));
-    }
+/*
+ * Sets libsurround_proc up with the filters, which it keeps. Returns
+ * -ENOENT when the library is not there.
+ */
+static int32_t ssr_init_surround_filters_lib(int16_t *real_coeffs[COEFF_ARRAY_SIZE],
+                                             int16_t *imag_coeffs[COEFF_ARRAY_SIZE])
+{
+    int ret;
 
-    /* Read real co-efficients */
-    if (NULL != ssrmod.real_coeffs[0]) {
-        fread(ssrmod.real_coeffs[0], sizeof(int16), FILT_SIZE, flt1r);
-    }
-    if (NULL != ssrmod.real_coeffs[0]) {
-        fread(ssrmod.real_coeffs[1], sizeof(int16), FILT_SIZE, flt2r);
-    }
-    if (NULL != ssrmod.real_coeffs[0]) {
-        fread(ssrmod.real_coeffs[2], sizeof(int16), FILT_SIZE, flt3r);
+    ssrmod.surround_filters_handle = dlopen(LIB_SURROUND_PROC, RTLD_NOW);
+    if (ssrmod.surround_filters_handle == NULL) {
+        ALOGW("%s: DLOPEN failed for %s", __func__, LIB_SURROUND_PROC);
+        return -ENOENT;
     }
-    if (NULL != ssrmod.real_coeffs[0]) {
-        fread(ssrmod.real_coeffs[3], sizeof(int16), FILT_SIZE, flt4r);
+    ALOGV("%s: DLOPEN successful for %s", __func__, LIB_SURROUND_PROC);
+    ssrmod.surround_filters_init = (surround_filters_init_t)
+        dlsym(ssrmod.surround_filters_handle, "surround_filters_init");
+    ssrmod.surround_filters_release = (surround_filters_release_t)
+        dlsym(ssrmod.surround_filters_handle, "surround_filters_release");
+    ssrmod.surround_filters_set_channel_map = (surround_filters_set_channel_map_t)
+        dlsym(ssrmod.surround_filters_handle, "surround_filters_set_channel_map");
+    ssrmod.surround_filters_intl_process = (surround_filters_intl_process_t)
+        dlsym(ssrmod.surround_filters_handle, "surround_filters_intl_process");
+    if (!ssrmod.surround_filters_init ||
+        !ssrmod.surround_filters_release ||
+        !ssrmod.surround_filters_set_channel_map ||
+        !ssrmod.surround_filters_intl_process) {
+        ALOGW("%s: Could not find the one of the symbols from %s",
+              __func__, LIB_SURROUND_PROC);
+        ret = -ENOENT;
+        goto fail;
     }
 
-    /* read imaginary co-efficients */
-    if (NULL != ssrmod.imag_coeffs[0]) {
-        fread(ssrmod.imag_coeffs[0], sizeof(int16), FILT_SIZE, flt1i);
-    }
-    if (NULL != ssrmod.imag_coeffs[0]) {
-        fread(ssrmod.imag_coeffs[1], sizeof(int16), FILT_SIZE, flt2i);
-    }
-    if (NULL != ssrmod.imag_coeffs[0]) {
-        fread(ssrmod.imag_coeffs[2], sizeof(int16), FILT_SIZE, flt3i);
-    }
-    if (NULL != ssrmod.imag_coeffs[0]) {
-        fread(ssrmod.imag_coeffs[3], sizeof(int16), FILT_SIZE, flt4i);
+    /* calculate the size of data to allocate for surround_obj */
+    ret = ssrmod.surround_filters_init(NULL, SSR_CHANNEL_OUTPUT_NUM,
+                                       SSR_CHANNEL_INPUT_NUM,
+                                       real_coeffs, imag_coeffs,
+                                       bands.sub_woofer, bands.low_freq,
+                                       bands.high_freq, NULL);
+    if (ret <= 0) {
+        ALOGE("%s: surround_filters_init(surround_obj=Null) "
+              "failed with ret: %d", __func__, ret);
+        ret = -EINVAL;
+        goto fail;
+    }
+    ALOGV("%s: Allocating surroundObj size is %d", __func__, ret);
+    ssrmod.surround_obj = calloc(1, ret);
+    if (ssrmod.surround_obj == NULL) {
+        ALOGE("%s: Allocationg surround_obj failed", __func__);
+        ret = -ENOMEM;
+        goto fail;
+    }
+    ret = ssrmod.surround_filters_init(ssrmod.surround_obj, SSR_CHANNEL_OUTPUT_NUM,
+                                       SSR_CHANNEL_INPUT_NUM,
+                                       real_coeffs, imag_coeffs,
+                                       bands.sub_woofer, bands.low_freq,
+                                       bands.high_freq, NULL);
+    if (ret != 0) {
+        ALOGE("%s: surround_filters_init failed with ret:%d", __func__, ret);
+        ssrmod.surround_filters_release(ssrmod.surround_obj);
+        free(ssrmod.surround_obj);
+        ssrmod.surround_obj = NULL;
+        ret = -EINVAL;
+        goto fail;
     }
-
-    fclose(flt1r);
-    fclose(flt2r);
-    fclose(flt3r);
-    fclose(flt4r);
-    fclose(flt1i);
-    fclose(flt2i);
-    fclose(flt3i);
-    fclose(flt4i);
-
+    (void) ssrmod.surround_filters_set_channel_map(ssrmod.surround_obj, chan_map);
+    memcpy(ssrmod.real_coeffs, real_coeffs, sizeof(ssrmod.real_coeffs));
+    memcpy(ssrmod.imag_coeffs, imag_coeffs, sizeof(ssrmod.imag_coeffs));
     return 0;
+
+fail:
+    dlclose(ssrmod.surround_filters_handle);
+    ssrmod.surround_filters_handle = NULL;
+    return ret;
 }
 
+/*
+ * Reads the filter files and sets up libsurround_proc with them, or the in
+ * tree SSR engine when audio.ssr.engine is set or the library is missing.
+ */
 static int32_t ssr_init_surround_sound_lib(unsigned long buffersize)
 {
-    /* sub_woofer channel assignment: default as first
-       microphone input channel */
-    int sub_woofer = 0;
-    /* frequency upper bound for sub_woofer:
-       frequency=(low_freq-1)/FFT_SIZE*samplingRate, default as 4 */
-    int low_freq = 4;
-    /* frequency upper bound for spatial processing:
-       frequency=(high_freq-1)/FFT_SIZE*samplingRate, default as 100 */
-    int high_freq = 100;
+    char value[PROPERTY_VALUE_MAX];
+    int16_t *real_coeffs[COEFF_ARRAY_SIZE] = { NULL };
+    int16_t *imag_coeffs[COEFF_ARRAY_SIZE] = { NULL };
+    bool use_engine;
     int i, ret = 0;
 
-    if ( ssrmod.surround_obj ) {
-        ALOGE("%s: ola filter library is already initialized", __func__);
+    if (ssrmod.engine || ssrmod.surround_obj) {
+        ALOGE("%s: ssr is already initialized", __func__);
+        if (ssrmod.engine)
+            ssr_engine_reset(ssrmod.engine);
         return 0;
     }
 
     /* Allocate memory for input buffer */
-    ssrmod.surround_raw_buffer = (Word16 *) calloc(buffersize,
-                                              sizeof(Word16));
+    ssrmod.surround_raw_buffer = (int16_t *) calloc(buffersize,
+                                              sizeof(int16_t));
     if ( !ssrmod.surround_raw_buffer ) {
        ALOGE("%s: Memory allocation failure. Not able to allocate "
              "memory for surroundInputBuffer", __func__);
-       goto init_fail;
-    }
-
-    /* Allocate memory for real and imag coeffs array */
-    ssrmod.real_coeffs = (Word16 **) calloc(COEFF_ARRAY_SIZE, sizeof(Word16 *));
-    if ( !ssrmod.real_coeffs ) {
-        ALOGE("%s: Memory allocation failure during real "
-              "Coefficient array", __func__);
-        goto init_fail;
-    }
-
-    ssrmod.imag_coeffs = (Word16 **) calloc(COEFF_ARRAY_SIZE, sizeof(Word16 *));
-    if ( !ssrmod.imag_coeffs ) {
-        ALOGE("%s: Memory allocation failure during imaginary "
-              "Coefficient array", __func__);
-        goto init_fail;
-    }
-
-    if( ssr_read_coeffs_from_file() != 0) {
-        ALOGE("%s: Error while loading coeffs from file", __func__);
-        goto init_fail;
-    }
-
-    ssrmod.surround_filters_handle = dlopen(LIB_SURROUND_PROC, RTLD_NOW);
-    if (ssrmod.surround_filters_handle == NULL) {
-        ALOGE("%s: DLOPEN failed for %s", __func__, LIB_SURROUND_PROC);
-    } else {
-        ALOGV("%s: DLOPEN successful for %s", __func__, LIB_SURROUND_PROC);
-        ssrmod.surround_filters_init = (surround_filters_init_t)
-        dlsym(ssrmod.surround_filters_handle, "surround_filters_init");
-
-        ssrmod.surround_filters_release = (surround_filters_release_t)
-         dlsym(ssrmod.surround_filters_handle, "surround_filters_release");
-
-        ssrmod.surround_filters_set_channel_map = (surround_filters_set_channel_map_t)
-         dlsym(ssrmod.surround_filters_handle, "surround_filters_set_channel_map");
-
-        ssrmod.surround_filters_intl_process = (surround_filters_intl_process_t)
-        dlsym(ssrmod.surround_filters_handle, "surround_filters_intl_process");
-
-        if (!ssrmod.surround_filters_init ||
-            !ssrmod.surround_filters_release ||
-            !ssrmod.surround_filters_set_channel_map ||
-            !ssrmod.surround_filters_intl_process){
-            ALOGW("%s: Could not find the one of the symbols from %s",
-                  __func__, LIB_SURROUND_PROC);
-            goto init_fail;
+       ret = -ENOMEM;
+       goto done;
+    }
+    ssrmod.surround_raw_frames = buffersize / SSR_CHANNEL_INPUT_NUM;
+
+    for (i = 0; i < COEFF_ARRAY_SIZE; i++) {
+        real_coeffs[i] = (int16_t *)calloc(FILT_SIZE, sizeof(int16_t));
+        imag_coeffs[i] = (int16_t *)calloc(FILT_SIZE, sizeof(int16_t));
+        if (!real_coeffs[i] || !imag_coeffs[i]) {
+            ALOGE("%s: Memory allocation failure during "
+                  "Coefficient array", __func__);
+            ret = -ENOMEM;
+            goto done;
         }
-    }
-
-    /* calculate the size of data to allocate for surround_obj */
-    ret = ssrmod.surround_filters_init(NULL,
-                  6, // Num output channel
-                  4,     // Num input channel
-                  ssrmod.real_coeffs,       // Coeffs hardcoded in header
-                  ssrmod.imag_coeffs,       // Coeffs hardcoded in header
-                  sub_woofer,
-                  low_freq,
-                  high_freq,
-                  NULL);
-
-    if ( ret > 0 ) {
-        ALOGV("%s: Allocating surroundObj size is %d", __func__, ret);
-        ssrmod.surround_obj = (void *)malloc(ret);
-        if (NULL != ssrmod.surround_obj) {
-            memset(ssrmod.surround_obj,0,ret);
-            /* initialize after allocating the memory for surround_obj */
-            ret = ssrmod.surround_filters_init(ssrmod.surround_obj,
-                        6,
-                        4,
-                        ssrmod.real_coeffs,
-                        ssrmod.imag_coeffs,
-                        sub_woofer,
-                        low_freq,
-                        high_freq,
-                        NULL);
-            if (0 != ret) {
-               ALOGE("%s: surround_filters_init failed with ret:%d",__func__, ret);
-               ssrmod.surround_filters_release(ssrmod.surround_obj);
-               goto init_fail;
-            }
-        } else {
-            ALOGE("%s: Allocationg surround_obj failed", __func__);
-            goto init_fail;
+        if (ssr_read_coeff_file(real_coeff_files[i], real_coeffs[i]) ||
+            ssr_read_coeff_file(imag_coeff_files[i], imag_coeffs[i])) {
+            ALOGE("%s: Error while loading coeffs from file", __func__);
+            ret = -EINVAL;
+            goto done;
         }
-    } else {
-        ALOGE("%s: surround_filters_init(surround_obj=Null) "
-              "failed with ret: %d", __func__, ret);
-        goto init_fail;
     }
 
-    (void) ssrmod.surround_filters_set_channel_map(ssrmod.surround_obj, chan_map);
-
-    return 0;
-
-init_fail:
-    if (ssrmod.surround_obj) {
-        free(ssrmod.surround_obj);
-        ssrmod.surround_obj = NULL;
-    }
-    if (ssrmod.surround_raw_buffer) {
+    /* the engine is not yet checked against the library on device, see
+     * test/ssr_engine_test -g */
+    property_get("audio.ssr.engine", value, "0");
+    use_engine = atoi(value) || !strncmp("true", value, 4);
+    if (!use_engine) {
+        ret = ssr_init_surround_filters_lib(real_coeffs, imag_coeffs);
+        if (ret == 0) {
+            /* the library keeps the coefficients */
+            for (i = 0; i < COEFF_ARRAY_SIZE; i++)
+                real_coeffs[i] = imag_coeffs[i] = NULL;
+            goto done;
+        }
+        if (ret != -ENOENT)
+            goto done;
+        ALOGW("%s: no %s, using the ssr engine", __func__, LIB_SURROUND_PROC);
+        ret = 0;
+    }
+
+    ret = ssr_engine_limit_bands(real_coeffs, imag_coeffs, &bands);
+    if (ret != 0)
+        goto done;
+    ssrmod.engine = ssr_engine_create(real_coeffs, imag_coeffs, chan_map);
+    if (ssrmod.engine == NULL) {
+        ALOGE("%s: ssr_engine_create failed", __func__);
+        ret = -ENOMEM;
+        goto done;
+    }
+
+done:
+    if (ret == 0)
+        latency_hist_reset(&ssrmod.process_hist);
+    /* the engine keeps its own converted copy */
+    for (i = 0; i < COEFF_ARRAY_SIZE; i++) {
+        free(real_coeffs[i]);
+        free(imag_coeffs[i]);
+    }
+    if (ret != 0 && ssrmod.surround_raw_buffer) {
         free(ssrmod.surround_raw_buffer);
         ssrmod.surround_raw_buffer = NULL;
+        ssrmod.surround_raw_frames = 0;
     }
-    if (ssrmod.real_coeffs){
-        for (i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-            if (ssrmod.real_coeffs[i]) {
-                free(ssrmod.real_coeffs[i]);
-                ssrmod.real_coeffs[i] = NULL;
-            }
-        }
-        free(ssrmod.real_coeffs);
-        ssrmod.real_coeffs = NULL;
-    }
-    if (ssrmod.imag_coeffs){
-        for (i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-            if (ssrmod.imag_coeffs[i]) {
-                free(ssrmod.imag_coeffs[i]);
-                ssrmod.imag_coeffs[i] = NULL;
-            }
-        }
-        free(ssrmod.imag_coeffs);
-        ssrmod.imag_coeffs = NULL;
-    }
-
-    return -ENOMEM;
+    return ret;
 }
 
 void audio_extn_ssr_update_enabled()
@@ -381,7 +336,6 @@ bool audio_extn_ssr_get_enabled()
 int32_t audio_extn_ssr_init(struct stream_in *in)
 {
     uint32_t ret;
-    char c_multi_ch_dump[128] = {0};
     uint32_t buffer_size;
 
     ALOGD("%s: ssr case ", __func__);
@@ -400,18 +354,11 @@ int32_t audio_extn_ssr_init(struct stream_in *in)
         return ret;
     }
 
-    property_get("ssr.pcmdump",c_multi_ch_dump,"0");
-    if (0 == strncmp("true", c_multi_ch_dump, sizeof("ssr.dump-pcm"))) {
-        /* Remember to change file system permission of data(e.g. chmod 777 data/),
-          otherwise, fopen may fail */
-        if ( !ssrmod.fp_4ch)
-            ssrmod.fp_4ch = fopen("/data/4ch.pcm", "wb");
-        if ( !ssrmod.fp_6ch)
-            ssrmod.fp_6ch = fopen("/data/6ch.pcm", "wb");
-        if ((!ssrmod.fp_4ch) || (!ssrmod.fp_6ch))
-            ALOGE("%s: mfp_4ch or mfp_6ch open failed: mfp_4ch:%p mfp_6ch:%p",
-                  __func__, ssrmod.fp_4ch, ssrmod.fp_6ch);
-    }
+    /* raw and converted pcm dumps, enabled through audio.pcm.tap */
+    if (!ssrmod.tap_4ch)
+        ssrmod.tap_4ch = pcm_tap_open("ssr_4ch");
+    if (!ssrmod.tap_6ch)
+        ssrmod.tap_6ch = pcm_tap_open("ssr_6ch");
 
     return 0;
 }
@@ -420,43 +367,35 @@ int32_t audio_extn_ssr_deinit()
 {
     int i;
 
-    if (ssrmod.surround_obj) {
+    if (ssrmod.engine || ssrmod.surround_obj) {
         ALOGV("%s: entry", __func__);
-        ssrmod.surround_filters_release(ssrmod.surround_obj);
-        if (ssrmod.surround_obj)
-            free(ssrmod.surround_obj);
-        ssrmod.surround_obj = NULL;
-        if (ssrmod.real_coeffs){
-            for (i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-                if (ssrmod.real_coeffs[i]) {
-                    free(ssrmod.real_coeffs[i]);
-                    ssrmod.real_coeffs[i] = NULL;
-                }
-            }
-            free(ssrmod.real_coeffs);
-            ssrmod.real_coeffs = NULL;
+        if (ssrmod.engine) {
+            ssr_engine_destroy(ssrmod.engine);
+            ssrmod.engine = NULL;
         }
-        if (ssrmod.imag_coeffs){
-            for (i =0; i<COEFF_ARRAY_SIZE; i++ ) {
-                if (ssrmod.imag_coeffs[i]) {
-                    free(ssrmod.imag_coeffs[i]);
-                    ssrmod.imag_coeffs[i] = NULL;
-                }
+        if (ssrmod.surround_obj) {
+            ssrmod.surround_filters_release(ssrmod.surround_obj);
+            free(ssrmod.surround_obj);
+            ssrmod.surround_obj = NULL;
+            for (i = 0; i < COEFF_ARRAY_SIZE; i++) {
+                free(ssrmod.real_coeffs[i]);
+                ssrmod.real_coeffs[i] = NULL;
+                free(ssrmod.imag_coeffs[i]);
+                ssrmod.imag_coeffs[i] = NULL;
             }
-            free(ssrmod.imag_coeffs);
-            ssrmod.imag_coeffs = NULL;
         }
         if (ssrmod.surround_raw_buffer) {
             free(ssrmod.surround_raw_buffer);
             ssrmod.surround_raw_buffer = NULL;
+            ssrmod.surround_raw_frames = 0;
         }
-        if (ssrmod.fp_4ch)
-            fclose(ssrmod.fp_4ch);
-        if (ssrmod.fp_6ch)
-            fclose(ssrmod.fp_6ch);
+        pcm_tap_close(ssrmod.tap_4ch);
+        ssrmod.tap_4ch = NULL;
+        pcm_tap_close(ssrmod.tap_6ch);
+        ssrmod.tap_6ch = NULL;
     }
 
-    if(ssrmod.surround_filters_handle) {
+    if (ssrmod.surround_filters_handle) {
         dlclose(ssrmod.surround_filters_handle);
         ssrmod.surround_filters_handle = NULL;
     }
@@ -465,20 +404,21 @@ int32_t audio_extn_ssr_deinit()
     return 0;
 }
 
-int32_t audio_extn_ssr_read(struct audio_stream_in *stream,
-                       void *buffer, size_t bytes)
+/* libsurround_proc converts a whole read at once */
+static int32_t ssr_read_surround_filters_lib(struct stream_in *in,
+                                             void *buffer, size_t bytes)
 {
-    struct stream_in *in = (struct stream_in *)stream;
-    struct audio_device *adev = in->dev;
     size_t peroid_bytes;
+    int64_t start_us;
     int32_t ret;
 
     /* Convert bytes for 6ch to 4ch*/
     peroid_bytes = (bytes / SSR_CHANNEL_OUTPUT_NUM) * SSR_CHANNEL_INPUT_NUM;
-
-    if (!ssrmod.surround_obj) {
-        ALOGE("%s: surround_obj not initialized", __func__);
-        return -ENOMEM;
+    if (peroid_bytes > ssrmod.surround_raw_frames * SSR_CHANNEL_INPUT_NUM *
+                       sizeof(int16_t)) {
+        ALOGE("%s: read of %zu bytes is larger than the raw buffer",
+              __func__, bytes);
+        return -EINVAL;
     }
 
     ret = pcm_read(in->pcm, ssrmod.surround_raw_buffer, peroid_bytes);
@@ -488,16 +428,70 @@ int32_t audio_extn_ssr_read(struct audio_stream_in *stream,
     }
 
     /* apply ssr libs to conver 4ch to 6ch */
+    start_us = latency_now_us();
     ssrmod.surround_filters_intl_process(ssrmod.surround_obj,
         buffer, ssrmod.surround_raw_buffer);
+    latency_hist_add_since(&ssrmod.process_hist, start_us);
+
+    pcm_tap_write(ssrmod.tap_4ch, ssrmod.surround_raw_buffer, peroid_bytes);
+    pcm_tap_write(ssrmod.tap_6ch, buffer, bytes);
+
+    return ret;
+}
 
-    /*dump for raw pcm data*/
-    if (ssrmod.fp_4ch)
-        fwrite(ssrmod.surround_raw_buffer, 1, peroid_bytes, ssrmod.fp_4ch);
-    if (ssrmod.fp_6ch)
-        fwrite(buffer, 1, bytes, ssrmod.fp_6ch);
+int32_t audio_extn_ssr_read(struct audio_stream_in *stream,
+                       void *buffer, size_t bytes)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    size_t frames = bytes / (SSR_CHANNEL_OUTPUT_NUM * sizeof(int16_t));
+    int16_t *out = (int16_t *)buffer;
+    int32_t ret = 0;
+
+    if (ssrmod.surround_obj)
+        return ssr_read_surround_filters_lib(in, buffer, bytes);
+
+    if (!ssrmod.engine) {
+        ALOGE("%s: ssr engine not initialized", __func__);
+        return -ENOMEM;
+    }
+
+    /* read 4ch in chunks of the raw buffer and convert each to 6ch */
+    while (frames > 0) {
+        size_t count = frames < ssrmod.surround_raw_frames ?
+                       frames : ssrmod.surround_raw_frames;
+        size_t peroid_bytes = count * SSR_CHANNEL_INPUT_NUM * sizeof(int16_t);
+        int64_t start_us;
+
+        ret = pcm_read(in->pcm, ssrmod.surround_raw_buffer, peroid_bytes);
+        if (ret < 0) {
+            ALOGE("%s: %s ret:%d", __func__, pcm_get_error(in->pcm),ret);
+            return ret;
+        }
+
+        start_us = latency_now_us();
+        ssr_engine_process(ssrmod.engine, ssrmod.surround_raw_buffer, out, count);
+        latency_hist_add_since(&ssrmod.process_hist, start_us);
+
+        pcm_tap_write(ssrmod.tap_4ch, ssrmod.surround_raw_buffer, peroid_bytes);
+        pcm_tap_write(ssrmod.tap_6ch, out,
+                      count * SSR_CHANNEL_OUTPUT_NUM * sizeof(int16_t));
+
+        out += count * SSR_CHANNEL_OUTPUT_NUM;
+        frames -= count;
+    }
 
     return ret;
 }
 
+void audio_extn_ssr_dump(int fd)
+{
+    if (ssrmod.surround_obj)
+        dprintf(fd, "    ssr %s\n", LIB_SURROUND_PROC);
+    else if (ssrmod.engine)
+        dprintf(fd, "    ssr engine (%s kernels)\n", ssr_engine_kernels());
+    else
+        return;
+    latency_hist_dump(&ssrmod.process_hist, "ssr process", fd);
+}
+
 #endif /* SSR_ENABLED */
@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define LOG_TAG "audio_hw_ssr_engine"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+
+#include "ssr_engine.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SSR_KERNELS_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define SSR_KERNELS_SSE
+#endif
+
+#define SSR_LOG2_TAPS            10
+#define SSR_LOG2_FFT_SIZE        11
+#define SSR_FFT_SIZE             (1 << SSR_LOG2_FFT_SIZE)
+#define SSR_FFT_BINS             (SSR_FFT_SIZE / 2 + 1)
+/* what a block still adds to the blocks after it */
+#define SSR_TAIL_SIZE            (SSR_FFT_SIZE - SSR_ENGINE_HOP)
+/* spectra are padded so that every row starts 16 byte aligned */
+#define SSR_BINS_STRIDE          ((SSR_FFT_BINS + 3) & ~3)
+
+#if (1 << SSR_LOG2_TAPS) != SSR_ENGINE_TAPS || \
+    SSR_FFT_SIZE < SSR_ENGINE_HOP + SSR_ENGINE_TAPS - 1
+#error "the transform must hold a hop convolved with the longest filter"
+#endif
+
+/*
+ * The filters come back from their spectrum through an unscaled inverse
+ * transform. The two real inputs packed into one transform come out at twice
+ * their level and the inverse transform of the outputs is unscaled as well.
+ * All of that is folded into the coefficients with the Q15 conversion.
+ */
+#define SSR_COEFF_SCALE          (1.0f / (32768.0f * SSR_ENGINE_TAPS * 2.0f * \
+                                          SSR_FFT_SIZE))
+
+struct ssr_engine {
+    int chan_map[SSR_ENGINE_OUTPUTS];
+    uint16_t bitrev[SSR_FFT_SIZE];
+
+    /* twiddles of the stage with half span h start at h - 1 */
+    float *tw_re;
+    float *tw_im;
+    /* [input][output][bin] */
+    float *coeff_re;
+    float *coeff_im;
+    /* [input][bin] and [output][bin] */
+    float *in_re;
+    float *in_im;
+    float *out_re;
+    float *out_im;
+    /* transform scratch and the overlap of each output, [output][frame] */
+    float *work_re;
+    float *work_im;
+    float *tail;
+    float *mem;
+
+    int16_t in_buf[SSR_ENGINE_HOP * SSR_ENGINE_INPUTS];
+    int16_t out_buf[SSR_ENGINE_HOP * SSR_ENGINE_OUTPUTS];
+    unsigned int fill;
+};
+
+/* b = a - b * w, a = a + b * w over count butterflies */
+static void ssr_butterflies(float *ar, float *ai, float *br, float *bi,
+                            const float *wr, const float *wi,
+                            unsigned int count)
+{
+    unsigned int j = 0;
+
+#if defined(SSR_KERNELS_NEON)
+    for (; j + 4 <= count; j += 4) {
+        float32x4_t xr = vld1q_f32(br + j);
+        float32x4_t xi = vld1q_f32(bi + j);
+        float32x4_t cr = vld1q_f32(wr + j);
+        float32x4_t ci = vld1q_f32(wi + j);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(xr, cr), xi, ci);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(xr, ci), xi, cr);
+        float32x4_t ur = vld1q_f32(ar + j);
+        float32x4_t ui = vld1q_f32(ai + j);
+
+        vst1q_f32(ar + j, vaddq_f32(ur, tr));
+        vst1q_f32(ai + j, vaddq_f32(ui, ti));
+        vst1q_f32(br + j, vsubq_f32(ur, tr));
+        vst1q_f32(bi + j, vsubq_f32(ui, ti));
+    }
+#elif defined(SSR_KERNELS_SSE)
+    for (; j + 4 <= count; j += 4) {
+        __m128 xr = _mm_loadu_ps(br + j);
+        __m128 xi = _mm_loadu_ps(bi + j);
+        __m128 cr = _mm_loadu_ps(wr + j);
+        __m128 ci = _mm_loadu_ps(wi + j);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+        __m128 ur = _mm_loadu_ps(ar + j);
+        __m128 ui = _mm_loadu_ps(ai + j);
+
+        _mm_storeu_ps(ar + j, _mm_add_ps(ur, tr));
+        _mm_storeu_ps(ai + j, _mm_add_ps(ui, ti));
+        _mm_storeu_ps(br + j, _mm_sub_ps(ur, tr));
+        _mm_storeu_ps(bi + j, _mm_sub_ps(ui, ti));
+    }
+#endif
+    for (; j < count; j++) {
+        float tr = br[j] * wr[j] - bi[j] * wi[j];
+        float ti = br[j] * wi[j] + bi[j] * wr[j];
+
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+    }
+}
+
+/* y += x * c over count bins */
+static void ssr_cmac(float *yr, float *yi, const float *xr, const float *xi,
+                     const float *cr, const float *ci, unsigned int count)
+{
+    unsigned int k = 0;
+
+#if defined(SSR_KERNELS_NEON)
+    for (; k + 4 <= count; k += 4) {
+        float32x4_t ar = vld1q_f32(xr + k);
+        float32x4_t ai = vld1q_f32(xi + k);
+        float32x4_t br = vld1q_f32(cr + k);
+        float32x4_t bi = vld1q_f32(ci + k);
+        float32x4_t sr = vld1q_f32(yr + k);
+        float32x4_t si = vld1q_f32(yi + k);
+
+        sr = vmlsq_f32(vmlaq_f32(sr, ar, br), ai, bi);
+        si = vmlaq_f32(vmlaq_f32(si, ar, bi), ai, br);
+        vst1q_f32(yr + k, sr);
+        vst1q_f32(yi + k, si);
+    }
+#elif defined(SSR_KERNELS_SSE)
+    for (; k + 4 <= count; k += 4) {
+        __m128 ar = _mm_loadu_ps(xr + k);
+        __m128 ai = _mm_loadu_ps(xi + k);
+        __m128 br = _mm_loadu_ps(cr + k);
+        __m128 bi = _mm_loadu_ps(ci + k);
+        __m128 sr = _mm_loadu_ps(yr + k);
+        __m128 si = _mm_loadu_ps(yi + k);
+
+        sr = _mm_add_ps(sr, _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi)));
+        si = _mm_add_ps(si, _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br)));
+        _mm_storeu_ps(yr + k, sr);
+        _mm_storeu_ps(yi + k, si);
+    }
+#endif
+    for (; k < count; k++) {
+        yr[k] += xr[k] * cr[k] - xi[k] * ci[k];
+        yi[k] += xr[k] * ci[k] + xi[k] * cr[k];
+    }
+}
+
+const char *ssr_engine_kernels(void)
+{
+#if defined(SSR_KERNELS_NEON)
+    return "neon";
+#elif defined(SSR_KERNELS_SSE)
+    return "sse";
+#else
+    return "c";
+#endif
+}
+
+/*
+ * In place radix-2 decimation in time of 1 << log2_size points, forward
+ * direction. Passing the imaginary part as re and the real part as im gives
+ * the unscaled inverse.
+ */
+static void ssr_fft(struct ssr_engine *engine, float *re, float *im,
+                    unsigned int log2_size)
+{
+    unsigned int size = 1 << log2_size;
+    unsigned int i, half, base;
+
+    for (i = 0; i < size; i++) {
+        unsigned int r = engine->bitrev[i] >> (SSR_LOG2_FFT_SIZE - log2_size);
+        float t;
+
+        if (i >= r)
+            continue;
+        t = re[i]; re[i] = re[r]; re[r] = t;
+        t = im[i]; im[i] = im[r]; im[r] = t;
+    }
+
+    for (half = 1; half < size; half <<= 1) {
+        const float *wr = engine->tw_re + half - 1;
+        const float *wi = engine->tw_im + half - 1;
+
+        for (base = 0; base < size; base += 2 * half)
+            ssr_butterflies(re + base, im + base,
+                            re + base + half, im + base + half,
+                            wr, wi, half);
+    }
+}
+
+static inline int16_t ssr_clamp16(float v)
+{
+    if (v >= 32767.0f)
+        return 32767;
+    if (v <= -32768.0f)
+        return -32768;
+    return (int16_t)(v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+static void ssr_process_block(struct ssr_engine *engine)
+{
+    float *re = engine->work_re;
+    float *im = engine->work_im;
+    unsigned int p, i, o, k, n;
+
+    /* two real microphones per transform, split again using symmetry */
+    for (p = 0; p < SSR_ENGINE_INPUTS / 2; p++) {
+        float *ar = engine->in_re + (2 * p) * SSR_BINS_STRIDE;
+        float *ai = engine->in_im + (2 * p) * SSR_BINS_STRIDE;
+        float *br = ar + SSR_BINS_STRIDE;
+        float *bi = ai + SSR_BINS_STRIDE;
+
+        for (n = 0; n < SSR_ENGINE_HOP; n++) {
+            re[n] = engine->in_buf[n * SSR_ENGINE_INPUTS + 2 * p];
+            im[n] = engine->in_buf[n * SSR_ENGINE_INPUTS + 2 * p + 1];
+        }
+        memset(re + SSR_ENGINE_HOP, 0, SSR_TAIL_SIZE * sizeof(float));
+        memset(im + SSR_ENGINE_HOP, 0, SSR_TAIL_SIZE * sizeof(float));
+        ssr_fft(engine, re, im, SSR_LOG2_FFT_SIZE);
+
+        for (k = 0; k < SSR_FFT_BINS; k++) {
+            unsigned int nk = (SSR_FFT_SIZE - k) & (SSR_FFT_SIZE - 1);
+
+            ar[k] = re[k] + re[nk];
+            ai[k] = im[k] - im[nk];
+            br[k] = im[k] + im[nk];
+            bi[k] = re[nk] - re[k];
+        }
+    }
+
+    for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+        float *yr = engine->out_re + o * SSR_BINS_STRIDE;
+        float *yi = engine->out_im + o * SSR_BINS_STRIDE;
+
+        memset(yr, 0, SSR_BINS_STRIDE * sizeof(float));
+        memset(yi, 0, SSR_BINS_STRIDE * sizeof(float));
+        for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+            size_t c = (i * SSR_ENGINE_OUTPUTS + o) * SSR_BINS_STRIDE;
+
+            ssr_cmac(yr, yi,
+                     engine->in_re + i * SSR_BINS_STRIDE,
+                     engine->in_im + i * SSR_BINS_STRIDE,
+                     engine->coeff_re + c, engine->coeff_im + c,
+                     SSR_FFT_BINS);
+        }
+    }
+
+    /* two real outputs per inverse transform, one in each part */
+    for (p = 0; p < SSR_ENGINE_OUTPUTS / 2; p++) {
+        const float *y1r = engine->out_re + (2 * p) * SSR_BINS_STRIDE;
+        const float *y1i = engine->out_im + (2 * p) * SSR_BINS_STRIDE;
+        const float *y2r = y1r + SSR_BINS_STRIDE;
+        const float *y2i = y1i + SSR_BINS_STRIDE;
+        float *tail1 = engine->tail + (2 * p) * SSR_TAIL_SIZE;
+        float *tail2 = tail1 + SSR_TAIL_SIZE;
+        int slot1 = engine->chan_map[2 * p];
+        int slot2 = engine->chan_map[2 * p + 1];
+
+        re[0] = y1r[0];
+        im[0] = y2r[0];
+        re[SSR_FFT_SIZE / 2] = y1r[SSR_FFT_SIZE / 2];
+        im[SSR_FFT_SIZE / 2] = y2r[SSR_FFT_SIZE / 2];
+        for (k = 1; k < SSR_FFT_SIZE / 2; k++) {
+            re[k] = y1r[k] - y2i[k];
+            im[k] = y1i[k] + y2r[k];
+            re[SSR_FFT_SIZE - k] = y1r[k] + y2i[k];
+            im[SSR_FFT_SIZE - k] = y2r[k] - y1i[k];
+        }
+        ssr_fft(engine, im, re, SSR_LOG2_FFT_SIZE);
+
+        for (n = 0; n < SSR_ENGINE_HOP; n++) {
+            int16_t *frame = engine->out_buf + n * SSR_ENGINE_OUTPUTS;
+
+            frame[slot1] = ssr_clamp16(re[n] + tail1[n]);
+            frame[slot2] = ssr_clamp16(im[n] + tail2[n]);
+        }
+        /* the tail spans several hops, shift it and add this block's part */
+        for (n = 0; n + SSR_ENGINE_HOP < SSR_TAIL_SIZE; n++) {
+            tail1[n] = tail1[n + SSR_ENGINE_HOP] + re[SSR_ENGINE_HOP + n];
+            tail2[n] = tail2[n + SSR_ENGINE_HOP] + im[SSR_ENGINE_HOP + n];
+        }
+        for (; n < SSR_TAIL_SIZE; n++) {
+            tail1[n] = re[SSR_ENGINE_HOP + n];
+            tail2[n] = im[SSR_ENGINE_HOP + n];
+        }
+    }
+}
+
+void ssr_engine_process(struct ssr_engine *engine, const int16_t *in,
+                        int16_t *out, size_t frames)
+{
+    while (frames > 0) {
+        size_t count = SSR_ENGINE_HOP - engine->fill;
+
+        if (count > frames)
+            count = frames;
+        memcpy(engine->in_buf + engine->fill * SSR_ENGINE_INPUTS, in,
+               count * SSR_ENGINE_INPUTS * sizeof(int16_t));
+        memcpy(out, engine->out_buf + engine->fill * SSR_ENGINE_OUTPUTS,
+               count * SSR_ENGINE_OUTPUTS * sizeof(int16_t));
+        in += count * SSR_ENGINE_INPUTS;
+        out += count * SSR_ENGINE_OUTPUTS;
+        frames -= count;
+        engine->fill += count;
+
+        if (engine->fill == SSR_ENGINE_HOP) {
+            ssr_process_block(engine);
+            engine->fill = 0;
+        }
+    }
+}
+
+void ssr_engine_reset(struct ssr_engine *engine)
+{
+    memset(engine->tail, 0,
+           SSR_ENGINE_OUTPUTS * SSR_TAIL_SIZE * sizeof(float));
+    memset(engine->out_buf, 0, sizeof(engine->out_buf));
+    engine->fill = 0;
+}
+
+static void ssr_fill_bins(int16_t *fr, int16_t *fi, unsigned int from,
+                          unsigned int to, int16_t value)
+{
+    for (; from < to; from++) {
+        fr[from] = value;
+        fi[from] = 0;
+    }
+}
+
+int ssr_engine_limit_bands(int16_t *const real_coeffs[SSR_ENGINE_INPUTS],
+                           int16_t *const imag_coeffs[SSR_ENGINE_INPUTS],
+                           const struct ssr_engine_bands *bands)
+{
+    unsigned int i, o;
+
+    if (bands->sub_woofer < 0 || bands->sub_woofer >= SSR_ENGINE_INPUTS ||
+        bands->lfe_output < 0 || bands->lfe_output >= SSR_ENGINE_OUTPUTS ||
+        bands->low_freq < 0 || bands->low_freq > SSR_ENGINE_BINS ||
+        bands->high_freq < 0 || bands->high_freq > SSR_ENGINE_BINS) {
+        ALOGE("%s: bad bands %d %d %d %d", __func__, bands->sub_woofer,
+              bands->low_freq, bands->high_freq, bands->lfe_output);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        /* unity in Q15 for the sub woofer input, nothing from the others */
+        int16_t pass = i == (unsigned int)bands->sub_woofer ? 32767 : 0;
+
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+            int16_t *fr = real_coeffs[i] + o * SSR_ENGINE_BINS;
+            int16_t *fi = imag_coeffs[i] + o * SSR_ENGINE_BINS;
+
+            if (o == (unsigned int)bands->lfe_output) {
+                ssr_fill_bins(fr, fi, 0, bands->low_freq, pass);
+                ssr_fill_bins(fr, fi, bands->low_freq, SSR_ENGINE_BINS, 0);
+            } else {
+                ssr_fill_bins(fr, fi, bands->high_freq, SSR_ENGINE_BINS, pass);
+            }
+        }
+    }
+    return 0;
+}
+
+struct ssr_engine *ssr_engine_create(int16_t *const real_coeffs[SSR_ENGINE_INPUTS],
+                                     int16_t *const imag_coeffs[SSR_ENGINE_INPUTS],
+                                     const int chan_map[SSR_ENGINE_OUTPUTS])
+{
+    struct ssr_engine *engine;
+    size_t coeff_floats = SSR_ENGINE_INPUTS * SSR_ENGINE_OUTPUTS * SSR_BINS_STRIDE;
+    size_t floats = 2 * SSR_FFT_SIZE +                     /* twiddles */
+                    2 * coeff_floats +
+                    2 * SSR_ENGINE_INPUTS * SSR_BINS_STRIDE +
+                    2 * SSR_ENGINE_OUTPUTS * SSR_BINS_STRIDE +
+                    2 * SSR_FFT_SIZE +                     /* scratch */
+                    SSR_ENGINE_OUTPUTS * SSR_TAIL_SIZE;    /* tails */
+    unsigned int i, o, k, half, mask = 0;
+    float *mem, *re, *im;
+
+    for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+        if (chan_map[o] < 0 || chan_map[o] >= SSR_ENGINE_OUTPUTS)
+            return NULL;
+        mask |= 1 << chan_map[o];
+    }
+    if (mask != (1 << SSR_ENGINE_OUTPUTS) - 1) {
+        ALOGE("%s: channel map is not a permutation", __func__);
+        return NULL;
+    }
+
+    engine = (struct ssr_engine *)calloc(1, sizeof(struct ssr_engine));
+    if (engine == NULL)
+        return NULL;
+    if (posix_memalign((void **)&mem, 16, floats * sizeof(float)) != 0) {
+        free(engine);
+        return NULL;
+    }
+    memset(mem, 0, floats * sizeof(float));
+    engine->mem = mem;
+    engine->tw_re = mem;        mem += SSR_FFT_SIZE;
+    engine->tw_im = mem;        mem += SSR_FFT_SIZE;
+    engine->coeff_re = mem;     mem += coeff_floats;
+    engine->coeff_im = mem;     mem += coeff_floats;
+    engine->in_re = mem;        mem += SSR_ENGINE_INPUTS * SSR_BINS_STRIDE;
+    engine->in_im = mem;        mem += SSR_ENGINE_INPUTS * SSR_BINS_STRIDE;
+    engine->out_re = mem;       mem += SSR_ENGINE_OUTPUTS * SSR_BINS_STRIDE;
+    engine->out_im = mem;       mem += SSR_ENGINE_OUTPUTS * SSR_BINS_STRIDE;
+    engine->work_re = mem;      mem += SSR_FFT_SIZE;
+    engine->work_im = mem;      mem += SSR_FFT_SIZE;
+    engine->tail = mem;
+
+    memcpy(engine->chan_map, chan_map, sizeof(engine->chan_map));
+
+    for (i = 0; i < SSR_FFT_SIZE; i++) {
+        unsigned int r = 0, v = i, b;
+
+        for (b = 0; b < SSR_LOG2_FFT_SIZE; b++) {
+            r = (r << 1) | (v & 1);
+            v >>= 1;
+        }
+        engine->bitrev[i] = r;
+    }
+    for (half = 1; half < SSR_FFT_SIZE; half <<= 1) {
+        for (k = 0; k < half; k++) {
+            double angle = -M_PI * k / half;
+
+            engine->tw_re[half - 1 + k] = (float)cos(angle);
+            engine->tw_im[half - 1 + k] = (float)sin(angle);
+        }
+    }
+
+    /*
+     * Each filter is inverse transformed back to its taps, which are then
+     * zero padded to the engine transform and transformed again.
+     */
+    re = engine->work_re;
+    im = engine->work_im;
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+            const int16_t *fr = real_coeffs[i] + o * SSR_ENGINE_BINS;
+            const int16_t *fi = imag_coeffs[i] + o * SSR_ENGINE_BINS;
+            size_t c = (i * SSR_ENGINE_OUTPUTS + o) * SSR_BINS_STRIDE;
+
+            /* real taps, so DC and Nyquist are real and the rest mirrors */
+            re[0] = fr[0];
+            im[0] = 0.0f;
+            re[SSR_ENGINE_TAPS / 2] = fr[SSR_ENGINE_BINS - 1];
+            im[SSR_ENGINE_TAPS / 2] = 0.0f;
+            for (k = 1; k < SSR_ENGINE_BINS - 1; k++) {
+                re[k] = fr[k];
+                im[k] = fi[k];
+                re[SSR_ENGINE_TAPS - k] = fr[k];
+                im[SSR_ENGINE_TAPS - k] = -fi[k];
+            }
+            ssr_fft(engine, im, re, SSR_LOG2_TAPS);
+
+            memset(re + SSR_ENGINE_TAPS, 0,
+                   (SSR_FFT_SIZE - SSR_ENGINE_TAPS) * sizeof(float));
+            memset(im, 0, SSR_FFT_SIZE * sizeof(float));
+            ssr_fft(engine, re, im, SSR_LOG2_FFT_SIZE);
+
+            for (k = 0; k < SSR_FFT_BINS; k++) {
+                engine->coeff_re[c + k] = re[k] * SSR_COEFF_SCALE;
+                engine->coeff_im[c + k] = im[k] * SSR_COEFF_SCALE;
+            }
+        }
+    }
+
+    ALOGD("%s: %s kernels", __func__, ssr_engine_kernels());
+    return engine;
+}
+
+void ssr_engine_destroy(struct ssr_engine *engine)
+{
+    if (engine == NULL)
+        return;
+    free(engine->mem);
+    free(engine);
+}
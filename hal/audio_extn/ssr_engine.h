@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SSR_ENGINE_H
+#define SSR_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Surround sound recording filter bank: 4 microphone channels in, 6 surround
+ * channels out. Each output is the sum of the 4 inputs, each convolved with
+ * its own filter by overlap-add in the frequency domain, a hop of 512 frames.
+ *
+ * Coefficients are in the format of the filter files shipped for SSR, one
+ * real and one imaginary array per input holding SSR_ENGINE_BINS Q15 values
+ * for each output in turn, output major. Those are the 1024 point spectrum of
+ * each filter, so a filter is taken as a causal FIR of up to SSR_ENGINE_TAPS
+ * taps. The engine transform is at least SSR_ENGINE_HOP + SSR_ENGINE_TAPS - 1
+ * long, so none of them wraps around into the block before.
+ */
+#define SSR_ENGINE_INPUTS        4
+#define SSR_ENGINE_OUTPUTS       6
+#define SSR_ENGINE_HOP           512
+#define SSR_ENGINE_BINS          513
+#define SSR_ENGINE_TAPS          ((SSR_ENGINE_BINS - 1) * 2)
+#define SSR_ENGINE_COEFF_SIZE    (SSR_ENGINE_BINS * SSR_ENGINE_OUTPUTS)
+
+struct ssr_engine;
+
+/*
+ * The band limits libsurround_proc applies to the filters, in bins of the
+ * coefficient files. Output lfe_output carries input sub_woofer alone, low
+ * passed to the bins below low_freq. The other outputs are only filtered
+ * below bin high_freq, above it they carry input sub_woofer as it is.
+ */
+struct ssr_engine_bands {
+    int sub_woofer;
+    int low_freq;
+    int high_freq;
+    int lfe_output;
+};
+
+/*
+ * Applies bands to coefficients in the file format, in place, before they
+ * are given to ssr_engine_create(). Returns -EINVAL for bands out of range.
+ */
+int ssr_engine_limit_bands(int16_t *const real_coeffs[SSR_ENGINE_INPUTS],
+                           int16_t *const imag_coeffs[SSR_ENGINE_INPUTS],
+                           const struct ssr_engine_bands *bands);
+
+/*
+ * chan_map[o] is the interleaved output slot filter output o is written to.
+ * test/ssr_engine_test checks a map against a capture of the old library.
+ */
+struct ssr_engine *ssr_engine_create(int16_t *const real_coeffs[SSR_ENGINE_INPUTS],
+                                     int16_t *const imag_coeffs[SSR_ENGINE_INPUTS],
+                                     const int chan_map[SSR_ENGINE_OUTPUTS]);
+void ssr_engine_destroy(struct ssr_engine *engine);
+void ssr_engine_reset(struct ssr_engine *engine);
+
+/*
+ * Any number of frames may be passed, output lags input by one hop.
+ * in holds SSR_ENGINE_INPUTS interleaved channels, out SSR_ENGINE_OUTPUTS.
+ */
+void ssr_engine_process(struct ssr_engine *engine, const int16_t *in,
+                        int16_t *out, size_t frames);
+
+/* "neon", "sse" or "c", whichever kernels were built */
+const char *ssr_engine_kernels(void);
+
+#endif /* SSR_ENGINE_H */
@@ -24,15 +24,25 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <cutils/str_parms.h>
+#include <cutils/uevent.h>
 #include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/stat.h>
 
 #include <system/audio.h>
+#include <system/thread_defs.h>
 #include <tinyalsa/asoundlib.h>
 
+#include "pcm_tap.h"
+
 #ifdef USB_HEADSET_ENABLED
 #define USB_LOW_LATENCY_OUTPUT_PERIOD_SIZE   512
 #define USB_LOW_LATENCY_OUTPUT_PERIOD_COUNT  8
@@ -46,11 +56,97 @@
 #define USB_PROXY_RATE_16000                 16000
 #define USB_PROXY_RATE_48000                 48000
 #define USB_PERIOD_SIZE                      2048
-#define USB_BUFF_SIZE                        2048
 #define AFE_PROXY_PERIOD_COUNT               32
 #define AFE_PROXY_PLAYBACK_DEVICE            8
 #define AFE_PROXY_CAPTURE_DEVICE             7
 
+/* Parsed stream0 descriptors are cached per card index */
+#define USB_MAX_CARDS                        8
+#define USB_MAX_ALTSETTINGS                  16
+#define USB_MAX_RATES                        16
+#define USB_STREAM_INFO_MAX_SIZE             8192
+#define USB_UEVENT_MSG_LEN                   2048
+#define USB_UEVENT_POLL_MS                   500
+
+#define USB_PLAYBACK                         0
+#define USB_CAPTURE                          1
+#define USB_DIRECTIONS                       2
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+/* one altsetting, either a list of rates or a continuous range */
+struct usb_altset_caps {
+    int interface;
+    int altset;
+    char format[16];
+    unsigned int channels;
+    unsigned int rates[USB_MAX_RATES];
+    unsigned int num_rates;
+    unsigned int min_rate;
+    unsigned int max_rate;
+};
+
+struct usb_dir_caps {
+    struct usb_altset_caps altsets[USB_MAX_ALTSETTINGS];
+    unsigned int num_altsets;
+};
+
+struct usb_card_caps {
+    bool valid;
+    struct usb_dir_caps dir[USB_DIRECTIONS];
+};
+
+/* Audio kept queued on the sink side of a forwarding thread, in sink
+ * periods, and the shortest sleep while waiting on either side */
+#define USB_FORWARD_TARGET_PERIODS           2
+#define USB_FORWARD_MIN_SLEEP_US             500
+
+/* Drift the rate converter may correct. The controller adds 1 ppm per
+ * frame of sink fill error, plus the error integrated at 1/2^KI_SHIFT
+ * of that per update; the fill is low passed over 2^FILL_SHIFT updates */
+#define USB_ASRC_MAX_CHANNELS                8
+#define USB_ASRC_MAX_PPM                     1000
+#define USB_ASRC_KI_SHIFT                    10
+#define USB_ASRC_FILL_SHIFT                  4
+
+/*
+ * Rate converter between two clocks at nominally the same rate. Output
+ * frames are linearly interpolated from the input. phase is the Q32
+ * position of the next output frame, 0 being the last input frame of the
+ * previous call which is kept in last[].
+ */
+struct usb_asrc {
+    unsigned int channels;
+    int64_t phase;
+    int64_t step;
+    int16_t last[USB_ASRC_MAX_CHANNELS];
+    int32_t fill;       /* << USB_ASRC_FILL_SHIFT */
+    int64_t integral;   /* << USB_ASRC_KI_SHIFT */
+    int32_t ppm;
+};
+
+/* One direction of the proxy, src is always read and dst written in place */
+struct usb_forward {
+    const char *name;
+    struct pcm *src;
+    struct pcm *dst;
+    unsigned int rate;
+    unsigned int src_buffer_size;
+    unsigned int dst_buffer_size;
+    unsigned int dst_period_size;
+    unsigned int target_fill;
+    bool src_started;
+    bool dst_started;
+    bool use_asrc;
+    uint32_t underruns;
+    uint32_t src_xruns;
+    uint32_t dst_xruns;
+    struct usb_asrc asrc;
+    struct pcm_tap *tap;
+};
+
 struct usb_module {
     uint32_t usb_card;
     uint32_t proxy_card;
@@ -75,6 +171,15 @@ struct usb_module {
     struct pcm *proxy_pcm_record_handle;
     struct pcm *usb_pcm_record_handle;
     struct audio_device *adev;
+
+    /* filled on first use or card add, dropped by uevents. Without the
+     * uevent thread nothing would drop them, so they are not reused */
+    pthread_mutex_t caps_lock;
+    struct usb_card_caps caps[USB_MAX_CARDS];
+    pthread_t uevent_thread;
+    bool uevent_thread_started;
+    volatile bool uevent_exit;
+    int uevent_fd;
 };
 
 static struct usb_module *usbmod = NULL;
@@ -132,210 +237,537 @@ static void initPlaybackVolume() {
     }
 }
 
-static int usb_get_numof_rates(char *rates_str)
+static int usb_read_stream_info(unsigned int card, char *buf, size_t size)
 {
-    int i, size = 0;
-    char *next_sr_string, *temp_ptr;
-    next_sr_string = strtok_r(rates_str, " ,", &temp_ptr);
+    char path[128];
+    size_t len = 0;
+    ssize_t n;
+    int fd;
 
-    if (next_sr_string == NULL) {
-        ALOGE("%s: get_numof_rates: could not find rates string", __func__);
-        return 0;
+    snprintf(path, sizeof(path), "/proc/asound/card%u/stream0", card);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("%s: error failed to open config file %s error: %d\n",
+              __func__, path, errno);
+        return -EINVAL;
+    }
+    while (len < size - 1) {
+        n = read(fd, buf + len, size - 1 - len);
+        if (n <= 0)
+            break;
+        len += n;
     }
+    buf[len] = '\0';
+    close(fd);
+    return len;
+}
 
-    for (i = 1; next_sr_string != NULL; i++) {
-        size ++;
-        next_sr_string = strtok_r(NULL, " ,.-", &temp_ptr);
+/* "44100, 48000" or "8000 - 48000 (continuous)" */
+static void usb_parse_rates(struct usb_altset_caps *alt, const char *str)
+{
+    unsigned int min_rate, max_rate;
+    unsigned long rate;
+    char *end;
+
+    if (strstr(str, "continuous") &&
+        sscanf(str, "%u - %u", &min_rate, &max_rate) == 2) {
+        alt->min_rate = min_rate;
+        alt->max_rate = max_rate;
+        return;
+    }
+    while (*str && alt->num_rates < USB_MAX_RATES) {
+        rate = strtoul(str, &end, 10);
+        if (end == str) {
+            str++;
+            continue;
+        }
+        alt->rates[alt->num_rates++] = rate;
+        str = end;
     }
-    return size;
 }
 
-static int usb_get_capability(char *type, int32_t *channels,
-                                    int32_t *sample_rate)
+/*
+ * Collects every altsetting listed in a stream0 file. The Status block of a
+ * running stream repeats Interface and Altset as "key = value" lines, those
+ * are skipped.
+ */
+static int usb_parse_stream_info(char *info, struct usb_card_caps *caps)
 {
-    ALOGD("%s: for %s", __func__, type);
-    long unsigned file_size;
-    FILE *fp;
-    char *buffer;
-    int32_t err = 1;
-    int32_t size = 0;
-    int32_t fd=-1, i, channels_playback;
-    char *str_start, *channel_start, *rates_str_start, *next_sr_str,
-         *next_sr_string, *temp_ptr;
-    struct stat st;
-    char *read_buf = NULL;
-    char *rates_str = NULL;
-    char *rates_str_for_val = NULL;
-    int  *rates_supported = NULL;
-    char path[128];
-    int ret = 0;
+    struct usb_dir_caps *dir = NULL;
+    struct usb_altset_caps *alt = NULL;
+    char *line, *saveptr;
+    int interface = 0;
+
+    memset(caps, 0, sizeof(*caps));
+    for (line = strtok_r(info, "\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\n", &saveptr)) {
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (!strncmp(line, "Playback:", 9)) {
+            dir = &caps->dir[USB_PLAYBACK];
+            alt = NULL;
+        } else if (!strncmp(line, "Capture:", 8)) {
+            dir = &caps->dir[USB_CAPTURE];
+            alt = NULL;
+        } else if (dir == NULL || strchr(line, '=') != NULL) {
+            continue;
+        } else if (!strncmp(line, "Interface", 9)) {
+            interface = atoi(line + 9);
+        } else if (!strncmp(line, "Altset", 6)) {
+            if (dir->num_altsets == USB_MAX_ALTSETTINGS) {
+                alt = NULL;
+                continue;
+            }
+            alt = &dir->altsets[dir->num_altsets++];
+            alt->interface = interface;
+            alt->altset = atoi(line + 6);
+        } else if (alt == NULL) {
+            continue;
+        } else if (!strncmp(line, "Format:", 7)) {
+            sscanf(line + 7, "%15s", alt->format);
+        } else if (!strncmp(line, "Channels:", 9)) {
+            alt->channels = atoi(line + 9);
+        } else if (!strncmp(line, "Rates:", 6)) {
+            usb_parse_rates(alt, line + 6);
+        }
+    }
 
-    memset(&st, 0x0, sizeof(struct stat));
-    *sample_rate = 0;
-    snprintf(path, sizeof(path), "/proc/asound/card%u/stream0",
-             usbmod->usb_card);
+    if (caps->dir[USB_PLAYBACK].num_altsets == 0 &&
+        caps->dir[USB_CAPTURE].num_altsets == 0)
+        return -EINVAL;
+    return 0;
+}
 
-    fd = open(path, O_RDONLY);
-    if (fd <0) {
-        ALOGE("%s: error failed to open config file %s error: %d\n",
-              __func__, path, errno);
+/*
+ * Returns the cached descriptor of a card, parsing it on first use. The
+ * cache is only trusted while the uevent thread is there to invalidate it,
+ * otherwise the descriptor is read again on every call.
+ * must be called with usbmod->caps_lock locked
+ */
+static struct usb_card_caps *usb_get_card_caps_l(unsigned int card)
+{
+    struct usb_card_caps *caps;
+    char *info;
+    unsigned int d, i;
+    int ret;
+
+    if (card >= USB_MAX_CARDS)
+        return NULL;
+    caps = &usbmod->caps[card];
+    if (caps->valid && usbmod->uevent_thread_started)
+        return caps;
+    caps->valid = false;
+
+    info = (char *)malloc(USB_STREAM_INFO_MAX_SIZE);
+    if (info == NULL)
+        return NULL;
+    ret = usb_read_stream_info(card, info, USB_STREAM_INFO_MAX_SIZE);
+    if (ret > 0)
+        ret = usb_parse_stream_info(info, caps);
+    else
         ret = -EINVAL;
-        goto done;
+    free(info);
+    if (ret < 0) {
+        ALOGE("%s: no usable stream info for card %u", __func__, card);
+        return NULL;
     }
 
-    if (fstat(fd, &st) < 0) {
-        ALOGE("%s: error failed to stat %s error %d\n",
-             __func__, path, errno);
-        ret = -EINVAL;
-        goto done;
-    }
+    for (d = 0; d < USB_DIRECTIONS; d++) {
+        for (i = 0; i < caps->dir[d].num_altsets; i++) {
+            struct usb_altset_caps *alt = &caps->dir[d].altsets[i];
 
-    file_size = st.st_size;
+            ALOGD("%s: card %u %s if %d alt %d %s ch %u rates %u (%u-%u)",
+                  __func__, card, d == USB_PLAYBACK ? "playback" : "capture",
+                  alt->interface, alt->altset, alt->format, alt->channels,
+                  alt->num_rates, alt->min_rate, alt->max_rate);
+        }
+    }
+    caps->valid = true;
+    return caps;
+}
 
-    read_buf = (char *)calloc(1, USB_BUFF_SIZE + 1);
+static bool usb_altset_supports_rate(const struct usb_altset_caps *alt,
+                                     unsigned int rate)
+{
+    unsigned int i;
 
-    if (!read_buf) {
-        ALOGE("Failed to create read_buf");
-        ret = -ENOMEM;
-        goto done;
+    if (alt->max_rate != 0)
+        return rate >= alt->min_rate && rate <= alt->max_rate;
+    for (i = 0; i < alt->num_rates; i++) {
+        if (alt->rates[i] == rate)
+            return true;
     }
+    return false;
+}
 
-    err = read(fd, read_buf, USB_BUFF_SIZE);
-    str_start = strstr(read_buf, type);
-    if (str_start == NULL) {
-        ALOGE("%s: error %s section not found in usb config file",
-               __func__, type);
-        ret = -EINVAL;
-        goto done;
-    }
+/*
+ * The proxy port is how the DSP reads from and writes to the device, so
+ * only 16 bit altsettings at one of its rates qualify. The highest rate
+ * wins, then stereo over mono.
+ */
+static int usb_get_capability(int direction, int32_t *channels,
+                              int32_t *sample_rate)
+{
+    static const int32_t proxy_rates[] = {
+        USB_PROXY_RATE_48000, USB_PROXY_RATE_16000, USB_PROXY_RATE_8000
+    };
+    const struct usb_card_caps *caps;
+    const struct usb_dir_caps *dir;
+    unsigned int i, r;
+    int ret = -EINVAL;
 
-    channel_start = strstr(str_start, "Channels:");
-    if (channel_start == NULL) {
-        ALOGE("%s: error could not find Channels information", __func__);
-        ret = -EINVAL;
+    *sample_rate = 0;
+    pthread_mutex_lock(&usbmod->caps_lock);
+    caps = usb_get_card_caps_l(usbmod->usb_card);
+    if (caps == NULL)
         goto done;
-    }
 
-    channel_start = strstr(channel_start, " ");
-    if (channel_start == NULL) {
-        ALOGE("%s: error channel section not found in usb config file",
-               __func__);
-        ret = -EINVAL;
-        goto done;
+    dir = &caps->dir[direction];
+    for (r = 0; r < ARRAY_SIZE(proxy_rates) && ret != 0; r++) {
+        for (i = 0; i < dir->num_altsets; i++) {
+            const struct usb_altset_caps *alt = &dir->altsets[i];
+
+            if (strcmp(alt->format, "S16_LE") ||
+                !usb_altset_supports_rate(alt, proxy_rates[r]))
+                continue;
+            if (ret == 0 && *channels == 2)
+                break;
+            *sample_rate = proxy_rates[r];
+            *channels = (alt->channels == 1) ? 1 : 2;
+            ret = 0;
+        }
     }
+    ALOGD("%s: %s channels %d sample_rate %d", __func__,
+          direction == USB_PLAYBACK ? "playback" : "capture",
+          *channels, *sample_rate);
 
-    channels_playback = atoi(channel_start);
-    if (channels_playback == 1) {
-        *channels = 1;
-    } else {
-        *channels = 2;
-    }
+done:
+    pthread_mutex_unlock(&usbmod->caps_lock);
+    return ret;
+}
 
-    ALOGD("%s: channels supported by device: %d", __func__, *channels);
-    rates_str_start = strstr(str_start, "Rates:");
-    if (rates_str_start == NULL) {
-        ALOGE("%s: error cant find rates information", __func__);
-        ret = -EINVAL;
-        goto done;
+/* drops the cached descriptor of a card that changed, refilling it on add */
+static void usb_handle_uevent(const char *msg, int len)
+{
+    const char *end = msg + len;
+    const char *action = NULL, *devpath = NULL, *subsystem = NULL;
+    const char *node;
+    unsigned int card;
+    int consumed = 0;
+
+    for (; msg < end; msg += strlen(msg) + 1) {
+        if (!strncmp(msg, "ACTION=", 7))
+            action = msg + 7;
+        else if (!strncmp(msg, "DEVPATH=", 8))
+            devpath = msg + 8;
+        else if (!strncmp(msg, "SUBSYSTEM=", 10))
+            subsystem = msg + 10;
     }
+    if (action == NULL || devpath == NULL || subsystem == NULL ||
+        strcmp(subsystem, "sound"))
+        return;
 
-    rates_str_start = strstr(rates_str_start, " ");
-    if (rates_str_start == NULL) {
-        ALOGE("%s: error channel section not found in usb config file",
-               __func__);
-        ret = -EINVAL;
-        goto done;
-    }
+    node = strrchr(devpath, '/');
+    if (node == NULL || sscanf(node, "/card%u%n", &card, &consumed) != 1 ||
+        node[consumed] != '\0' || card >= USB_MAX_CARDS)
+        return;
 
-    char *target = strchr(rates_str_start, '\n');
-    if (target == NULL) {
-        ALOGE("%s: error end of line not found", __func__);
-        ret = -EINVAL;
-        goto done;
+    ALOGD("%s: %s card %u", __func__, action, card);
+    pthread_mutex_lock(&usbmod->caps_lock);
+    usbmod->caps[card].valid = false;
+    if (!strcmp(action, "add") || !strcmp(action, "change"))
+        usb_get_card_caps_l(card);
+    pthread_mutex_unlock(&usbmod->caps_lock);
+}
+
+static void *usb_uevent_thread_loop(void *context __unused)
+{
+    char msg[USB_UEVENT_MSG_LEN + 2];
+    struct pollfd pfd;
+    int n;
+
+    prctl(PR_SET_NAME, (unsigned long)"USB Uevent", 0, 0, 0);
+
+    pfd.fd = usbmod->uevent_fd;
+    pfd.events = POLLIN;
+    while (!usbmod->uevent_exit) {
+        if (poll(&pfd, 1, USB_UEVENT_POLL_MS) <= 0)
+            continue;
+        n = uevent_kernel_multicast_recv(usbmod->uevent_fd, msg,
+                                         USB_UEVENT_MSG_LEN);
+        if (n <= 0 || n >= USB_UEVENT_MSG_LEN)
+            continue;
+        msg[n] = '\0';
+        msg[n + 1] = '\0';
+        usb_handle_uevent(msg, n);
     }
+    return NULL;
+}
 
-    size = target - rates_str_start;
-    if ((rates_str = (char *)malloc(size + 1)) == NULL) {
-        ALOGE("%s: error unable to allocate memory to hold sample rate strings",
-              __func__);
-        ret = -EINVAL;
-        goto done;
+static void usb_asrc_reset(struct usb_asrc *asrc, unsigned int channels,
+                           unsigned int fill)
+{
+    memset(asrc, 0, sizeof(*asrc));
+    asrc->channels = channels;
+    asrc->phase = 1LL << 32;
+    asrc->step = 1LL << 32;
+    asrc->fill = fill << USB_ASRC_FILL_SHIFT;
+}
+
+/*
+ * Steers the conversion ratio from how much the sink has queued: a sink
+ * filling up is consuming slower than the source produces, so each output
+ * frame has to take a little more input.
+ */
+static void usb_asrc_update(struct usb_asrc *asrc, unsigned int fill,
+                            unsigned int target)
+{
+    int64_t limit = (int64_t)USB_ASRC_MAX_PPM << USB_ASRC_KI_SHIFT;
+    int64_t ppm;
+    int32_t error;
+
+    asrc->fill += ((int32_t)(fill << USB_ASRC_FILL_SHIFT) - asrc->fill) >>
+                  USB_ASRC_FILL_SHIFT;
+    error = (asrc->fill >> USB_ASRC_FILL_SHIFT) - (int32_t)target;
+
+    asrc->integral += error;
+    if (asrc->integral > limit)
+        asrc->integral = limit;
+    else if (asrc->integral < -limit)
+        asrc->integral = -limit;
+
+    ppm = error + (asrc->integral >> USB_ASRC_KI_SHIFT);
+    if (ppm > USB_ASRC_MAX_PPM)
+        ppm = USB_ASRC_MAX_PPM;
+    else if (ppm < -USB_ASRC_MAX_PPM)
+        ppm = -USB_ASRC_MAX_PPM;
+
+    asrc->ppm = (int32_t)ppm;
+    asrc->step = (1LL << 32) + ppm * (1LL << 32) / 1000000;
+}
+
+/* converts until either side runs out, both counts are updated in place */
+static void usb_asrc_process(struct usb_asrc *asrc, const int16_t *in,
+                             unsigned int *in_frames, int16_t *out,
+                             unsigned int *out_frames)
+{
+    unsigned int channels = asrc->channels;
+    unsigned int avail = *in_frames;
+    unsigned int produced = 0;
+    unsigned int used, c;
+    int64_t phase = asrc->phase;
+
+    while (produced < *out_frames) {
+        unsigned int i = (unsigned int)(phase >> 32);
+        int64_t frac = (uint32_t)phase;
+        const int16_t *a, *b;
+
+        if (i >= avail)
+            break;
+        a = (i == 0) ? asrc->last : in + (i - 1) * channels;
+        b = in + i * channels;
+        for (c = 0; c < channels; c++)
+            out[c] = a[c] + (int16_t)(((b[c] - a[c]) * frac) >> 32);
+        out += channels;
+        produced++;
+        phase += asrc->step;
     }
 
-    if ((rates_str_for_val = (char *)malloc(size + 1)) == NULL) {
-        ALOGE("%s: error unable to allocate memory to hold sample rate string",
-               __func__);
-        ret = -EINVAL;
-        goto done;
+    used = (unsigned int)(phase >> 32);
+    if (used > avail)
+        used = avail;
+    if (used > 0) {
+        memcpy(asrc->last, in + (used - 1) * channels,
+               channels * sizeof(int16_t));
+        phase -= (int64_t)used << 32;
     }
+    asrc->phase = phase;
+    *in_frames = used;
+    *out_frames = produced;
+}
 
-    memcpy(rates_str, rates_str_start, size);
-    memcpy(rates_str_for_val, rates_str_start, size);
-    rates_str[size] = '\0';
-    rates_str_for_val[size] = '\0';
+static void usb_forward_init(struct usb_forward *fwd, const char *name,
+                             struct pcm *src, struct pcm *dst,
+                             unsigned int rate, unsigned int channels,
+                             unsigned int dst_period_size)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    char tap_name[32];
+
+    memset(fwd, 0, sizeof(*fwd));
+    fwd->name = name;
+    fwd->src = src;
+    fwd->dst = dst;
+    fwd->rate = rate;
+    fwd->src_buffer_size = pcm_get_buffer_size(src);
+    fwd->dst_buffer_size = pcm_get_buffer_size(dst);
+    fwd->dst_period_size = dst_period_size;
+    fwd->target_fill = dst_period_size * USB_FORWARD_TARGET_PERIODS;
+    if (fwd->target_fill > fwd->dst_buffer_size / 2)
+        fwd->target_fill = fwd->dst_buffer_size / 2;
+
+    property_get("audio.usb.asrc.enabled", value, "true");
+    fwd->use_asrc = (atoi(value) || !strncmp("true", value, 4)) &&
+                    channels <= USB_ASRC_MAX_CHANNELS;
+    usb_asrc_reset(&fwd->asrc, channels, fwd->target_fill);
+
+    snprintf(tap_name, sizeof(tap_name), "usb_%s", name);
+    fwd->tap = pcm_tap_open(tap_name);
+
+    ALOGD("%s: %s rate %u channels %u sink buffer %u target %u asrc %d",
+          __func__, name, rate, channels, fwd->dst_buffer_size,
+          fwd->target_fill, fwd->use_asrc);
+}
 
-    size = usb_get_numof_rates(rates_str);
-    if (!size) {
-        ALOGE("%s: error could not get rate size, returning", __func__);
-        ret = -EINVAL;
-        goto done;
+static void usb_forward_sleep(struct usb_forward *fwd, unsigned int frames)
+{
+    struct timespec ts;
+    uint64_t us = (uint64_t)frames * 1000000 / fwd->rate;
+
+    if (us < USB_FORWARD_MIN_SLEEP_US)
+        us = USB_FORWARD_MIN_SLEEP_US;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+/*
+ * Moves what the source has captured straight into the sink's DMA buffer,
+ * through the rate converter when it is enabled. Only one contiguous
+ * region of each buffer is handled per call. Returns the frames queued on
+ * the sink or a negative errno.
+ */
+static int usb_forward_transfer(struct usb_forward *fwd, unsigned int src_avail,
+                                unsigned int dst_avail)
+{
+    unsigned int src_offset, dst_offset;
+    unsigned int src_frames = src_avail;
+    unsigned int dst_frames = dst_avail;
+    void *src_areas, *dst_areas;
+    const int16_t *in;
+    int16_t *out;
+
+    if (pcm_mmap_begin(fwd->src, &src_areas, &src_offset, &src_frames) < 0 ||
+        pcm_mmap_begin(fwd->dst, &dst_areas, &dst_offset, &dst_frames) < 0)
+        return -EIO;
+
+    in = (const int16_t *)((uint8_t *)src_areas +
+                           pcm_frames_to_bytes(fwd->src, src_offset));
+    out = (int16_t *)((uint8_t *)dst_areas +
+                      pcm_frames_to_bytes(fwd->dst, dst_offset));
+    if (fwd->use_asrc) {
+        usb_asrc_process(&fwd->asrc, in, &src_frames, out, &dst_frames);
+    } else {
+        if (dst_frames > src_frames)
+            dst_frames = src_frames;
+        src_frames = dst_frames;
+        memcpy(out, in, pcm_frames_to_bytes(fwd->dst, dst_frames));
     }
+    pcm_tap_write(fwd->tap, out, pcm_frames_to_bytes(fwd->dst, dst_frames));
 
-    rates_supported = (int *)malloc(sizeof(int) * size);
+    if (pcm_mmap_commit(fwd->src, src_offset, src_frames) < 0 ||
+        pcm_mmap_commit(fwd->dst, dst_offset, dst_frames) < 0)
+        return -EIO;
+    return dst_frames;
+}
 
-    if (!rates_supported) {
-        ALOGE("couldn't allocate mem for rates_supported");
-        ret = -EINVAL;
-        goto done;
-    }
+/* queues silence on the sink, a NOIRQ stream would replay stale data */
+static void usb_forward_pad(struct usb_forward *fwd, unsigned int frames)
+{
+    unsigned int offset;
+    void *areas;
 
-    next_sr_string = strtok_r(rates_str_for_val, " ,", &temp_ptr);
-    if (next_sr_string == NULL) {
-        ALOGE("%s: error could not get first rate val", __func__);
-        ret = -EINVAL;
-        goto done;
-    }
+    if (pcm_mmap_begin(fwd->dst, &areas, &offset, &frames) < 0)
+        return;
+    memset((uint8_t *)areas + pcm_frames_to_bytes(fwd->dst, offset), 0,
+           pcm_frames_to_bytes(fwd->dst, frames));
+    pcm_mmap_commit(fwd->dst, offset, frames);
+}
+
+static void usb_forward_run(struct usb_forward *fwd, volatile bool *running)
+{
+    unsigned int poll_frames = fwd->dst_period_size / 4;
+
+    while (*running) {
+        int src_avail, dst_avail, ret;
+        unsigned int fill;
+
+        if (!fwd->src_started) {
+            if (pcm_start(fwd->src) < 0) {
+                ALOGE("%s: %s source start failed: %s", __func__, fwd->name,
+                      pcm_get_error(fwd->src));
+                usb_forward_sleep(fwd, fwd->dst_period_size);
+                continue;
+            }
+            fwd->src_started = true;
+        }
 
-    rates_supported[0] = atoi(next_sr_string);
-    ALOGD("%s: rates_supported[0] for playback: %d",
-           __func__, rates_supported[0]);
-    for (i = 1; i<size; i++) {
-        next_sr_string = strtok_r(NULL, " ,.-", &temp_ptr);
-        if (next_sr_string == NULL) {
-            rates_supported[i] = -1; // fill in an invalid sr for the rest
+        /*
+         * With stop_threshold at INT_MAX neither pcm ever stops on an xrun,
+         * the hardware pointer just runs more than a buffer past ours.
+         * pcm_prepare() puts both pointers back together.
+         */
+        src_avail = pcm_avail_update(fwd->src);
+        if (src_avail < 0 || (unsigned int)src_avail > fwd->src_buffer_size) {
+            fwd->src_xruns++;
+            ALOGW("%s: %s source overrun (avail %d), %u so far", __func__,
+                  fwd->name, src_avail, fwd->src_xruns);
+            pcm_prepare(fwd->src);
+            fwd->src_started = false;
             continue;
         }
-        rates_supported[i] = atoi(next_sr_string);
-        ALOGD("rates_supported[%d] for playback: %d",i, rates_supported[i]);
-    }
-
-    for (i = 0; i<size; i++) {
-        if ((rates_supported[i] > *sample_rate) &&
-            (rates_supported[i] <= 48000)) {
-            /* Sample Rate should be one of the proxy supported rates only
-               This is because proxy port is used to read from/write to DSP */
-            if ((rates_supported[i] == USB_PROXY_RATE_8000) ||
-                (rates_supported[i] == USB_PROXY_RATE_16000) ||
-                (rates_supported[i] == USB_PROXY_RATE_48000)) {
-                *sample_rate = rates_supported[i];
+        dst_avail = pcm_avail_update(fwd->dst);
+        if (dst_avail < 0 || (unsigned int)dst_avail > fwd->dst_buffer_size) {
+            fwd->dst_xruns++;
+            ALOGW("%s: %s sink underrun (avail %d), %u so far", __func__,
+                  fwd->name, dst_avail, fwd->dst_xruns);
+            pcm_prepare(fwd->dst);
+            fwd->dst_started = false;
+            usb_asrc_reset(&fwd->asrc, fwd->asrc.channels, fwd->target_fill);
+            continue;
+        }
+        fill = fwd->dst_buffer_size - dst_avail;
+
+        if (fwd->use_asrc && fwd->dst_started)
+            usb_asrc_update(&fwd->asrc, fill, fwd->target_fill);
+
+        if ((unsigned int)src_avail < poll_frames || dst_avail == 0) {
+            if (src_avail == 0 && fwd->dst_started &&
+                fill < fwd->dst_period_size) {
+                usb_forward_pad(fwd, fwd->dst_period_size);
+                fwd->underruns++;
             }
+            usb_forward_sleep(fwd, poll_frames);
+            continue;
+        }
+
+        ret = usb_forward_transfer(fwd, src_avail, dst_avail);
+        if (ret < 0) {
+            ALOGE("%s: %s transfer failed %d", __func__, fwd->name, ret);
+            usb_forward_sleep(fwd, poll_frames);
+            continue;
+        }
+
+        if (!fwd->dst_started && fill + ret >= fwd->target_fill) {
+            if (pcm_start(fwd->dst) < 0)
+                ALOGE("%s: %s sink start failed: %s", __func__, fwd->name,
+                      pcm_get_error(fwd->dst));
+            else
+                fwd->dst_started = true;
         }
     }
-    ALOGD("%s: sample_rate: %d", __func__, *sample_rate);
 
-done:
-    if (fd >= 0) close(fd);
-    if (rates_str_for_val) free(rates_str_for_val);
-    if (rates_str) free(rates_str);
-    if (rates_supported) free(rates_supported);
-    if (read_buf) free(read_buf);
-    return ret;
+    ALOGD("%s: %s done, %u underruns, %u source and %u sink xruns, "
+          "last correction %d ppm", __func__, fwd->name, fwd->underruns,
+          fwd->src_xruns, fwd->dst_xruns, fwd->asrc.ppm);
+    pcm_tap_close(fwd->tap);
+    fwd->tap = NULL;
 }
 
 static int32_t usb_playback_entry(void *adev)
 {
-    unsigned char usbbuf[USB_PROXY_PERIOD_SIZE] = {0};
-    int32_t ret, bytes, proxy_open_retry_count;
+    struct usb_forward fwd;
+    int32_t ret, proxy_open_retry_count;
 
     ALOGD("%s: entry", __func__);
     /* update audio device pointer */
@@ -344,7 +776,7 @@ static int32_t usb_playback_entry(void *adev)
 
     /* get capabilities */
     pthread_mutex_lock(&usbmod->usb_playback_lock);
-    ret = usb_get_capability((char *)"Playback:",
+    ret = usb_get_capability(USB_PLAYBACK,
             &usbmod->channels_playback, &usbmod->sample_rate_playback);
     if (ret) {
         ALOGE("%s: could not get playback capabilities from usb device",
@@ -419,19 +851,12 @@ static int32_t usb_playback_entry(void *adev)
 
     ALOGD("Init USB volume");
     initPlaybackVolume();
-    /* main loop to read from proxy and write to usb */
-    while (usbmod->is_playback_running) {
-        /* read data from proxy */
-        ret = pcm_mmap_read(usbmod->proxy_pcm_playback_handle,
-                                 (void *)usbbuf, USB_PROXY_PERIOD_SIZE);
-        /* Write to usb */
-        ret = pcm_mmap_write(usbmod->usb_pcm_playback_handle,
-                                (void *)usbbuf, USB_PROXY_PERIOD_SIZE);
-        if(!usbmod->is_playback_running)
-            break;
-
-        memset(usbbuf, 0, USB_PROXY_PERIOD_SIZE);
-    } /* main loop end */
+    /* forward from proxy to usb until stopped */
+    usb_forward_init(&fwd, "playback", usbmod->proxy_pcm_playback_handle,
+                     usbmod->usb_pcm_playback_handle,
+                     usbmod->sample_rate_playback, usbmod->channels_playback,
+                     USB_PERIOD_SIZE/4);
+    usb_forward_run(&fwd, &usbmod->is_playback_running);
 
     ALOGD("%s: exiting USB playback thread",__func__);
     return 0;
@@ -441,6 +866,9 @@ static void* usb_playback_launcher(void *adev)
 {
     int32_t ret;
 
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    prctl(PR_SET_NAME, (unsigned long)"USB Playback", 0, 0, 0);
+
     usbmod->is_playback_running = true;
     ret = usb_playback_entry(adev);
 
@@ -453,8 +881,8 @@ static void* usb_playback_launcher(void *adev)
 
 static int32_t usb_record_entry(void *adev)
 {
-    unsigned char usbbuf[USB_PROXY_PERIOD_SIZE] = {0};
-    int32_t ret, bytes, proxy_open_retry_count;
+    struct usb_forward fwd;
+    int32_t ret, proxy_open_retry_count;
     ALOGD("%s: entry", __func__);
 
     /* update audio device pointer */
@@ -463,7 +891,7 @@ static int32_t usb_record_entry(void *adev)
 
     /* get capabilities */
     pthread_mutex_lock(&usbmod->usb_record_lock);
-    ret = usb_get_capability((char *)"Capture:",
+    ret = usb_get_capability(USB_CAPTURE,
             &usbmod->channels_record, &usbmod->sample_rate_record);
     if (ret) {
         ALOGE("%s: could not get capture capabilities from usb device",
@@ -535,19 +963,12 @@ static int32_t usb_record_entry(void *adev)
     ALOGD("%s: PROXY configured for capture", __func__);
     pthread_mutex_unlock(&usbmod->usb_record_lock);
 
-    /* main loop to read from usb and write to proxy */
-    while (usbmod->is_record_running) {
-        /* read data from usb */
-        ret = pcm_mmap_read(usbmod->usb_pcm_record_handle,
-                                 (void *)usbbuf, USB_PROXY_PERIOD_SIZE);
-        /* Write to proxy */
-        ret = pcm_mmap_write(usbmod->proxy_pcm_record_handle,
-                                (void *)usbbuf, USB_PROXY_PERIOD_SIZE);
-        if(!usbmod->is_record_running)
-            break;
-
-        memset(usbbuf, 0, USB_PROXY_PERIOD_SIZE);
-    } /* main loop end */
+    /* forward from usb to proxy until stopped */
+    usb_forward_init(&fwd, "capture", usbmod->usb_pcm_record_handle,
+                     usbmod->proxy_pcm_record_handle,
+                     usbmod->sample_rate_record, usbmod->channels_record,
+                     USB_PROXY_PERIOD_SIZE/4);
+    usb_forward_run(&fwd, &usbmod->is_record_running);
 
     ALOGD("%s: exiting USB capture thread",__func__);
     return 0;
@@ -557,6 +978,9 @@ static void* usb_capture_launcher(void *adev)
 {
     int32_t ret;
 
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    prctl(PR_SET_NAME, (unsigned long)"USB Capture", 0, 0, 0);
+
     usbmod->is_record_running = true;
     ret = usb_record_entry(adev);
 
@@ -590,11 +1014,37 @@ void audio_extn_usb_init(void *adev)
                         (const pthread_mutexattr_t *) NULL);
      pthread_mutex_init(&usbmod->usb_record_lock,
                         (const pthread_mutexattr_t *) NULL);
+
+    if (!usbmod->uevent_thread_started) {
+        pthread_mutex_init(&usbmod->caps_lock,
+                           (const pthread_mutexattr_t *) NULL);
+        usbmod->uevent_exit = false;
+        usbmod->uevent_fd = uevent_open_socket(64 * 1024, true);
+        if (usbmod->uevent_fd < 0) {
+            ALOGE("%s: uevent socket failed, capabilities are not cached",
+                  __func__);
+        } else if (pthread_create(&usbmod->uevent_thread, NULL,
+                                  usb_uevent_thread_loop, NULL) == 0) {
+            usbmod->uevent_thread_started = true;
+        } else {
+            ALOGE("%s: uevent thread failed, capabilities are not cached",
+                  __func__);
+            close(usbmod->uevent_fd);
+            usbmod->uevent_fd = -1;
+        }
+    }
 }
 
 void audio_extn_usb_deinit()
 {
     if (NULL != usbmod){
+        if (usbmod->uevent_thread_started) {
+            usbmod->uevent_exit = true;
+            pthread_join(usbmod->uevent_thread, NULL);
+        }
+        if (usbmod->uevent_fd >= 0)
+            close(usbmod->uevent_fd);
+        pthread_mutex_destroy(&usbmod->caps_lock);
         free(usbmod);
         usbmod = NULL;
     }
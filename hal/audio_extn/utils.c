@@ -21,6 +21,9 @@
 /* #define LOG_NDEBUG 0 */
 
 #include <errno.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
 #include <cutils/properties.h>
 #include <cutils/config_utils.h>
 #include <stdlib.h>
@@ -28,6 +31,8 @@
 #include <cutils/str_parms.h>
 #include <cutils/log.h>
 #include <cutils/misc.h>
+#include <cutils/sched_policy.h>
+#include <system/thread_defs.h>
 
 #include "audio_hw.h"
 #include "platform.h"
@@ -49,6 +54,8 @@
 #define STRING_TO_ENUM(string) { #string, string }
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+#define CAL_QUEUE_SIZE 16
+
 #define BASE_TABLE_SIZE 64
 #define MAX_BASEINDEX_LEN 256
 
@@ -583,12 +590,216 @@ exit_send_app_type_cfg:
     return rc;
 }
 
+/*
+ * ACDB sends can take tens of ms, so they are handed to a worker thread and
+ * the stream start only waits for them right before the session is started,
+ * see audio_extn_utils_wait_for_calibration(). The last calibration queued
+ * for each direction is remembered and an identical request is dropped, the
+ * kernel still holds it. Both are enabled by audio.calibration.async.enabled,
+ * without it every request goes to ACDB in the caller's context as before.
+ */
+struct cal_job {
+    snd_device_t snd_device;
+    int app_type;
+    int sample_rate;
+};
+
+enum {
+    CAL_DIR_RX,
+    CAL_DIR_TX,
+    CAL_DIR_MAX,
+};
+
+struct cal_worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    bool async;
+    bool running;
+    bool exit;
+    void *platform;
+    struct cal_job queue[CAL_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int count;
+    /* the barrier waits for completed to catch up with submitted */
+    uint32_t submitted;
+    uint32_t completed;
+    struct cal_job last[CAL_DIR_MAX];
+    bool last_valid[CAL_DIR_MAX];
+};
+
+static struct cal_worker cal_worker = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static int cal_direction(snd_device_t snd_device)
+{
+    if (snd_device >= SND_DEVICE_OUT_BEGIN && snd_device < SND_DEVICE_OUT_END)
+        return CAL_DIR_RX;
+    return CAL_DIR_TX;
+}
+
+static void *cal_worker_loop(void *context __unused)
+{
+    struct cal_job job;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    set_sched_policy(0, SP_FOREGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"Audio Calibration", 0, 0, 0);
+
+    pthread_mutex_lock(&cal_worker.lock);
+    while (1) {
+        if (cal_worker.count == 0) {
+            if (cal_worker.exit)
+                break;
+            pthread_cond_wait(&cal_worker.work_cond, &cal_worker.lock);
+            continue;
+        }
+        job = cal_worker.queue[cal_worker.head];
+        cal_worker.head = (cal_worker.head + 1) % CAL_QUEUE_SIZE;
+        cal_worker.count--;
+        /* a full queue may be waiting for this slot */
+        pthread_cond_broadcast(&cal_worker.done_cond);
+        pthread_mutex_unlock(&cal_worker.lock);
+
+        ALOGV("%s: snd_device(%d) app_type(%d) sample_rate(%d)", __func__,
+              job.snd_device, job.app_type, job.sample_rate);
+        platform_send_audio_calibration(cal_worker.platform, job.snd_device,
+                                        job.app_type, job.sample_rate);
+
+        pthread_mutex_lock(&cal_worker.lock);
+        cal_worker.completed++;
+        pthread_cond_broadcast(&cal_worker.done_cond);
+    }
+    pthread_mutex_unlock(&cal_worker.lock);
+    return NULL;
+}
+
+void audio_extn_utils_calibration_init(struct audio_device *adev)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    cal_worker.platform = adev->platform;
+    cal_worker.head = 0;
+    cal_worker.count = 0;
+    cal_worker.submitted = 0;
+    cal_worker.completed = 0;
+    cal_worker.exit = false;
+    audio_extn_utils_reset_calibration_cache();
+
+    property_get("audio.calibration.async.enabled", value, NULL);
+    cal_worker.async = atoi(value) || !strncmp("true", value, 4);
+    if (!cal_worker.async)
+        return;
+
+    if (pthread_create(&cal_worker.thread, (const pthread_attr_t *) NULL,
+                       cal_worker_loop, NULL)) {
+        ALOGE("%s: failed to create calibration thread", __func__);
+        return;
+    }
+    cal_worker.running = true;
+}
+
+void audio_extn_utils_calibration_deinit(void)
+{
+    if (!cal_worker.running)
+        return;
+
+    pthread_mutex_lock(&cal_worker.lock);
+    cal_worker.exit = true;
+    pthread_cond_signal(&cal_worker.work_cond);
+    pthread_mutex_unlock(&cal_worker.lock);
+    pthread_join(cal_worker.thread, (void **) NULL);
+    cal_worker.running = false;
+}
+
+/* calibration stored in the kernel is lost on SSR */
+void audio_extn_utils_reset_calibration_cache(void)
+{
+    pthread_mutex_lock(&cal_worker.lock);
+    memset(cal_worker.last_valid, 0, sizeof(cal_worker.last_valid));
+    pthread_mutex_unlock(&cal_worker.lock);
+}
+
+void audio_extn_utils_wait_for_calibration(void)
+{
+    uint32_t target;
+
+    if (!cal_worker.running)
+        return;
+
+    pthread_mutex_lock(&cal_worker.lock);
+    target = cal_worker.submitted;
+    while ((int32_t)(cal_worker.completed - target) < 0)
+        pthread_cond_wait(&cal_worker.done_cond, &cal_worker.lock);
+    pthread_mutex_unlock(&cal_worker.lock);
+}
+
+static void queue_audio_calibration(snd_device_t snd_device, int app_type,
+                                    int sample_rate)
+{
+    int dir = cal_direction(snd_device);
+    struct cal_job *last = &cal_worker.last[dir];
+
+    if (!cal_worker.async) {
+        platform_send_audio_calibration(cal_worker.platform, snd_device,
+                                        app_type, sample_rate);
+        return;
+    }
+
+    pthread_mutex_lock(&cal_worker.lock);
+    if (cal_worker.last_valid[dir] && last->snd_device == snd_device &&
+        last->app_type == app_type && last->sample_rate == sample_rate) {
+        pthread_mutex_unlock(&cal_worker.lock);
+        ALOGV("%s: snd_device(%d) app_type(%d) sample_rate(%d) already sent",
+              __func__, snd_device, app_type, sample_rate);
+        return;
+    }
+    last->snd_device = snd_device;
+    last->app_type = app_type;
+    last->sample_rate = sample_rate;
+    cal_worker.last_valid[dir] = true;
+
+    if (!cal_worker.running) {
+        pthread_mutex_unlock(&cal_worker.lock);
+        platform_send_audio_calibration(cal_worker.platform, snd_device,
+                                        app_type, sample_rate);
+        return;
+    }
+
+    while (cal_worker.count == CAL_QUEUE_SIZE)
+        pthread_cond_wait(&cal_worker.done_cond, &cal_worker.lock);
+    cal_worker.queue[(cal_worker.head + cal_worker.count) % CAL_QUEUE_SIZE] =
+            (struct cal_job) { snd_device, app_type, sample_rate };
+    cal_worker.count++;
+    cal_worker.submitted++;
+    pthread_cond_signal(&cal_worker.work_cond);
+    pthread_mutex_unlock(&cal_worker.lock);
+}
+
+/*
+ * For callers that need the calibration in place on return, ordered after
+ * anything still queued.
+ */
+void audio_extn_utils_send_audio_calibration_sync(snd_device_t snd_device,
+                                                  int app_type,
+                                                  int sample_rate)
+{
+    queue_audio_calibration(snd_device, app_type, sample_rate);
+    audio_extn_utils_wait_for_calibration();
+}
+
 void audio_extn_utils_send_audio_calibration(struct audio_device *adev,
                                              struct audio_usecase *usecase)
 {
     int type = usecase->type;
     int rc;
 
+    /* the per usecase path talks to ACDB directly, keep it ordered */
+    audio_extn_utils_wait_for_calibration();
     rc = platform_send_audio_calibration_for_usecase(adev->platform, usecase);
     if (rc != -ENOSYS) {
         return;
@@ -599,22 +810,22 @@ void audio_extn_utils_send_audio_calibration(struct audio_device *adev,
         int snd_device = usecase->out_snd_device;
         snd_device = (snd_device == SND_DEVICE_OUT_SPEAKER) ?
                      audio_extn_get_spkr_prot_snd_device(snd_device) : snd_device;
-        platform_send_audio_calibration(adev->platform, usecase->out_snd_device,
-                                        out->app_type_cfg.app_type,
-                                        out->app_type_cfg.sample_rate);
+        queue_audio_calibration(usecase->out_snd_device,
+                                out->app_type_cfg.app_type,
+                                out->app_type_cfg.sample_rate);
     }
     if ((type == PCM_HFP_CALL) || (type == PCM_CAPTURE)) {
         if ((type == PCM_CAPTURE) & voice_is_in_call_rec_stream(usecase->stream.in)) {
             snd_device_t incall_record_snd_device =
                         voice_get_incall_rec_snd_device(usecase->in_snd_device);
-            platform_send_audio_calibration(adev->platform, incall_record_snd_device,
-                                            platform_get_default_app_type(adev->platform),
-                                            48000);
+            queue_audio_calibration(incall_record_snd_device,
+                                    platform_get_default_app_type(adev->platform),
+                                    48000);
         } else {
             /* when app type is default. the sample rate is not used to send cal */
-            platform_send_audio_calibration(adev->platform, usecase->in_snd_device,
-                                            platform_get_default_app_type(adev->platform),
-                                            48000);
+            queue_audio_calibration(usecase->in_snd_device,
+                                    platform_get_default_app_type(adev->platform),
+                                    48000);
         }
     }
 }
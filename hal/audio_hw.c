@@ -48,6 +48,7 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
 #include <math.h>
 #include <dlfcn.h>
@@ -69,6 +70,7 @@
 #include <platform.h>
 #include "audio_extn.h"
 #include "voice_extn.h"
+#include "proxy_capture.h"
 
 #include "sound/compress_params.h"
 #include "sound/asound.h"
@@ -81,6 +83,41 @@
 #define PROXY_OPEN_RETRY_COUNT           100
 #define PROXY_OPEN_WAIT_TIME             20
 
+/* Shortest and longest stall tolerated while waiting on an mmap pcm */
+#define MMAP_PLAYBACK_MIN_SLEEP_US       500
+#define MMAP_PLAYBACK_MAX_STALL_US       500000
+
+/* Restarts of a failed stream back off from one buffer duration up to this,
+ * and streams slower than the budget to come back after SSR are reported */
+#define STREAM_ERROR_BACKOFF_SHIFT_MAX   4
+#define STREAM_ERROR_BACKOFF_MAX_US      500000
+#define STREAM_RECOVERY_BUDGET_US        1000000
+
+/* Periods of deep buffer data queued between out_write and the pcm */
+#define DEEP_BUFFER_RING_PERIOD_COUNT    2
+
+/* Periods of captured data held for in_read, beyond that frames are lost */
+#define CAPTURE_RING_PERIOD_COUNT        4
+
+/* How long positions are predicted from the clock model before the driver
+ * is read again, and how far off a reading restarts the model */
+#define POSITION_MODEL_REFRESH_NS        50000000LL
+#define POSITION_MODEL_RESYNC_US         50000
+
+/* Spare audio_usecase nodes kept for reuse, see alloc_usecase() */
+#define USECASE_FREE_LIST_MAX            8
+
+/* Adaptive offload buffering: how long one fragment should last at the
+ * stream's byte rate, the least audio the DSP should hold in total, and how
+ * much playback a session needs before its rates are trusted */
+#define OFFLOAD_FRAGMENT_TARGET_MS       5000
+#define OFFLOAD_BUFFER_MIN_MS            3000
+#define OFFLOAD_MAX_FRAGMENTS            8
+#define OFFLOAD_RATE_MIN_RENDERED_MS     2000
+
+/* Retry delay when a parked pcm cannot be closed because its stream is busy */
+#define WARM_STANDBY_RETRY_US            10000
+
 #define USECASE_AUDIO_PLAYBACK_PRIMARY USECASE_AUDIO_PLAYBACK_DEEP_BUFFER
 
 #define MIXER_CTL_COMPRESS_PLAYBACK_VOLUME "Compress Playback Volume"
@@ -289,7 +326,7 @@ static int check_and_set_gapless_mode(struct audio_device *adev) {
     property_get("audio.offload.gapless.enabled", value, NULL);
     gapless_enabled = atoi(value) || !strncmp("true", value, 4);
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
                                __func__, mixer_ctl_name);
@@ -371,16 +408,136 @@ int get_snd_card_state(struct audio_device *adev)
 
 static int set_snd_card_state(struct audio_device *adev, int snd_scard_state)
 {
+    struct sound_card_status *card;
+    int64_t now_us = latency_now_us();
+
     if (!adev)
         return -ENOSYS;
 
-    pthread_mutex_lock(&adev->snd_card_status.lock);
-    adev->snd_card_status.state = snd_scard_state;
-    pthread_mutex_unlock(&adev->snd_card_status.lock);
+    card = &adev->snd_card_status;
+    pthread_mutex_lock(&card->lock);
+    if (card->state != snd_scard_state) {
+        card->state = snd_scard_state;
+        card->state_seq++;
+        if (snd_scard_state == SND_CARD_STATE_OFFLINE) {
+            card->offline_us = now_us;
+        } else {
+            card->online_seq++;
+            card->online_us = now_us;
+            /* the first ONLINE after boot is no recovery */
+            if (card->offline_us != 0) {
+                latency_hist_add(&card->offline_hist, now_us - card->offline_us);
+                ALOGD("%s: card back after %lld ms", __func__,
+                      (long long)(now_us - card->offline_us) / 1000);
+            }
+        }
+        /* parked streams retry right away instead of sleeping it out */
+        pthread_cond_broadcast(&card->cond);
+    }
+    pthread_mutex_unlock(&card->lock);
 
     return 0;
 }
 
+/*
+ * Called instead of sleeping for the buffer duration when a stream's io
+ * failed, or when the stream is parked and may not restart yet. A failure
+ * pushes the next restart out, exponentially while the card stays online
+ * up to STREAM_ERROR_BACKOFF_MAX_US. The client is then held until that
+ * restart is due, or for a buffer duration while the card is offline, but
+ * the wait ends as soon as the card changes state.
+ */
+static void stream_error_park(struct audio_device *adev,
+                              struct stream_error_state *err, int64_t buffer_us,
+                              bool failed)
+{
+    struct sound_card_status *card = &adev->snd_card_status;
+    int64_t now_us = latency_now_us();
+    int64_t backoff_us, until_us;
+    unsigned int shift;
+    uint32_t seq;
+    struct timespec ts;
+
+    pthread_mutex_lock(&card->lock);
+    if (failed) {
+        if (err->online_seq != card->online_seq)
+            err->failures = 0;
+        err->failures++;
+        err->online_seq = card->online_seq;
+        shift = err->failures - 1;
+        if (shift > STREAM_ERROR_BACKOFF_SHIFT_MAX)
+            shift = STREAM_ERROR_BACKOFF_SHIFT_MAX;
+        backoff_us = buffer_us << shift;
+        if (backoff_us > STREAM_ERROR_BACKOFF_MAX_US)
+            backoff_us = STREAM_ERROR_BACKOFF_MAX_US;
+        err->retry_us = now_us + backoff_us;
+    }
+
+    if (card->state == SND_CARD_STATE_OFFLINE)
+        until_us = now_us + buffer_us;
+    else
+        until_us = err->retry_us;
+    if (until_us <= now_us) {
+        pthread_mutex_unlock(&card->lock);
+        return;
+    }
+
+    /* card->cond runs on CLOCK_MONOTONIC, like latency_now_us() */
+    ts.tv_sec = until_us / 1000000;
+    ts.tv_nsec = (until_us % 1000000) * 1000;
+    seq = card->state_seq;
+    while (card->state_seq == seq) {
+        if (pthread_cond_timedwait(&card->cond, &card->lock, &ts) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&card->lock);
+}
+
+/* whether a parked stream may try to start its session again */
+static bool stream_error_may_retry(struct audio_device *adev,
+                                   struct stream_error_state *err)
+{
+    struct sound_card_status *card = &adev->snd_card_status;
+    bool retry;
+
+    if (err->failures == 0)
+        return true;
+
+    pthread_mutex_lock(&card->lock);
+    if (card->state == SND_CARD_STATE_OFFLINE)
+        retry = false;
+    else if (err->online_seq != card->online_seq)
+        retry = true;   /* back from SSR, all parked streams go at once */
+    else
+        retry = latency_now_us() >= err->retry_us;
+    pthread_mutex_unlock(&card->lock);
+
+    return retry;
+}
+
+/* called after a successful read or write */
+static void stream_error_clear(struct audio_device *adev,
+                               struct stream_error_state *err,
+                               const char *name)
+{
+    struct sound_card_status *card = &adev->snd_card_status;
+    int64_t restart_us;
+
+    if (err->failures == 0)
+        return;
+
+    pthread_mutex_lock(&card->lock);
+    if (err->online_seq != card->online_seq) {
+        restart_us = latency_now_us() - card->online_us;
+        latency_hist_add(&card->restart_hist, restart_us);
+        if (restart_us > STREAM_RECOVERY_BUDGET_US)
+            ALOGW("%s: %s took %lld ms to come back after SSR", __func__,
+                  name, (long long)restart_us / 1000);
+    }
+    pthread_mutex_unlock(&card->lock);
+    err->failures = 0;
+}
+
 static int enable_audio_route_for_voice_usecases(struct audio_device *adev,
                                                  struct audio_usecase *uc_info)
 {
@@ -414,6 +571,92 @@ int pcm_ioctl(struct pcm *pcm, int request, ...)
     return ioctl(pcm_fd, request, arg);
 }
 
+/* pthread_mutex_lock() that records how long the caller had to wait */
+static void timed_mutex_lock(pthread_mutex_t *lock, struct latency_hist *hist)
+{
+    int64_t start_us;
+
+    if (pthread_mutex_trylock(lock) == 0) {
+        latency_hist_add(hist, 0);
+        return;
+    }
+    start_us = latency_now_us();
+    pthread_mutex_lock(lock);
+    latency_hist_add_since(hist, start_us);
+}
+
+static void dump_stream_latency_stats(struct stream_latency_stats *stats,
+                                      const char *io_name, int fd)
+{
+    latency_hist_dump(&stats->io, io_name, fd);
+    latency_hist_dump(&stats->lock_wait, "stream_lock_wait", fd);
+    latency_hist_dump(&stats->adev_lock_wait, "adev_lock_wait", fd);
+    latency_hist_dump(&stats->start, "start", fd);
+    latency_hist_dump(&stats->offload_cmd, "offload_cmd", fd);
+}
+
+static void format_stream_latency_stats(struct stream_latency_stats *stats,
+                                        const char *io_name, char *buf,
+                                        size_t size)
+{
+    buf[0] = '\0';
+    latency_hist_format(&stats->io, io_name, buf, size);
+    latency_hist_format(&stats->lock_wait, "stream_lock_wait", buf, size);
+    latency_hist_format(&stats->adev_lock_wait, "adev_lock_wait", buf, size);
+    latency_hist_format(&stats->start, "start", buf, size);
+    latency_hist_format(&stats->offload_cmd, "offload_cmd", buf, size);
+}
+
+/*
+ * While a route transaction is open, mixer path changes are only staged in
+ * audio_route and the resulting control diff is written out once on commit,
+ * so a path that is reset and applied again within one device switch does
+ * not touch the hardware.
+ * must be called with hw device mutex locked
+ */
+static void begin_route_transaction(struct audio_device *adev)
+{
+    adev->route_txn_depth++;
+}
+
+/*
+ * Writes out what is staged so far, for callers that need the routes in
+ * place before they go on, e.g. before opening a pcm on them.
+ * must be called with hw device mutex locked
+ */
+void flush_route_transaction(struct audio_device *adev)
+{
+    if (adev->route_txn_depth > 0)
+        audio_route_update_mixer(adev->audio_route);
+}
+
+/* must be called with hw device mutex locked */
+static void commit_route_transaction(struct audio_device *adev)
+{
+    if (adev->route_txn_depth <= 0) {
+        ALOGE("%s: no open route transaction", __func__);
+        return;
+    }
+    if (--adev->route_txn_depth == 0)
+        audio_route_update_mixer(adev->audio_route);
+}
+
+static void apply_mixer_path(struct audio_device *adev, const char *path)
+{
+    if (adev->route_txn_depth > 0)
+        audio_route_apply_path(adev->audio_route, path);
+    else
+        audio_route_apply_and_update_path(adev->audio_route, path);
+}
+
+static void reset_mixer_path(struct audio_device *adev, const char *path)
+{
+    if (adev->route_txn_depth > 0)
+        audio_route_reset_path(adev->audio_route, path);
+    else
+        audio_route_reset_and_update_path(adev->audio_route, path);
+}
+
 int enable_audio_route(struct audio_device *adev,
                        struct audio_usecase *usecase)
 {
@@ -448,7 +691,7 @@ int enable_audio_route(struct audio_device *adev,
     strlcpy(mixer_path, use_case_table[usecase->id], MIXER_PATH_MAX_LENGTH );
     platform_add_backend_name(mixer_path, snd_device);
     ALOGV("%s: apply mixer and update path: %s", __func__, mixer_path);
-    audio_route_apply_and_update_path(adev->audio_route, mixer_path);
+    apply_mixer_path(adev, mixer_path);
     ALOGV("%s: exit", __func__);
     return 0;
 }
@@ -476,7 +719,7 @@ int disable_audio_route(struct audio_device *adev,
     strlcpy(mixer_path, use_case_table[usecase->id], MIXER_PATH_MAX_LENGTH);
     platform_add_backend_name(mixer_path, snd_device);
     ALOGV("%s: reset and update mixer path: %s", __func__, mixer_path);
-    audio_route_reset_and_update_path(adev->audio_route, mixer_path);
+    reset_mixer_path(adev, mixer_path);
     audio_extn_sound_trigger_update_stream_status(usecase, ST_EVENT_STREAM_FREE);
     audio_extn_listen_update_stream_status(usecase, LISTEN_EVENT_STREAM_FREE);
     ALOGV("%s: exit", __func__);
@@ -546,7 +789,7 @@ int enable_snd_device(struct audio_device *adev,
             return -EINVAL;
         }
         audio_extn_dev_arbi_acquire(snd_device);
-        audio_route_apply_and_update_path(adev->audio_route, device_name);
+        apply_mixer_path(adev, device_name);
     }
     return 0;
 }
@@ -590,7 +833,7 @@ int disable_snd_device(struct audio_device *adev,
             audio_extn_spkr_prot_is_enabled()) {
             audio_extn_spkr_prot_stop_processing(snd_device);
         } else {
-            audio_route_reset_and_update_path(adev->audio_route, device_name);
+            reset_mixer_path(adev, device_name);
             audio_extn_dev_arbi_release(snd_device);
         }
 
@@ -607,10 +850,9 @@ static void check_usecases_codec_backend(struct audio_device *adev,
                                           struct audio_usecase *uc_info,
                                           snd_device_t snd_device)
 {
-    struct listnode *node;
     struct audio_usecase *usecase;
     bool switch_device[AUDIO_USECASE_MAX];
-    int i, num_uc_to_switch = 0;
+    int i, uc_id, num_uc_to_switch = 0;
 
     /*
      * This function is to make sure that all the usecases that are active on
@@ -636,8 +878,8 @@ static void check_usecases_codec_backend(struct audio_device *adev,
     for (i = 0; i < AUDIO_USECASE_MAX; i++)
         switch_device[i] = false;
 
-    list_for_each(node, &adev->usecase_list) {
-        usecase = node_to_item(node, struct audio_usecase, list);
+    for_each_active_usecase(adev, uc_id) {
+        usecase = adev->usecase_index[uc_id];
         if (usecase->type != PCM_CAPTURE &&
                 usecase != uc_info &&
                 (usecase->out_snd_device != snd_device || force_routing)  &&
@@ -656,15 +898,15 @@ static void check_usecases_codec_backend(struct audio_device *adev,
 
         /* Make sure the previous devices to be disabled first and then enable the
            selected devices */
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             if (switch_device[usecase->id]) {
                 disable_snd_device(adev, usecase->out_snd_device);
             }
         }
 
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             if (switch_device[usecase->id]) {
                 enable_snd_device(adev, snd_device);
             }
@@ -672,8 +914,8 @@ static void check_usecases_codec_backend(struct audio_device *adev,
 
         /* Re-route all the usecases on the shared backend other than the
            specified usecase to new snd devices */
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             /* Update the out_snd_device only before enabling the audio route */
             if (switch_device[usecase->id] ) {
                 usecase->out_snd_device = snd_device;
@@ -688,10 +930,9 @@ static void check_and_route_capture_usecases(struct audio_device *adev,
                                              struct audio_usecase *uc_info,
                                              snd_device_t snd_device)
 {
-    struct listnode *node;
     struct audio_usecase *usecase;
     bool switch_device[AUDIO_USECASE_MAX];
-    int i, num_uc_to_switch = 0;
+    int i, uc_id, num_uc_to_switch = 0;
 
     /*
      * This function is to make sure that all the active capture usecases
@@ -706,8 +947,8 @@ static void check_and_route_capture_usecases(struct audio_device *adev,
     for (i = 0; i < AUDIO_USECASE_MAX; i++)
         switch_device[i] = false;
 
-    list_for_each(node, &adev->usecase_list) {
-        usecase = node_to_item(node, struct audio_usecase, list);
+    for_each_active_usecase(adev, uc_id) {
+        usecase = adev->usecase_index[uc_id];
         if (usecase->type != PCM_PLAYBACK &&
                 usecase != uc_info &&
                 usecase->in_snd_device != snd_device &&
@@ -726,15 +967,15 @@ static void check_and_route_capture_usecases(struct audio_device *adev,
 
         /* Make sure the previous devices to be disabled first and then enable the
            selected devices */
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             if (switch_device[usecase->id]) {
                 disable_snd_device(adev, usecase->in_snd_device);
             }
         }
 
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             if (switch_device[usecase->id]) {
                 enable_snd_device(adev, snd_device);
             }
@@ -742,8 +983,8 @@ static void check_and_route_capture_usecases(struct audio_device *adev,
 
         /* Re-route all the usecases on the shared backend other than the
            specified usecase to new snd devices */
-        list_for_each(node, &adev->usecase_list) {
-            usecase = node_to_item(node, struct audio_usecase, list);
+        for_each_active_usecase(adev, uc_id) {
+            usecase = adev->usecase_index[uc_id];
             /* Update the in_snd_device only before enabling the audio route */
             if (switch_device[usecase->id] ) {
                 usecase->in_snd_device = snd_device;
@@ -793,10 +1034,10 @@ static int read_hdmi_channel_masks(struct stream_out *out)
 static audio_usecase_t get_voice_usecase_id_from_list(struct audio_device *adev)
 {
     struct audio_usecase *usecase;
-    struct listnode *node;
+    int uc_id;
 
-    list_for_each(node, &adev->usecase_list) {
-        usecase = node_to_item(node, struct audio_usecase, list);
+    for_each_active_usecase(adev, uc_id) {
+        usecase = adev->usecase_index[uc_id];
         if (usecase->type == VOICE_CALL) {
             ALOGV("%s: usecase id %d", __func__, usecase->id);
             return usecase->id;
@@ -807,16 +1048,99 @@ static audio_usecase_t get_voice_usecase_id_from_list(struct audio_device *adev)
 
 struct audio_usecase *get_usecase_from_list(struct audio_device *adev,
                                             audio_usecase_t uc_id)
+{
+    if ((int)uc_id < 0 || uc_id >= AUDIO_USECASE_MAX)
+        return NULL;
+
+    return adev->usecase_index[uc_id];
+}
+
+int next_active_usecase(struct audio_device *adev, int uc_id)
+{
+    int word = uc_id / 32;
+    uint32_t bits;
+
+    if (uc_id >= AUDIO_USECASE_MAX)
+        return AUDIO_USECASE_MAX;
+
+    bits = adev->active_usecases[word] & (~0U << (uc_id % 32));
+    while (!bits) {
+        if (++word >= USECASE_MASK_WORDS)
+            return AUDIO_USECASE_MAX;
+        bits = adev->active_usecases[word];
+    }
+    return word * 32 + __builtin_ctz(bits);
+}
+
+/*
+ * Stream start and stop recycle their usecase nodes instead of going to the
+ * heap each time. Nodes come back zeroed, as from calloc().
+ * must be called with hw device mutex locked
+ */
+struct audio_usecase *alloc_usecase(struct audio_device *adev)
+{
+    struct audio_usecase *usecase;
+    struct listnode *node;
+
+    if (list_empty(&adev->usecase_free_list))
+        return (struct audio_usecase *)calloc(1, sizeof(struct audio_usecase));
+
+    node = list_head(&adev->usecase_free_list);
+    list_remove(node);
+    adev->usecase_free_count--;
+    usecase = node_to_item(node, struct audio_usecase, list);
+    memset(usecase, 0, sizeof(*usecase));
+    return usecase;
+}
+
+/* must be called with hw device mutex locked */
+void release_usecase(struct audio_device *adev, struct audio_usecase *usecase)
+{
+    if (adev->usecase_free_count >= USECASE_FREE_LIST_MAX) {
+        free(usecase);
+        return;
+    }
+    list_add_tail(&adev->usecase_free_list, &usecase->list);
+    adev->usecase_free_count++;
+}
+
+/* must be called with hw device mutex locked */
+void add_usecase_to_list(struct audio_device *adev,
+                         struct audio_usecase *uc_info)
+{
+    list_add_tail(&adev->usecase_list, &uc_info->list);
+
+    /* the first instance of an id wins, as with the old list walk */
+    if (adev->usecase_index[uc_info->id] == NULL) {
+        adev->usecase_index[uc_info->id] = uc_info;
+        adev->active_usecases[uc_info->id / 32] |= 1U << (uc_info->id % 32);
+    }
+}
+
+/* must be called with hw device mutex locked */
+void remove_usecase_from_list(struct audio_device *adev,
+                              struct audio_usecase *uc_info)
 {
     struct audio_usecase *usecase;
     struct listnode *node;
 
+    list_remove(&uc_info->list);
+
+    if (adev->usecase_index[uc_info->id] != uc_info)
+        return;
+
+    adev->usecase_index[uc_info->id] = NULL;
+    adev->active_usecases[uc_info->id / 32] &= ~(1U << (uc_info->id % 32));
+
+    /* only voip can have the same id twice, promote the remaining one */
     list_for_each(node, &adev->usecase_list) {
         usecase = node_to_item(node, struct audio_usecase, list);
-        if (usecase->id == uc_id)
-            return usecase;
+        if (usecase->id == uc_info->id) {
+            adev->usecase_index[usecase->id] = usecase;
+            adev->active_usecases[usecase->id / 32] |= 1U << (usecase->id % 32);
+            break;
+        }
     }
-    return NULL;
 }
 
 int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
@@ -830,6 +1154,7 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
     audio_usecase_t hfp_ucid;
     struct listnode *node;
     int status = 0;
+    int64_t switch_start_us;
 
     usecase = get_usecase_from_list(adev, uc_id);
     if (usecase == NULL) {
@@ -915,6 +1240,13 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
           out_snd_device, platform_get_snd_device_name(out_snd_device),
           in_snd_device,  platform_get_snd_device_name(in_snd_device));
 
+    /*
+     * Stage the whole switch, including the other usecases moved by
+     * check_usecases_codec_backend(), and write the net control diff once.
+     */
+    switch_start_us = latency_now_us();
+    begin_route_transaction(adev);
+
     /*
      * Limitation: While in call, to do a device switch we need to disable
      * and enable both RX and TX devices though one of them is same as current
@@ -944,6 +1276,7 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
     if ((usecase->type == VOICE_CALL) &&
         (usecase->in_snd_device != SND_DEVICE_NONE) &&
         (usecase->out_snd_device != SND_DEVICE_NONE)) {
+        flush_route_transaction(adev);
         status = platform_switch_voice_call_enable_device_config(adev->platform,
                                                                  out_snd_device,
                                                                  in_snd_device);
@@ -962,6 +1295,8 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
     }
 
     if (usecase->type == VOICE_CALL || usecase->type == VOIP_CALL) {
+        flush_route_transaction(adev);
+        audio_extn_utils_wait_for_calibration();
         status = platform_switch_voice_call_device_post(adev->platform,
                                                         out_snd_device,
                                                         in_snd_device);
@@ -984,6 +1319,7 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
     }
 
     enable_audio_route(adev, usecase);
+    commit_route_transaction(adev);
 
     /* Applicable only on the targets that has external modem.
      * Enable device command should be sent to modem only after
@@ -993,6 +1329,7 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
         status = platform_switch_voice_call_usecase_route_post(adev->platform,
                                                                out_snd_device,
                                                                in_snd_device);
+    latency_hist_add_since(&adev->device_switch_hist, switch_start_us);
     ALOGD("%s: done",__func__);
 
     return status;
@@ -1029,13 +1366,17 @@ static int stop_input_stream(struct stream_in *in)
     /* 2. Disable the tx device */
     disable_snd_device(adev, uc_info->in_snd_device);
 
-    list_remove(&uc_info->list);
-    free(uc_info);
+    remove_usecase_from_list(adev, uc_info);
+    release_usecase(adev, uc_info);
 
     ALOGV("%s: exit: status(%d)", __func__, ret);
     return ret;
 }
 
+/*
+ * must be called with in->lock and adev->lock locked, adev->lock is
+ * released while the pcm is being opened
+ */
 int start_input_stream(struct stream_in *in)
 {
     /* 1. Enable output device and stream routing controls */
@@ -1072,7 +1413,7 @@ int start_input_stream(struct stream_in *in)
     }
 
     adev->active_input = in;
-    uc_info = (struct audio_usecase *)calloc(1, sizeof(struct audio_usecase));
+    uc_info = alloc_usecase(adev);
 
     if (!uc_info) {
         ret = -ENOMEM;
@@ -1086,7 +1427,7 @@ int start_input_stream(struct stream_in *in)
     uc_info->in_snd_device = SND_DEVICE_NONE;
     uc_info->out_snd_device = SND_DEVICE_NONE;
 
-    list_add_tail(&adev->usecase_list, &uc_info->list);
+    add_usecase_to_list(adev, uc_info);
     select_devices(adev, in->usecase);
 
     ALOGV("%s: Opening PCM device card_id(%d) device_id(%d), channels %d",
@@ -1098,8 +1439,13 @@ int start_input_stream(struct stream_in *in)
     if (in->usecase == USECASE_AUDIO_RECORD_AFE_PROXY) {
         flags |= PCM_MMAP | PCM_NOIRQ;
         pcm_open_retry_count = PROXY_OPEN_RETRY_COUNT;
+    } else if (in->use_ring) {
+        /* capture timestamps are compared against CLOCK_MONOTONIC */
+        flags |= PCM_MONOTONIC;
     }
 
+    /* routing is in place, the session open does not need adev->lock */
+    pthread_mutex_unlock(&adev->lock);
     while (1) {
         in->pcm = pcm_open(adev->snd_card, in->pcm_device_id,
                            flags, &in->config);
@@ -1111,13 +1457,17 @@ int start_input_stream(struct stream_in *in)
             }
             if (pcm_open_retry_count-- == 0) {
                 ret = -EIO;
-                goto error_open;
+                break;
             }
             usleep(PROXY_OPEN_WAIT_TIME * 1000);
             continue;
         }
         break;
     }
+    audio_extn_utils_wait_for_calibration();
+    pthread_mutex_lock(&adev->lock);
+    if (ret != 0)
+        goto error_open;
 
     if (uc_info->in_snd_device != SND_DEVICE_NONE) {
         if (audio_extn_ext_hw_plugin_usecase_start(adev->ext_hw_plugin, uc_info))
@@ -1137,30 +1487,188 @@ error_config:
     return ret;
 }
 
-/* must be called with out->lock locked */
+/*
+ * Commands are never dropped. A write wait is only queued once, so the last
+ * slot is kept for it and a drain that finds the rest taken waits for the
+ * offload thread to free one.
+ * must be called with out->lock locked
+ */
 static int send_offload_cmd_l(struct stream_out* out, int command)
 {
-    struct offload_cmd *cmd = (struct offload_cmd *)calloc(1, sizeof(struct offload_cmd));
+    struct offload_cmd *cmd;
+    unsigned int i;
 
-    if (!cmd) {
-        ALOGE("failed to allocate mem for command 0x%x", command);
-        return -ENOMEM;
+    ALOGVV("%s %d", __func__, command);
+
+    /* one pending wait already covers the next write ready callback */
+    if (command == OFFLOAD_CMD_WAIT_FOR_BUFFER) {
+        for (i = 0; i < out->offload_cmd_count; i++) {
+            cmd = &out->offload_cmds[(out->offload_cmd_head + i) %
+                                     OFFLOAD_CMD_QUEUE_SIZE];
+            if (cmd->cmd == OFFLOAD_CMD_WAIT_FOR_BUFFER)
+                return 0;
+        }
     }
 
-    ALOGVV("%s %d", __func__, command);
+    if (command == OFFLOAD_CMD_EXIT) {
+        /* nothing queued matters once the thread is told to exit */
+        if (out->offload_cmd_count == OFFLOAD_CMD_QUEUE_SIZE)
+            out->offload_cmd_count = 0;
+    } else if (command != OFFLOAD_CMD_WAIT_FOR_BUFFER) {
+        while (out->offload_cmd_count >= OFFLOAD_CMD_QUEUE_SIZE - 1) {
+            ALOGW("%s: queue full, waiting to queue command 0x%x",
+                  __func__, command);
+            pthread_cond_wait(&out->cond, &out->lock);
+        }
+    }
 
+    cmd = &out->offload_cmds[(out->offload_cmd_head + out->offload_cmd_count) %
+                             OFFLOAD_CMD_QUEUE_SIZE];
     cmd->cmd = command;
-    list_add_tail(&out->offload_cmd_list, &cmd->node);
+    cmd->queued_us = latency_now_us();
+    out->offload_cmd_count++;
     pthread_cond_signal(&out->offload_cond);
     return 0;
 }
 
+static void out_reset_position_model_l(struct stream_out *out);
+
+/*
+ * Byte rate and wakeup rate of the running session, taken against what the
+ * DSP has rendered so that time spent paused does not count.
+ *
+ * must be called with out->lock locked
+ */
+static int out_get_offload_session_rates_l(struct stream_out *out,
+                                           uint32_t *byte_rate,
+                                           uint32_t *wakeups_per_min)
+{
+    unsigned long frames;
+    unsigned int sample_rate;
+    unsigned int avail;
+    struct timespec ts;
+    uint64_t rendered_ms, consumed;
+    uint32_t queued_max = out->compr_config.fragment_size *
+                          out->compr_config.fragments;
+
+    if (out->compr == NULL ||
+        compress_get_tstamp(out->compr, &frames, &sample_rate) < 0 ||
+        sample_rate == 0)
+        return -ENODEV;
+
+    rendered_ms = (uint64_t)frames * 1000 / sample_rate;
+    if (rendered_ms < OFFLOAD_RATE_MIN_RENDERED_MS)
+        return -EAGAIN;
+
+    /* data still queued in the DSP has been written but not played */
+    consumed = out->offload_bytes_written;
+    if (compress_get_hpointer(out->compr, &avail, &ts) == 0 &&
+        avail <= queued_max && consumed > queued_max - avail)
+        consumed -= queued_max - avail;
+
+    *byte_rate = (uint32_t)(consumed * 1000 / rendered_ms);
+    *wakeups_per_min = (uint32_t)((uint64_t)out->offload_wakeups * 60000 /
+                                  rendered_ms);
+    return 0;
+}
+
+/*
+ * Keeps what the session measured for the next out_adapt_offload_fragments_l()
+ * and starts counting afresh, the DSP timestamp restarts on compress_stop.
+ *
+ * must be called with out->lock locked
+ */
+static void out_end_offload_session_l(struct stream_out *out)
+{
+    uint32_t byte_rate, wakeups_per_min;
+
+    if (out_get_offload_session_rates_l(out, &byte_rate, &wakeups_per_min) == 0) {
+        out->offload_byte_rate = byte_rate;
+        out->offload_wakeups_per_min = wakeups_per_min;
+        ALOGV("%s: %u bytes/s, %u wakeups/min", __func__,
+              byte_rate, wakeups_per_min);
+    }
+    out->offload_bytes_written = 0;
+    out->offload_wakeups = 0;
+}
+
+/*
+ * The AP is woken once for every fragment the DSP frees, so fragments are
+ * sized to last OFFLOAD_FRAGMENT_TARGET_MS at the stream's byte rate. That
+ * rate is the larger of the declared bit rate and what the last session
+ * consumed or was woken for, which catches VBR content running above its
+ * average. Fragments are then added until the DSP holds at least
+ * OFFLOAD_BUFFER_MIN_MS, which is what keeps high rate FLAC from underrunning
+ * once its fragment size hits the platform maximum. The total never exceeds
+ * COMPRESS_OFFLOAD_NUM_FRAGMENTS of the platform's largest fragment.
+ *
+ * AudioFlinger reads out_get_buffer_size() once when the output is opened,
+ * so the fragment size is only chosen there (open true). Each standby exit
+ * only adapts the fragment count, compress_open() reads the config then.
+ *
+ * must be called with out->lock locked
+ */
+static void out_adapt_offload_fragments_l(struct stream_out *out, bool open)
+{
+    uint32_t min_size, max_size;
+    uint32_t fragment_size, fragments, max_fragments;
+    uint64_t byte_rate, woken_rate;
+
+    if (!out->adapt_fragments ||
+        !platform_get_compress_offload_fragment_limits(&min_size, &max_size))
+        return;
+
+    byte_rate = out->compr_config.codec->bit_rate / 8;
+    if (out->offload_byte_rate > byte_rate)
+        byte_rate = out->offload_byte_rate;
+    /* each wakeup of the last session refilled one of its fragments */
+    woken_rate = (uint64_t)out->offload_wakeups_per_min *
+                 out->compr_config.fragment_size / 60;
+    if (woken_rate > byte_rate)
+        byte_rate = woken_rate;
+    if (byte_rate == 0)
+        return;
+
+    fragment_size = out->compr_config.fragment_size;
+    if (open) {
+        fragment_size = (uint32_t)((byte_rate * OFFLOAD_FRAGMENT_TARGET_MS / 1000 +
+                                    1023) & ~1023ULL);
+        if (fragment_size < min_size)
+            fragment_size = min_size;
+        else if (fragment_size > max_size)
+            fragment_size = max_size;
+    }
+
+    max_fragments = COMPRESS_OFFLOAD_NUM_FRAGMENTS * max_size / fragment_size;
+    if (max_fragments > OFFLOAD_MAX_FRAGMENTS)
+        max_fragments = OFFLOAD_MAX_FRAGMENTS;
+    fragments = (uint32_t)((byte_rate * OFFLOAD_BUFFER_MIN_MS / 1000 +
+                            fragment_size - 1) / fragment_size);
+    if (fragments > max_fragments)
+        fragments = max_fragments;
+    if (fragments < COMPRESS_OFFLOAD_NUM_FRAGMENTS)
+        fragments = COMPRESS_OFFLOAD_NUM_FRAGMENTS;
+
+    if (fragment_size != out->compr_config.fragment_size ||
+        fragments != out->compr_config.fragments)
+        ALOGD("%s: %llu bytes/s, fragments %u x %u -> %u x %u", __func__,
+              (unsigned long long)byte_rate, out->compr_config.fragments,
+              out->compr_config.fragment_size, fragments, fragment_size);
+    out->compr_config.fragment_size = fragment_size;
+    out->compr_config.fragments = fragments;
+}
+
 /* must be called iwth out->lock locked */
 static void stop_compressed_output_l(struct stream_out *out)
 {
+    out_end_offload_session_l(out);
+    out_reset_position_model_l(out);
     out->offload_state = OFFLOAD_STATE_IDLE;
     out->playback_started = 0;
     out->send_new_metadata = 1;
+    /* metadata held for the next track goes away with the queued data */
+    out->partial_draining = false;
+    out->next_mdata_valid = false;
     if (out->compr != NULL) {
         compress_stop(out->compr);
         while (out->offload_thread_blocked) {
@@ -1219,10 +1727,55 @@ static void free_offload_usecase(struct audio_device *adev,
     ALOGV("%s: free offload usecase %d", __func__, uc_id);
 }
 
+/* must be called with out->lock locked */
+static bool offload_apply_next_metadata_l(struct stream_out *out)
+{
+    if (!out->next_mdata_valid)
+        return false;
+    out->gapless_mdata = out->next_mdata;
+    out->next_mdata_valid = false;
+    compress_set_gapless_metadata(out->compr, &out->gapless_mdata);
+    out->send_new_metadata = 0;
+    return true;
+}
+
+/*
+ * Gapless track switch, runs on the offload thread without out->lock.
+ * Metadata of the next track that is already known goes in right behind
+ * compress_next_track() so that the drain returns with the DSP set up
+ * for it. Returns true when it did.
+ */
+static bool offload_switch_track(struct stream_out *out)
+{
+    bool mdata_sent;
+
+    compress_next_track(out->compr);
+    pthread_mutex_lock(&out->lock);
+    mdata_sent = offload_apply_next_metadata_l(out);
+    pthread_mutex_unlock(&out->lock);
+    ALOGD("copl(%p):calling compress_drain", out);
+    compress_drain(out->compr);
+    ALOGD("copl(%p):out of compress_drain", out);
+    return mdata_sent;
+}
+
+/*
+ * Metadata that came in during the drain still precedes the next track's
+ * first write, otherwise the current one is sent again with it.
+ * must be called with out->lock locked
+ */
+static void offload_end_partial_drain_l(struct stream_out *out, bool mdata_sent)
+{
+    out->partial_draining = false;
+    if (out->offload_state == OFFLOAD_STATE_IDLE)
+        return;
+    if (!offload_apply_next_metadata_l(out) && !mdata_sent)
+        out->send_new_metadata = 1;
+}
+
 static void *offload_thread_loop(void *context)
 {
     struct stream_out *out = (struct stream_out *) context;
-    struct listnode *item;
     int ret = 0;
 
     setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
@@ -1232,41 +1785,43 @@ static void *offload_thread_loop(void *context)
     ALOGV("%s", __func__);
     pthread_mutex_lock(&out->lock);
     for (;;) {
-        struct offload_cmd *cmd = NULL;
+        struct offload_cmd cmd;
         stream_callback_event_t event;
         bool send_callback = false;
+        bool mdata_sent = false;
 
-        ALOGVV("%s offload_cmd_list %d out->offload_state %d",
-              __func__, list_empty(&out->offload_cmd_list),
+        ALOGVV("%s offload_cmd_count %d out->offload_state %d",
+              __func__, out->offload_cmd_count,
               out->offload_state);
-        if (list_empty(&out->offload_cmd_list)) {
+        if (out->offload_cmd_count == 0) {
             ALOGV("%s SLEEPING", __func__);
             pthread_cond_wait(&out->offload_cond, &out->lock);
             ALOGV("%s RUNNING", __func__);
             continue;
         }
 
-        item = list_head(&out->offload_cmd_list);
-        cmd = node_to_item(item, struct offload_cmd, node);
-        list_remove(item);
+        cmd = out->offload_cmds[out->offload_cmd_head];
+        out->offload_cmd_head = (out->offload_cmd_head + 1) % OFFLOAD_CMD_QUEUE_SIZE;
+        out->offload_cmd_count--;
+        latency_hist_add_since(&out->stats.offload_cmd, cmd.queued_us);
+        /* send_offload_cmd_l() may be waiting for this slot */
+        pthread_cond_broadcast(&out->cond);
 
         ALOGVV("%s STATE %d CMD %d out->compr %p",
-               __func__, out->offload_state, cmd->cmd, out->compr);
+               __func__, out->offload_state, cmd.cmd, out->compr);
 
-        if (cmd->cmd == OFFLOAD_CMD_EXIT) {
-            free(cmd);
+        if (cmd.cmd == OFFLOAD_CMD_EXIT)
             break;
-        }
 
         if (out->compr == NULL) {
             ALOGE("%s: Compress handle is NULL", __func__);
-            pthread_cond_signal(&out->cond);
+            pthread_cond_broadcast(&out->cond);
             continue;
         }
         out->offload_thread_blocked = true;
         pthread_mutex_unlock(&out->lock);
         send_callback = false;
-        switch(cmd->cmd) {
+        switch(cmd.cmd) {
         case OFFLOAD_CMD_WAIT_FOR_BUFFER:
             ALOGD("copl(%p):calling compress_wait", out);
             compress_wait(out->compr, -1);
@@ -1275,14 +1830,9 @@ static void *offload_thread_loop(void *context)
             event = STREAM_CBK_EVENT_WRITE_READY;
             break;
         case OFFLOAD_CMD_PARTIAL_DRAIN:
-            compress_next_track(out->compr);
-            ALOGD("copl(%p):calling compress_drain", out);
-            compress_drain(out->compr);
-            ALOGD("copl(%p):out of compress_drain", out);
+            mdata_sent = offload_switch_track(out);
             send_callback = true;
             event = STREAM_CBK_EVENT_DRAIN_READY;
-            /* Resend the metadata for next iteration */
-            out->send_new_metadata = 1;
             break;
         case OFFLOAD_CMD_DRAIN:
             ALOGD("copl(%p):calling compress_drain", out);
@@ -1292,25 +1842,27 @@ static void *offload_thread_loop(void *context)
             event = STREAM_CBK_EVENT_DRAIN_READY;
             break;
         default:
-            ALOGE("%s unknown command received: %d", __func__, cmd->cmd);
+            ALOGE("%s unknown command received: %d", __func__, cmd.cmd);
             break;
         }
         pthread_mutex_lock(&out->lock);
         out->offload_thread_blocked = false;
-        pthread_cond_signal(&out->cond);
+        if (cmd.cmd == OFFLOAD_CMD_WAIT_FOR_BUFFER)
+            out->offload_wakeups++;
+        else if (cmd.cmd == OFFLOAD_CMD_PARTIAL_DRAIN) {
+            /* the DSP counts the next track from zero */
+            out_reset_position_model_l(out);
+            offload_end_partial_drain_l(out, mdata_sent);
+        }
+        pthread_cond_broadcast(&out->cond);
         if (send_callback) {
             ALOGVV("%s: sending offload_callback event %d", __func__, event);
             out->offload_callback(event, NULL, out->offload_cookie);
         }
-        free(cmd);
     }
 
-    pthread_cond_signal(&out->cond);
-    while (!list_empty(&out->offload_cmd_list)) {
-        item = list_head(&out->offload_cmd_list);
-        list_remove(item);
-        free(node_to_item(item, struct offload_cmd, node));
-    }
+    out->offload_cmd_count = 0;
+    pthread_cond_broadcast(&out->cond);
     pthread_mutex_unlock(&out->lock);
 
     return NULL;
@@ -1319,7 +1871,8 @@ static void *offload_thread_loop(void *context)
 static int create_offload_callback_thread(struct stream_out *out)
 {
     pthread_cond_init(&out->offload_cond, (const pthread_condattr_t *) NULL);
-    list_init(&out->offload_cmd_list);
+    out->offload_cmd_head = 0;
+    out->offload_cmd_count = 0;
     pthread_create(&out->offload_thread, (const pthread_attr_t *) NULL,
                     offload_thread_loop, out);
     return 0;
@@ -1338,6 +1891,310 @@ static int destroy_offload_callback_thread(struct stream_out *out)
     return 0;
 }
 
+/*
+ * NOIRQ streams get no period interrupts, so the writer sleeps on a timer
+ * sized from the hardware pointer instead. With enough periods the queue is
+ * also kept one period short of the kernel buffer.
+ */
+static unsigned int out_mmap_target_frames(struct stream_out *out)
+{
+    unsigned int frames = out->config.period_size * out->config.period_count;
+
+    if (out->config.period_count > 2)
+        frames -= out->config.period_size;
+    return frames;
+}
+
+static void out_mmap_sleep(struct stream_out *out, unsigned int frames)
+{
+    struct timespec ts;
+    uint64_t us = (uint64_t)frames * 1000000 / out->config.rate;
+
+    if (us < MMAP_PLAYBACK_MIN_SLEEP_US)
+        us = MMAP_PLAYBACK_MIN_SLEEP_US;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+/*
+ * Copies straight into the DMA buffer. Same return convention as
+ * pcm_write(): 0 on success, -1 with errno set on failure.
+ * The caller must own out->pcm (out->lock held or the ring writer busy).
+ */
+static int out_pcm_mmap_write(struct stream_out *out, const void *buffer,
+                              size_t bytes)
+{
+    struct pcm *pcm = out->pcm;
+    unsigned int buffer_size = out->config.period_size * out->config.period_count;
+    unsigned int target = out_mmap_target_frames(out);
+    unsigned int frames = pcm_bytes_to_frames(pcm, bytes);
+    const uint8_t *src = (const uint8_t *)buffer;
+    unsigned int stalled_us = 0;
+    int last_avail = -1;
+
+    while (frames > 0) {
+        unsigned int queued, offset, count;
+        void *areas;
+        int avail;
+
+        avail = pcm_avail_update(pcm);
+        if (avail < 0)
+            return -1;
+        queued = ((unsigned int)avail < buffer_size) ? buffer_size - avail : 0;
+
+        if (queued >= target) {
+            unsigned int wait = queued - target +
+                    (frames < out->config.period_size ? frames : out->config.period_size);
+
+            if (!out->mmap_started) {
+                if (pcm_start(pcm) < 0)
+                    ALOGW("%s: pcm_start failed: %s", __func__, pcm_get_error(pcm));
+                out->mmap_started = true;
+            }
+            if (avail == last_avail) {
+                stalled_us += wait * 1000000 / out->config.rate;
+                if (stalled_us > MMAP_PLAYBACK_MAX_STALL_US) {
+                    ALOGE("%s: hw pointer stalled for %u us", __func__, stalled_us);
+                    errno = EIO;
+                    return -1;
+                }
+            } else {
+                stalled_us = 0;
+            }
+            last_avail = avail;
+            out_mmap_sleep(out, wait);
+            continue;
+        }
+
+        count = target - queued;
+        if (count > frames)
+            count = frames;
+        if (pcm_mmap_begin(pcm, &areas, &offset, &count) < 0)
+            return -1;
+        memcpy((uint8_t *)areas + pcm_frames_to_bytes(pcm, offset), src,
+               pcm_frames_to_bytes(pcm, count));
+        if (pcm_mmap_commit(pcm, offset, count) < 0)
+            return -1;
+
+        src += pcm_frames_to_bytes(pcm, count);
+        frames -= count;
+        stalled_us = 0;
+        last_avail = -1;
+
+        if (!out->mmap_started && queued + count >= out->config.start_threshold) {
+            if (pcm_start(pcm) < 0)
+                ALOGW("%s: pcm_start failed: %s", __func__, pcm_get_error(pcm));
+            out->mmap_started = true;
+        }
+    }
+
+    return 0;
+}
+
+static int out_pcm_write(struct stream_out *out, const void *buffer,
+                         size_t bytes)
+{
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_AFE_PROXY)
+        return pcm_mmap_write(out->pcm, (void *)buffer, bytes);
+    else if (out->use_mmap)
+        return out_pcm_mmap_write(out, buffer, bytes);
+
+    return pcm_write(out->pcm, (void *)buffer, bytes);
+}
+
+static void *ring_writer_thread_loop(void *context)
+{
+    struct stream_out *out = (struct stream_out *) context;
+    size_t frame_size = audio_stream_out_frame_size(&out->stream);
+    size_t chunk_size = out->config.period_size * frame_size;
+    unsigned int kernel_buffer_size = out->config.period_size *
+                                          out->config.period_count;
+    bool started = false;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    set_sched_policy(0, SP_FOREGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"Deep Buffer Writer", 0, 0, 0);
+
+    ALOGV("%s", __func__);
+    pthread_mutex_lock(&out->ring_lock);
+    for (;;) {
+        struct timespec ts;
+        unsigned int avail;
+        bool underrun = false;
+        void *data;
+        size_t bytes;
+        int ret;
+
+        if (out->ring_state == RING_STATE_EXIT)
+            break;
+
+        bytes = ring_buffer_read_ptr(&out->ring, &data);
+        if (out->ring_state != RING_STATE_RUNNING || out->ring_error != 0 ||
+                bytes == 0) {
+            if (out->ring_state != RING_STATE_RUNNING)
+                started = false;
+            pthread_cond_wait(&out->ring_cond, &out->ring_lock);
+            continue;
+        }
+        out->ring_thread_busy = true;
+        pthread_mutex_unlock(&out->ring_lock);
+
+        if (bytes > chunk_size)
+            bytes = chunk_size;
+
+        /*
+         * stop_threshold is INT_MAX so the pcm keeps running on an underrun,
+         * which shows up as more room than the whole kernel buffer.
+         */
+        if (started && pcm_get_htimestamp(out->pcm, &avail, &ts) == 0 &&
+                avail >= kernel_buffer_size)
+            underrun = true;
+
+        ALOGVV("%s: writing buffer (%zu bytes) to pcm device", __func__, bytes);
+        ret = out_pcm_write(out, data, bytes);
+        if (ret < 0) {
+            ret = -errno;
+        } else {
+            ring_buffer_consume(&out->ring, bytes);
+            started = true;
+        }
+
+        pthread_mutex_lock(&out->ring_lock);
+        out->ring_thread_busy = false;
+        if (underrun)
+            out->ring_underruns++;
+        if (ret < 0) {
+            ALOGE("%s: error %d - %s", __func__, ret, pcm_get_error(out->pcm));
+            out->ring_error = ret;
+        }
+        pthread_cond_broadcast(&out->ring_space_cond);
+    }
+    pthread_mutex_unlock(&out->ring_lock);
+
+    return NULL;
+}
+
+static int create_ring_writer_thread(struct stream_out *out)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    size_t frame_size = audio_stream_out_frame_size(&out->stream);
+    int ret;
+
+    property_get("audio.deep_buffer.ring.enabled", value, NULL);
+    if (!(atoi(value) || !strncmp("true", value, 4)))
+        return 0;
+
+    ret = ring_buffer_init(&out->ring, out->config.period_size *
+                           DEEP_BUFFER_RING_PERIOD_COUNT * frame_size);
+    if (ret != 0)
+        return ret;
+    if (out->ring.size % frame_size) {
+        ALOGW("%s: ring size %u is not a multiple of frame size %zu",
+              __func__, out->ring.size, frame_size);
+        ring_buffer_deinit(&out->ring);
+        return -EINVAL;
+    }
+
+    pthread_mutex_init(&out->ring_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&out->ring_cond, (const pthread_condattr_t *) NULL);
+    pthread_cond_init(&out->ring_space_cond, (const pthread_condattr_t *) NULL);
+    out->ring_state = RING_STATE_IDLE;
+    out->ring_thread_busy = false;
+    out->ring_error = 0;
+    out->ring_underruns = 0;
+
+    ret = pthread_create(&out->ring_thread, (const pthread_attr_t *) NULL,
+                         ring_writer_thread_loop, out);
+    if (ret != 0) {
+        ALOGE("%s: failed to create writer thread (%d)", __func__, ret);
+        pthread_cond_destroy(&out->ring_space_cond);
+        pthread_cond_destroy(&out->ring_cond);
+        pthread_mutex_destroy(&out->ring_lock);
+        ring_buffer_deinit(&out->ring);
+        return -ret;
+    }
+    out->use_ring = true;
+    ALOGD("%s: %u bytes ring for usecase %s", __func__, out->ring.size,
+          use_case_table[out->usecase]);
+    return 0;
+}
+
+static int destroy_ring_writer_thread(struct stream_out *out)
+{
+    if (!out->use_ring)
+        return 0;
+
+    pthread_mutex_lock(&out->ring_lock);
+    out->ring_state = RING_STATE_EXIT;
+    pthread_cond_signal(&out->ring_cond);
+    pthread_mutex_unlock(&out->ring_lock);
+    pthread_join(out->ring_thread, (void **) NULL);
+
+    pthread_cond_destroy(&out->ring_space_cond);
+    pthread_cond_destroy(&out->ring_cond);
+    pthread_mutex_destroy(&out->ring_lock);
+    ring_buffer_deinit(&out->ring);
+    out->use_ring = false;
+
+    return 0;
+}
+
+/* must be called with out->lock locked */
+static void ring_writer_start_l(struct stream_out *out)
+{
+    pthread_mutex_lock(&out->ring_lock);
+    out->ring_state = RING_STATE_RUNNING;
+    out->ring_error = 0;
+    pthread_mutex_unlock(&out->ring_lock);
+}
+
+/* must be called with out->lock locked, before out->pcm is closed */
+static void ring_writer_stop_l(struct stream_out *out)
+{
+    pthread_mutex_lock(&out->ring_lock);
+    out->ring_state = RING_STATE_IDLE;
+    while (out->ring_thread_busy)
+        pthread_cond_wait(&out->ring_space_cond, &out->ring_lock);
+    /* unplayed data is dropped like it would be by pcm_close() */
+    ring_buffer_reset(&out->ring);
+    out->ring_error = 0;
+    pthread_cond_broadcast(&out->ring_space_cond);
+    pthread_mutex_unlock(&out->ring_lock);
+}
+
+/*
+ * Called without out->lock so that a full ring does not stall the other
+ * stream operations. Only one thread writes to a stream at a time.
+ */
+static void ring_writer_wait_for_space(struct stream_out *out, size_t bytes)
+{
+    if (bytes > out->ring.size)
+        bytes = out->ring.size;
+
+    pthread_mutex_lock(&out->ring_lock);
+    while (out->ring_state == RING_STATE_RUNNING && out->ring_error == 0 &&
+           ring_buffer_avail_write(&out->ring) < bytes)
+        pthread_cond_wait(&out->ring_space_cond, &out->ring_lock);
+    pthread_mutex_unlock(&out->ring_lock);
+}
+
+/* must be called with out->lock locked */
+static int ring_writer_queue_l(struct stream_out *out, const void *buffer,
+                               size_t *bytes)
+{
+    int ret;
+
+    *bytes = ring_buffer_write(&out->ring, buffer, *bytes);
+
+    pthread_mutex_lock(&out->ring_lock);
+    ret = out->ring_error;
+    pthread_cond_signal(&out->ring_cond);
+    pthread_mutex_unlock(&out->ring_lock);
+
+    return ret;
+}
+
 static bool allow_hdmi_channel_config(struct audio_device *adev)
 {
     struct listnode *node;
@@ -1431,6 +2288,153 @@ static int check_and_set_hdmi_channels(struct audio_device *adev,
     return 0;
 }
 
+static bool out_warm_standby_allowed(struct stream_out *out)
+{
+    return out->dev->warm_standby_ms > 0 &&
+           !is_offload_usecase(out->usecase) &&
+           out->usecase != USECASE_COMPRESS_VOIP_CALL;
+}
+
+/*
+ * Keeps the pcm of a stream going to standby open, but stopped, for
+ * audio.playback.warm_standby.ms so that a short clip played right after
+ * does not pay for pcm_open() again. Routing is torn down as usual.
+ * must be called with out->lock locked
+ */
+static void out_park_pcm_l(struct stream_out *out)
+{
+    struct audio_device *adev = out->dev;
+
+    pcm_stop(out->pcm);
+    pthread_mutex_lock(&adev->warm_lock);
+    out->warm_pcm = out->pcm;
+    out->warm_deadline_us = latency_now_us() + adev->warm_standby_ms * 1000LL;
+    list_add_tail(&adev->warm_list, &out->warm_node);
+    pthread_cond_signal(&adev->warm_cond);
+    pthread_mutex_unlock(&adev->warm_lock);
+    out->pcm = NULL;
+}
+
+/* must be called with out->lock locked */
+static struct pcm *out_unpark_pcm_l(struct stream_out *out)
+{
+    struct audio_device *adev = out->dev;
+    struct pcm *pcm;
+
+    if (!out_warm_standby_allowed(out))
+        return NULL;
+
+    pthread_mutex_lock(&adev->warm_lock);
+    pcm = out->warm_pcm;
+    if (pcm != NULL) {
+        list_remove(&out->warm_node);
+        out->warm_pcm = NULL;
+    }
+    pthread_mutex_unlock(&adev->warm_lock);
+    return pcm;
+}
+
+static void *warm_standby_thread_loop(void *context)
+{
+    struct audio_device *adev = (struct audio_device *) context;
+    struct listnode *node, *tempnode;
+    struct stream_out *out;
+    struct timespec ts;
+    int64_t now_us, next_us, wait_us;
+
+    prctl(PR_SET_NAME, (unsigned long)"Audio Warm Standby", 0, 0, 0);
+
+    pthread_mutex_lock(&adev->warm_lock);
+    while (!adev->warm_exit) {
+        now_us = latency_now_us();
+        next_us = INT64_MAX;
+        list_for_each_safe(node, tempnode, &adev->warm_list) {
+            out = node_to_item(node, struct stream_out, warm_node);
+            if (out->warm_deadline_us <= now_us) {
+                /* the stream mutex ranks above warm_lock, never block on it */
+                if (pthread_mutex_trylock(&out->lock) == 0) {
+                    ALOGV("%s: closing parked pcm of %p", __func__, out);
+                    list_remove(&out->warm_node);
+                    pcm_close(out->warm_pcm);
+                    out->warm_pcm = NULL;
+                    pthread_mutex_unlock(&out->lock);
+                    continue;
+                }
+                out->warm_deadline_us = now_us + WARM_STANDBY_RETRY_US;
+            }
+            if (out->warm_deadline_us < next_us)
+                next_us = out->warm_deadline_us;
+        }
+
+        if (next_us == INT64_MAX) {
+            pthread_cond_wait(&adev->warm_cond, &adev->warm_lock);
+            continue;
+        }
+        wait_us = next_us - now_us;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += wait_us / 1000000;
+        ts.tv_nsec += (wait_us % 1000000) * 1000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&adev->warm_cond, &adev->warm_lock, &ts);
+    }
+    pthread_mutex_unlock(&adev->warm_lock);
+    return NULL;
+}
+
+/* closes every parked pcm as soon as possible, e.g. after SSR */
+static void warm_standby_expire_all(struct audio_device *adev)
+{
+    struct listnode *node;
+    struct stream_out *out;
+
+    if (adev->warm_standby_ms == 0)
+        return;
+
+    pthread_mutex_lock(&adev->warm_lock);
+    list_for_each(node, &adev->warm_list) {
+        out = node_to_item(node, struct stream_out, warm_node);
+        out->warm_deadline_us = 0;
+    }
+    pthread_cond_signal(&adev->warm_cond);
+    pthread_mutex_unlock(&adev->warm_lock);
+}
+
+static void warm_standby_init(struct audio_device *adev)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_init(&adev->warm_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&adev->warm_cond, (const pthread_condattr_t *) NULL);
+    list_init(&adev->warm_list);
+    adev->warm_exit = false;
+
+    property_get("audio.playback.warm_standby.ms", value, "0");
+    adev->warm_standby_ms = atoi(value);
+    if (adev->warm_standby_ms == 0)
+        return;
+
+    if (pthread_create(&adev->warm_thread, (const pthread_attr_t *) NULL,
+                       warm_standby_thread_loop, adev)) {
+        ALOGE("%s: failed to create warm standby thread", __func__);
+        adev->warm_standby_ms = 0;
+    }
+}
+
+static void warm_standby_deinit(struct audio_device *adev)
+{
+    if (adev->warm_standby_ms == 0)
+        return;
+
+    pthread_mutex_lock(&adev->warm_lock);
+    adev->warm_exit = true;
+    pthread_cond_signal(&adev->warm_cond);
+    pthread_mutex_unlock(&adev->warm_lock);
+    pthread_join(adev->warm_thread, (void **) NULL);
+}
+
 static int stop_output_stream(struct stream_out *out)
 {
     int i, ret = 0;
@@ -1468,8 +2472,8 @@ static int stop_output_stream(struct stream_out *out)
     /* 2. Disable the rx device */
     disable_snd_device(adev, uc_info->out_snd_device);
 
-    list_remove(&uc_info->list);
-    free(uc_info);
+    remove_usecase_from_list(adev, uc_info);
+    release_usecase(adev, uc_info);
 
     if (is_offload_usecase(out->usecase) &&
         (out->devices & AUDIO_DEVICE_OUT_AUX_DIGITAL) &&
@@ -1487,6 +2491,10 @@ static int stop_output_stream(struct stream_out *out)
     return ret;
 }
 
+/*
+ * must be called with out->lock and adev->lock locked, adev->lock is
+ * released while the pcm or compress session is being opened
+ */
 int start_output_stream(struct stream_out *out)
 {
     int ret = 0;
@@ -1519,7 +2527,7 @@ int start_output_stream(struct stream_out *out)
         goto error_open;
     }
 
-    uc_info = (struct audio_usecase *)calloc(1, sizeof(struct audio_usecase));
+    uc_info = alloc_usecase(adev);
 
     if (!uc_info) {
         ret = -ENOMEM;
@@ -1557,7 +2565,7 @@ int start_output_stream(struct stream_out *out)
         }
         audio_extn_dolby_set_hdmi_config(adev, out);
     }
-    list_add_tail(&adev->usecase_list, &uc_info->list);
+    add_usecase_to_list(adev, uc_info);
 
     select_devices(adev, out->usecase);
 
@@ -1569,10 +2577,22 @@ int start_output_stream(struct stream_out *out)
         if (out->usecase == USECASE_AUDIO_PLAYBACK_AFE_PROXY) {
             flags |= PCM_MMAP | PCM_NOIRQ;
             pcm_open_retry_count = PROXY_OPEN_RETRY_COUNT;
+        } else if (out->use_mmap) {
+            flags |= PCM_MMAP | PCM_NOIRQ | PCM_MONOTONIC;
+            out->mmap_started = false;
         } else
             flags |= PCM_MONOTONIC;
 
-        while (1) {
+        /* routing is in place, the session open does not need adev->lock */
+        pthread_mutex_unlock(&adev->lock);
+        out->pcm = out_unpark_pcm_l(out);
+        if (out->pcm != NULL && pcm_prepare(out->pcm) < 0) {
+            ALOGW("%s: parked pcm cannot be prepared: %s", __func__,
+                  pcm_get_error(out->pcm));
+            pcm_close(out->pcm);
+            out->pcm = NULL;
+        }
+        while (out->pcm == NULL) {
             out->pcm = pcm_open(adev->snd_card, out->pcm_device_id,
                                flags, &out->config);
             if (out->pcm == NULL || !pcm_is_ready(out->pcm)) {
@@ -1583,22 +2603,31 @@ int start_output_stream(struct stream_out *out)
                 }
                 if (pcm_open_retry_count-- == 0) {
                     ret = -EIO;
-                    goto error_open;
+                    break;
                 }
                 usleep(PROXY_OPEN_WAIT_TIME * 1000);
                 continue;
             }
             break;
         }
+        /* nothing reaches the DSP before the first write or pcm_start */
+        audio_extn_utils_wait_for_calibration();
+        pthread_mutex_lock(&adev->lock);
+        if (ret != 0)
+            goto error_open;
         platform_set_stream_channel_map(adev->platform, out->channel_mask,
                                     out->pcm_device_id);
     } else {
         platform_set_stream_channel_map(adev->platform, out->channel_mask,
                                     out->pcm_device_id);
         out->pcm = NULL;
+        out_adapt_offload_fragments_l(out, false);
+        pthread_mutex_unlock(&adev->lock);
+        audio_extn_utils_wait_for_calibration();
         out->compr = compress_open(adev->snd_card,
                                    out->pcm_device_id,
                                    COMPRESS_IN, &out->compr_config);
+        pthread_mutex_lock(&adev->lock);
         if (out->compr && !is_compress_ready(out->compr)) {
             ALOGE("%s: %s", __func__, compress_get_error(out->compr));
             compress_close(out->compr);
@@ -1768,11 +2797,17 @@ static int out_standby(struct audio_stream *stream)
 
     pthread_mutex_lock(&out->lock);
     if (!out->standby) {
-        pthread_mutex_lock(&adev->lock);
+        if (out->use_ring)
+            ring_writer_stop_l(out);
         out->standby = true;
+        out_reset_position_model_l(out);
+        /* sessions are closed before adev->lock, they are owned by out->lock */
         if (!is_offload_usecase(out->usecase)) {
             if (out->pcm) {
-                pcm_close(out->pcm);
+                if (out_warm_standby_allowed(out))
+                    out_park_pcm_l(out);
+                else
+                    pcm_close(out->pcm);
                 out->pcm = NULL;
             }
         } else {
@@ -1785,6 +2820,7 @@ static int out_standby(struct audio_stream *stream)
                 out->compr = NULL;
             }
         }
+        pthread_mutex_lock(&adev->lock);
         stop_output_stream(out);
         pthread_mutex_unlock(&adev->lock);
     }
@@ -1793,9 +2829,13 @@ static int out_standby(struct audio_stream *stream)
     return 0;
 }
 
-static int out_dump(const struct audio_stream *stream __unused,
-                    int fd __unused)
+static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_out *out = (struct stream_out *)stream;
+
+    dprintf(fd, "  output %p usecase %s flags %#x\n", out,
+            use_case_table[out->usecase], out->flags);
+    dump_stream_latency_stats(&out->stats, "write", fd);
     return 0;
 }
 
@@ -1917,10 +2957,16 @@ static int parse_compress_metadata(struct stream_out *out, struct str_parms *par
         ALOGV("%s: Not gapless meta data params", __func__);
         return 0;
     }
-    out->gapless_mdata = tmp_mdata;
-    out->send_new_metadata = 1;
+    if (out->partial_draining) {
+        /* belongs to the next track, applied on the switch */
+        out->next_mdata = tmp_mdata;
+        out->next_mdata_valid = true;
+    } else {
+        out->gapless_mdata = tmp_mdata;
+        out->send_new_metadata = 1;
+    }
     ALOGV("%s new encoder delay %u and padding %u", __func__,
-          out->gapless_mdata.encoder_delay, out->gapless_mdata.encoder_padding);
+          tmp_mdata.encoder_delay, tmp_mdata.encoder_padding);
 
     return 0;
 }
@@ -2096,6 +3142,59 @@ static char* out_get_parameters(const struct audio_stream *stream, const char *k
         str_parms_add_str(reply, AUDIO_PARAMETER_STREAM_SUP_FORMATS, value);
         str = str_parms_to_str(reply);
     }
+
+    if (out->use_ring &&
+        (str_parms_has_key(query, AUDIO_PARAMETER_KEY_RING_UNDERRUNS) ||
+         str_parms_has_key(query, AUDIO_PARAMETER_KEY_RING_FILL_FRAMES))) {
+        size_t frame_size = audio_stream_out_frame_size(
+                                (const struct audio_stream_out *)stream);
+        uint32_t underruns;
+
+        pthread_mutex_lock(&out->ring_lock);
+        underruns = out->ring_underruns;
+        pthread_mutex_unlock(&out->ring_lock);
+
+        if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_RING_UNDERRUNS))
+            str_parms_add_int(reply, AUDIO_PARAMETER_KEY_RING_UNDERRUNS, underruns);
+        if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_RING_FILL_FRAMES)) {
+            str_parms_add_int(reply, AUDIO_PARAMETER_KEY_RING_FILL_FRAMES,
+                              ring_buffer_avail_read(&out->ring) / frame_size);
+            str_parms_add_int(reply, AUDIO_PARAMETER_KEY_RING_SIZE_FRAMES,
+                              out->ring.size / frame_size);
+        }
+        free(str);
+        str = str_parms_to_str(reply);
+    }
+
+    if (is_offload_usecase(out->usecase) &&
+        (str_parms_has_key(query, AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENT_SIZE) ||
+         str_parms_has_key(query, AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENTS) ||
+         str_parms_has_key(query, AUDIO_PARAMETER_KEY_OFFLOAD_WAKEUPS_PER_MIN))) {
+        uint32_t byte_rate, wakeups_per_min;
+
+        pthread_mutex_lock(&out->lock);
+        /* the running session if it has played long enough, else the last one */
+        if (out_get_offload_session_rates_l(out, &byte_rate, &wakeups_per_min) != 0)
+            wakeups_per_min = out->offload_wakeups_per_min;
+        str_parms_add_int(reply, AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENT_SIZE,
+                          out->compr_config.fragment_size);
+        str_parms_add_int(reply, AUDIO_PARAMETER_KEY_OFFLOAD_FRAGMENTS,
+                          out->compr_config.fragments);
+        str_parms_add_int(reply, AUDIO_PARAMETER_KEY_OFFLOAD_WAKEUPS_PER_MIN,
+                          wakeups_per_min);
+        pthread_mutex_unlock(&out->lock);
+        free(str);
+        str = str_parms_to_str(reply);
+    }
+
+    if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_LATENCY_STATS)) {
+        char stats[512];
+
+        format_stream_latency_stats(&out->stats, "write", stats, sizeof(stats));
+        str_parms_add_str(reply, AUDIO_PARAMETER_KEY_LATENCY_STATS, stats);
+        free(str);
+        str = str_parms_to_str(reply);
+    }
     str_parms_destroy(query);
     str_parms_destroy(reply);
     ALOGV("%s: exit: returns - %s", __func__, str);
@@ -2106,11 +3205,20 @@ static uint32_t out_get_latency(const struct audio_stream_out *stream)
 {
     struct stream_out *out = (struct stream_out *)stream;
 
+    uint32_t frames;
+
     if (is_offload_usecase(out->usecase))
         return COMPRESS_OFFLOAD_PLAYBACK_LATENCY;
 
-    return (out->config.period_count * out->config.period_size * 1000) /
-           (out->config.rate);
+    if (out->use_mmap)
+        frames = out_mmap_target_frames(out);
+    else
+        frames = out->config.period_count * out->config.period_size;
+    if (out->use_ring)
+        frames += out->ring.size /
+                      audio_stream_out_frame_size((const struct audio_stream_out *)stream);
+
+    return (frames * 1000) / (out->config.rate);
 }
 
 static int out_set_volume(struct audio_stream_out *stream, float left,
@@ -2137,10 +3245,10 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
             int pcm_device_id = platform_get_pcm_device_id(out->usecase,
                                                        PCM_PLAYBACK);
             if (out->usecase == USECASE_AUDIO_PLAYBACK_RES_OFFLOAD) {
-                ctl = mixer_get_ctl_by_name(adev->mixer,
+                ctl = platform_get_mixer_ctl(adev->platform,
                                             MIXER_CTL_RES_COMPRESS_PLAYBACK_VOLUME);
             } else {
-                ctl = mixer_get_ctl_by_name(adev->mixer,
+                ctl = platform_get_mixer_ctl(adev->platform,
                                             MIXER_CTL_COMPRESS_PLAYBACK_VOLUME);
             }
             if (!ctl) {
@@ -2150,7 +3258,9 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
             }
             volume[0] = (int)(left * COMPRESS_PLAYBACK_VOLUME_MAX);
             volume[1] = (int)(right * COMPRESS_PLAYBACK_VOLUME_MAX);
+            pthread_mutex_lock(&adev->mixer_lock);
             mixer_ctl_set_array(ctl, volume, sizeof(volume)/sizeof(volume[0]));
+            pthread_mutex_unlock(&adev->mixer_lock);
             return 0;
         }
     }
@@ -2158,6 +3268,12 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
     return -ENOSYS;
 }
 
+static int64_t out_buffer_duration_us(struct stream_out *out, size_t bytes)
+{
+    return (int64_t)bytes * 1000000 / audio_stream_out_frame_size(&out->stream) /
+           out_get_sample_rate(&out->stream.common);
+}
+
 static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
                          size_t bytes)
 {
@@ -2165,8 +3281,13 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
     struct audio_device *adev = out->dev;
     int snd_scard_state = get_snd_card_state(adev);
     ssize_t ret = 0;
+    bool parked = false;
+    int64_t write_start_us = latency_now_us();
 
-    pthread_mutex_lock(&out->lock);
+    if (out->use_ring)
+        ring_writer_wait_for_space(out, bytes);
+
+    timed_mutex_lock(&out->lock, &out->stats.lock_wait);
 
     if (SND_CARD_STATE_OFFLINE == snd_scard_state) {
         if (out->pcm) {
@@ -2182,18 +3303,28 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
     }
 
     if (out->standby) {
+        int64_t start_us = latency_now_us();
+
+        if (!stream_error_may_retry(adev, &out->error)) {
+            parked = true;
+            ret = -EIO;
+            goto exit;
+        }
         out->standby = false;
-        pthread_mutex_lock(&adev->lock);
+        timed_mutex_lock(&adev->lock, &out->stats.adev_lock_wait);
         if (out->usecase == USECASE_COMPRESS_VOIP_CALL)
             ret = voice_extn_compress_voip_start_output_stream(out);
         else
             ret = start_output_stream(out);
         pthread_mutex_unlock(&adev->lock);
+        latency_hist_add_since(&out->stats.start, start_us);
         /* ToDo: If use case is compress offload should return 0 */
         if (ret != 0) {
             out->standby = true;
             goto exit;
         }
+        if (out->use_ring)
+            ring_writer_start_l(out);
     }
 
     if (is_offload_usecase(out->usecase)) {
@@ -2209,6 +3340,7 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
                 int status;
 
                 status = compress_resume(out->compr);
+                clock_model_reset(&out->position_model, out->sample_rate);
 
                 ALOGD("%s: resumed previously paused compress offload playback, status %d",
                       __func__, status);
@@ -2223,6 +3355,10 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
             ret = compress_write(out->compr, buffer, bytes);
             if (ret < 0)
                 ret = -errno;
+            else {
+                out->offload_bytes_written += ret;
+                pcm_tap_write(out->tap, buffer, ret);
+            }
 
         }
         ALOGVV("%s: writing buffer (%d bytes) to compress device returned %d", __func__, bytes, ret);
@@ -2245,21 +3381,31 @@ static ssize_t out_write(struct audio_stream_out *stream, const void *buffer,
                                                      popcount(out->channel_mask),
                                                      out->playback_started);
         }
+        if (ret >= 0)
+            stream_error_clear(adev, &out->error, use_case_table[out->usecase]);
         pthread_mutex_unlock(&out->lock);
+        latency_hist_add_since(&out->stats.io, write_start_us);
         return ret;
     } else {
-        if (out->pcm) {
+        if (out->pcm && out->use_ring) {
+            if (out->muted)
+                memset((void *)buffer, 0, bytes);
+            ret = ring_writer_queue_l(out, buffer, &bytes);
+            if (ret == 0) {
+                out->written += bytes / (out->config.channels * sizeof(short));
+                pcm_tap_write(out->tap, buffer, bytes);
+            }
+        } else if (out->pcm) {
             if (out->muted)
                 memset((void *)buffer, 0, bytes);
             ALOGVV("%s: writing buffer (%d bytes) to pcm device", __func__, bytes);
-            if (out->usecase == USECASE_AUDIO_PLAYBACK_AFE_PROXY)
-                ret = pcm_mmap_write(out->pcm, (void *)buffer, bytes);
-            else
-                ret = pcm_write(out->pcm, (void *)buffer, bytes);
+            ret = out_pcm_write(out, buffer, bytes);
             if (ret < 0)
                 ret = -errno;
-            else if (ret == 0)
+            else if (ret == 0) {
                 out->written += bytes / (out->config.channels * sizeof(short));
+                pcm_tap_write(out->tap, buffer, bytes);
+            }
         }
     }
 
@@ -2271,8 +3417,13 @@ exit:
     }
 
     pthread_mutex_unlock(&out->lock);
+    latency_hist_add_since(&out->stats.io, write_start_us);
 
-    if (ret != 0) {
+    if (parked) {
+        /* still backing off from an earlier failure */
+        stream_error_park(adev, &out->error, out_buffer_duration_us(out, bytes),
+                          false);
+    } else if (ret != 0) {
         if (out->pcm)
             ALOGE("%s: error %ld - %s", __func__, ret, pcm_get_error(out->pcm));
         if (out->usecase == USECASE_COMPRESS_VOIP_CALL) {
@@ -2282,9 +3433,10 @@ exit:
             out->standby = true;
         }
         out_standby(&out->stream.common);
-        usleep(bytes * 1000000 / audio_stream_out_frame_size(stream) /
-                        out_get_sample_rate(&out->stream.common));
-
+        stream_error_park(adev, &out->error, out_buffer_duration_us(out, bytes),
+                          true);
+    } else {
+        stream_error_clear(adev, &out->error, use_case_table[out->usecase]);
     }
     return bytes;
 }
@@ -2338,46 +3490,173 @@ static int out_get_next_write_timestamp(const struct audio_stream_out *stream __
     return -EINVAL;
 }
 
+static int64_t timespec_to_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static int64_t monotonic_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_ns(&ts);
+}
+
+/* must be called with out->lock locked */
+static void out_reset_position_model_l(struct stream_out *out)
+{
+    clock_model_reset(&out->position_model, out->sample_rate);
+    out->last_position = 0;
+}
+
+/* must be called with out->lock locked */
+static void out_update_position_model_l(struct stream_out *out,
+                                        int64_t time_ns, int64_t frames)
+{
+    struct clock_model *cm = &out->position_model;
+    int64_t error;
+
+    if (cm->sample_rate != out->sample_rate) {
+        clock_model_reset(cm, out->sample_rate);
+    } else if (clock_model_valid(cm)) {
+        error = frames - clock_model_predict(cm, time_ns);
+        if (llabs(error) > (int64_t)out->sample_rate * POSITION_MODEL_RESYNC_US
+                               / 1000000) {
+            ALOGV("%s: resync, %lld frames off", __func__, (long long)error);
+            clock_model_reset(cm, out->sample_rate);
+        }
+    }
+    clock_model_add(cm, time_ns, frames);
+}
+
+/*
+ * Reads the rendered frame count from the driver into the clock model.
+ * must be called with out->lock locked
+ */
+static int out_sample_position_l(struct stream_out *out)
+{
+    unsigned long dsp_frames;
+    struct timespec ts;
+    unsigned int avail;
+    int64_t before_ns, after_ns;
+
+    if (is_offload_usecase(out->usecase)) {
+        if (out->compr == NULL)
+            return -ENODEV;
+        /* the compress driver reports no time, bracket the ioctl instead */
+        before_ns = monotonic_now_ns();
+        if (compress_get_tstamp(out->compr, &dsp_frames, &out->sample_rate) < 0)
+            return -errno;
+        after_ns = monotonic_now_ns();
+        ALOGVV("%s rendered frames %ld sample_rate %d",
+               __func__, dsp_frames, out->sample_rate);
+        out_update_position_model_l(out, before_ns + (after_ns - before_ns) / 2,
+                                    dsp_frames);
+        return 0;
+    }
+
+    if (out->pcm == NULL)
+        return -ENODEV;
+    if (pcm_get_htimestamp(out->pcm, &avail, &ts) != 0)
+        return -EIO;
+
+    size_t kernel_buffer_size = out->config.period_size * out->config.period_count;
+    int64_t signed_frames = out->written - kernel_buffer_size + avail;
+    // Frames still queued in the ring have not reached the pcm yet.
+    // Right after a pcm_write() returns the writer thread may not
+    // have consumed them yet, which briefly under-reports.
+    if (out->use_ring)
+        signed_frames -= ring_buffer_avail_read(&out->ring) /
+                             audio_stream_out_frame_size(&out->stream);
+    out_update_position_model_l(out, timespec_to_ns(&ts), signed_frames);
+    return 0;
+}
+
+/*
+ * Frames handed to the driver so far, -1 when the stream is compressed and
+ * the byte count says nothing about frames.
+ * must be called with out->lock locked
+ */
+static int64_t out_written_frames_l(struct stream_out *out)
+{
+    size_t frame_size;
+
+    if (!is_offload_usecase(out->usecase))
+        return out->written;
+    if ((out->format & AUDIO_FORMAT_MAIN_MASK) != AUDIO_FORMAT_PCM_OFFLOAD)
+        return -1;
+    frame_size = (out->format == AUDIO_FORMAT_PCM_24_BIT_OFFLOAD ? 4 : 2) *
+                 popcount(out->channel_mask);
+    return out->offload_bytes_written / frame_size;
+}
+
 static int out_get_presentation_position(const struct audio_stream_out *stream,
                                    uint64_t *frames, struct timespec *timestamp)
 {
     struct stream_out *out = (struct stream_out *)stream;
     int ret = -1;
-    unsigned long dsp_frames;
+    int64_t now_ns, position, written;
+    bool running;
 
     pthread_mutex_lock(&out->lock);
 
     if (is_offload_usecase(out->usecase)) {
-        if (out->compr != NULL) {
-            compress_get_tstamp(out->compr, &dsp_frames,
-                    &out->sample_rate);
-            ALOGVV("%s rendered frames %ld sample_rate %d",
-                   __func__, dsp_frames, out->sample_rate);
-            *frames = dsp_frames;
-            ret = 0;
-            /* this is the best we can do */
-            clock_gettime(CLOCK_MONOTONIC, timestamp);
-        }
+        if (out->compr == NULL)
+            goto exit;
+        running = out->offload_state == OFFLOAD_STATE_PLAYING;
     } else {
-        if (out->pcm) {
-            unsigned int avail;
-            if (pcm_get_htimestamp(out->pcm, &avail, timestamp) == 0) {
-                size_t kernel_buffer_size = out->config.period_size * out->config.period_count;
-                int64_t signed_frames = out->written - kernel_buffer_size + avail;
-                // This adjustment accounts for buffering after app processor.
-                // It is based on estimated DSP latency per use case, rather than exact.
-                signed_frames -=
-                    (platform_render_latency(out->usecase) * out->sample_rate / 1000000LL);
-
-                // It would be unusual for this value to be negative, but check just in case ...
-                if (signed_frames >= 0) {
-                    *frames = signed_frames;
-                    ret = 0;
-                }
-            }
-        }
+        if (out->pcm == NULL)
+            goto exit;
+        running = !out->standby;
+    }
+
+    /*
+     * While running, positions are predicted from the clock model and the
+     * driver is only read once the newest sample is too old.
+     */
+    now_ns = monotonic_now_ns();
+    if (!running) {
+        clock_model_reset(&out->position_model, out->sample_rate);
+        if (out_sample_position_l(out) != 0)
+            goto exit;
+        now_ns = out->position_model.last_ns;
+    } else if (clock_model_age_ns(&out->position_model, now_ns) >
+                   POSITION_MODEL_REFRESH_NS) {
+        if (out_sample_position_l(out) != 0)
+            goto exit;
+        now_ns = monotonic_now_ns();
+    }
+
+    position = clock_model_predict(&out->position_model, now_ns);
+    /* nothing can have been rendered that was not written */
+    written = out_written_frames_l(out);
+    if (written >= 0 && position > written)
+        position = written;
+    if (!is_offload_usecase(out->usecase)) {
+        // This adjustment accounts for buffering after app processor.
+        // It is based on estimated DSP latency per use case, rather than exact.
+        position -= platform_render_latency(out->usecase) * out->sample_rate / 1000000LL;
+        // It would be unusual for this value to be negative, but check just in case ...
+        if (position < 0)
+            goto exit;
     }
 
+    /*
+     * A refit may move the line back slightly and a stall only shows on the
+     * next sample, never report going backwards. The written cap and the
+     * stall detection keep what is held here to one refresh period at most.
+     */
+    if ((uint64_t)position < out->last_position)
+        position = out->last_position;
+    out->last_position = position;
+
+    *frames = position;
+    timestamp->tv_sec = now_ns / 1000000000LL;
+    timestamp->tv_nsec = now_ns % 1000000000LL;
+    ret = 0;
+
+exit:
     pthread_mutex_unlock(&out->lock);
 
     return ret;
@@ -2410,6 +3689,7 @@ static int out_pause(struct audio_stream_out* stream)
 
             if (SND_CARD_STATE_ONLINE == snd_scard_state)
                 status = compress_pause(out->compr);
+            clock_model_reset(&out->position_model, out->sample_rate);
 
             out->offload_state = OFFLOAD_STATE_PAUSED;
 
@@ -2438,6 +3718,7 @@ static int out_resume(struct audio_stream_out* stream)
 
             if (SND_CARD_STATE_ONLINE == snd_scard_state)
                 status = compress_resume(out->compr);
+            clock_model_reset(&out->position_model, out->sample_rate);
 
             out->offload_state = OFFLOAD_STATE_PLAYING;
 
@@ -2457,9 +3738,11 @@ static int out_drain(struct audio_stream_out* stream, audio_drain_type_t type )
     ALOGV("%s", __func__);
     if (is_offload_usecase(out->usecase)) {
         pthread_mutex_lock(&out->lock);
-        if (type == AUDIO_DRAIN_EARLY_NOTIFY)
+        if (type == AUDIO_DRAIN_EARLY_NOTIFY) {
             status = send_offload_cmd_l(out, OFFLOAD_CMD_PARTIAL_DRAIN);
-        else
+            if (status == 0)
+                out->partial_draining = true;
+        } else
             status = send_offload_cmd_l(out, OFFLOAD_CMD_DRAIN);
         pthread_mutex_unlock(&out->lock);
     }
@@ -2528,6 +3811,270 @@ static int in_set_format(struct audio_stream *stream __unused,
     return -ENOSYS;
 }
 
+/*
+ * Places the chunk just pulled from the pcm on the capture timeline. The
+ * hw pointer timestamp anchors the timeline to the clock, and a gap
+ * between two anchors larger than a period means the kernel overran and
+ * tinyalsa restarted the pcm behind our back.
+ * must be called with in->ring_lock locked
+ */
+static void capture_reader_update_timeline_l(struct stream_in *in,
+                                             unsigned int frames,
+                                             unsigned int dropped,
+                                             const struct timespec *ts,
+                                             unsigned int avail)
+{
+    int64_t anchor_frames, anchor_ns, expected, gap = 0;
+
+    in->capture_frames += frames;
+    in->session_frames_lost += dropped;
+    in->frames_lost += dropped;
+    if (ts == NULL)
+        return;
+
+    anchor_frames = in->capture_frames + avail;
+    anchor_ns = timespec_to_ns(ts);
+    if (in->capture_anchor_ns != 0 && anchor_ns > in->capture_anchor_ns) {
+        expected = (anchor_ns - in->capture_anchor_ns) * in->config.rate /
+                   1000000000LL;
+        gap = expected - (anchor_frames - in->capture_anchor_frames);
+        if (gap > (int64_t)in->config.period_size) {
+            ALOGW("%s: overrun, %lld frames lost", __func__, (long long)gap);
+            in->capture_frames += gap;
+            in->session_frames_lost += gap;
+            in->frames_lost += gap;
+            anchor_frames += gap;
+        }
+    }
+    in->capture_anchor_frames = anchor_frames;
+    in->capture_anchor_ns = anchor_ns;
+}
+
+static void *capture_reader_thread_loop(void *context)
+{
+    struct stream_in *in = (struct stream_in *) context;
+    size_t frame_size = audio_stream_in_frame_size(&in->stream);
+    size_t chunk_size = in->config.period_size * frame_size;
+    void *chunk;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    set_sched_policy(0, SP_FOREGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"Capture Reader", 0, 0, 0);
+
+    chunk = malloc(chunk_size);
+
+    ALOGV("%s", __func__);
+    pthread_mutex_lock(&in->ring_lock);
+    for (;;) {
+        struct timespec ts;
+        unsigned int avail = 0;
+        size_t space, copied = 0;
+        bool timestamped = false;
+        int ret;
+
+        if (in->ring_state == RING_STATE_EXIT)
+            break;
+
+        if (in->ring_state != RING_STATE_RUNNING || in->ring_error != 0 ||
+                chunk == NULL) {
+            pthread_cond_wait(&in->ring_cond, &in->ring_lock);
+            continue;
+        }
+        in->ring_thread_busy = true;
+        pthread_mutex_unlock(&in->ring_lock);
+
+        ret = pcm_read(in->pcm, chunk, chunk_size);
+        if (ret < 0) {
+            ret = -errno;
+        } else {
+            timestamped = pcm_get_htimestamp(in->pcm, &avail, &ts) == 0;
+            /* whole frames only, the ring size is a multiple of frame_size */
+            space = ring_buffer_avail_write(&in->ring);
+            space -= space % frame_size;
+            copied = ring_buffer_write(&in->ring, chunk,
+                                       chunk_size < space ? chunk_size : space);
+        }
+
+        pthread_mutex_lock(&in->ring_lock);
+        in->ring_thread_busy = false;
+        if (ret < 0) {
+            ALOGE("%s: error %d - %s", __func__, ret, pcm_get_error(in->pcm));
+            in->ring_error = ret;
+        } else {
+            capture_reader_update_timeline_l(in, chunk_size / frame_size,
+                                             (chunk_size - copied) / frame_size,
+                                             timestamped ? &ts : NULL, avail);
+        }
+        pthread_cond_broadcast(&in->ring_data_cond);
+    }
+    pthread_mutex_unlock(&in->ring_lock);
+    free(chunk);
+
+    return NULL;
+}
+
+/*
+ * Only plain pcm_read() captures go through the ring, the proxy, surround
+ * and compressed paths keep reading the device themselves.
+ */
+static int create_capture_reader_thread(struct stream_in *in)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    size_t frame_size = audio_stream_in_frame_size(&in->stream);
+    int ret;
+
+    property_get("audio.capture.ring.enabled", value, NULL);
+    if (!(atoi(value) || !strncmp("true", value, 4)))
+        return 0;
+    if (in->is_st_session || in->usecase == USECASE_COMPRESS_VOIP_CALL ||
+        in->usecase == USECASE_AUDIO_RECORD_AFE_PROXY ||
+        audio_extn_compr_cap_usecase_supported(in->usecase) ||
+        (audio_extn_ssr_get_enabled() &&
+         audio_channel_count_from_in_mask(in->channel_mask) == 6))
+        return 0;
+
+    ret = ring_buffer_init(&in->ring, in->config.period_size *
+                           CAPTURE_RING_PERIOD_COUNT * frame_size);
+    if (ret != 0)
+        return ret;
+    if (in->ring.size % frame_size) {
+        ALOGW("%s: ring size %u is not a multiple of frame size %zu",
+              __func__, in->ring.size, frame_size);
+        ring_buffer_deinit(&in->ring);
+        return -EINVAL;
+    }
+
+    pthread_mutex_init(&in->ring_lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&in->ring_cond, (const pthread_condattr_t *) NULL);
+    pthread_cond_init(&in->ring_data_cond, (const pthread_condattr_t *) NULL);
+    in->ring_state = RING_STATE_IDLE;
+    in->ring_thread_busy = false;
+    in->ring_error = 0;
+
+    ret = pthread_create(&in->ring_thread, (const pthread_attr_t *) NULL,
+                         capture_reader_thread_loop, in);
+    if (ret != 0) {
+        ALOGE("%s: failed to create reader thread (%d)", __func__, ret);
+        pthread_cond_destroy(&in->ring_data_cond);
+        pthread_cond_destroy(&in->ring_cond);
+        pthread_mutex_destroy(&in->ring_lock);
+        ring_buffer_deinit(&in->ring);
+        return -ret;
+    }
+    in->use_ring = true;
+    ALOGD("%s: %u bytes ring for usecase %s", __func__, in->ring.size,
+          use_case_table[in->usecase]);
+    return 0;
+}
+
+static int destroy_capture_reader_thread(struct stream_in *in)
+{
+    if (!in->use_ring)
+        return 0;
+
+    pthread_mutex_lock(&in->ring_lock);
+    in->ring_state = RING_STATE_EXIT;
+    pthread_cond_signal(&in->ring_cond);
+    pthread_mutex_unlock(&in->ring_lock);
+    pthread_join(in->ring_thread, (void **) NULL);
+
+    pthread_cond_destroy(&in->ring_data_cond);
+    pthread_cond_destroy(&in->ring_cond);
+    pthread_mutex_destroy(&in->ring_lock);
+    ring_buffer_deinit(&in->ring);
+    in->use_ring = false;
+
+    return 0;
+}
+
+/* must be called with in->lock locked, once in->pcm is open */
+static void capture_reader_start_l(struct stream_in *in)
+{
+    pthread_mutex_lock(&in->ring_lock);
+    in->capture_frames = in->frames_read;
+    in->capture_anchor_frames = in->frames_read;
+    in->capture_anchor_ns = 0;
+    in->session_frames_lost = 0;
+    in->ring_state = RING_STATE_RUNNING;
+    in->ring_error = 0;
+    pthread_cond_signal(&in->ring_cond);
+    pthread_mutex_unlock(&in->ring_lock);
+}
+
+/* must be called with in->lock locked, before in->pcm is closed */
+static void capture_reader_stop_l(struct stream_in *in)
+{
+    pthread_mutex_lock(&in->ring_lock);
+    in->ring_state = RING_STATE_IDLE;
+    while (in->ring_thread_busy)
+        pthread_cond_wait(&in->ring_data_cond, &in->ring_lock);
+    /* unread data is dropped like it would be by pcm_close() */
+    ring_buffer_reset(&in->ring);
+    in->ring_error = 0;
+    pthread_mutex_unlock(&in->ring_lock);
+}
+
+/*
+ * Copies captured data out of the ring, waiting only for the reader thread
+ * to bring in what is missing.
+ * must be called with in->lock locked
+ */
+static int capture_reader_read_l(struct stream_in *in, void *buffer,
+                                 size_t bytes)
+{
+    size_t copied = 0;
+    int ret = 0;
+
+    pthread_mutex_lock(&in->ring_lock);
+    while (copied < bytes) {
+        copied += ring_buffer_read(&in->ring, (uint8_t *)buffer + copied,
+                                   bytes - copied);
+        if (copied == bytes)
+            break;
+        if (in->ring_error != 0 || in->ring_state != RING_STATE_RUNNING) {
+            ret = in->ring_error != 0 ? in->ring_error : -EIO;
+            break;
+        }
+        pthread_cond_wait(&in->ring_data_cond, &in->ring_lock);
+    }
+    pthread_mutex_unlock(&in->ring_lock);
+
+    return ret;
+}
+
+/*
+ * Frames returned by in_read() so far and when the last of them was
+ * captured. Frames lost before it are accounted as soon as they are
+ * detected, which may be slightly early when the ring overflowed.
+ */
+static int in_get_capture_position(const struct audio_stream_in *stream,
+                                   int64_t *frames, int64_t *time)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    int ret = -ENOSYS;
+
+    if (!in->use_ring)
+        return ret;
+
+    pthread_mutex_lock(&in->lock);
+    pthread_mutex_lock(&in->ring_lock);
+    if (!in->standby && in->capture_anchor_ns != 0) {
+        int64_t behind = in->capture_anchor_frames -
+                         (int64_t)in->frames_read - in->session_frames_lost;
+
+        *frames = in->frames_read;
+        *time = in->capture_anchor_ns -
+                behind * 1000000000LL / in->config.rate;
+        ret = 0;
+    } else {
+        ret = -ENODATA;
+    }
+    pthread_mutex_unlock(&in->ring_lock);
+    pthread_mutex_unlock(&in->lock);
+
+    return ret;
+}
+
 static int in_standby(struct audio_stream *stream)
 {
     struct stream_in *in = (struct stream_in *)stream;
@@ -2552,12 +4099,14 @@ static int in_standby(struct audio_stream *stream)
     }
 
     if (!in->standby) {
-        pthread_mutex_lock(&adev->lock);
         in->standby = true;
         if (in->pcm) {
+            if (in->use_ring)
+                capture_reader_stop_l(in);
             pcm_close(in->pcm);
             in->pcm = NULL;
         }
+        pthread_mutex_lock(&adev->lock);
         status = stop_input_stream(in);
         pthread_mutex_unlock(&adev->lock);
     }
@@ -2566,9 +4115,23 @@ static int in_standby(struct audio_stream *stream)
     return status;
 }
 
-static int in_dump(const struct audio_stream *stream __unused,
-                   int fd __unused)
+static int in_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_in *in = (struct stream_in *)stream;
+
+    dprintf(fd, "  input %p usecase %s source %d\n", in,
+            use_case_table[in->usecase], in->source);
+    dump_stream_latency_stats(&in->stats, "read", fd);
+    if (in->use_ring) {
+        pthread_mutex_lock(&in->ring_lock);
+        dprintf(fd, "    capture ring %zu/%u bytes, %lld frames lost this session\n",
+                ring_buffer_avail_read(&in->ring), in->ring.size,
+                (long long)in->session_frames_lost);
+        pthread_mutex_unlock(&in->ring_lock);
+    }
+    if (audio_extn_ssr_get_enabled() &&
+            audio_channel_count_from_in_mask(in->channel_mask) == 6)
+        audio_extn_ssr_dump(fd);
     return 0;
 }
 
@@ -2648,6 +4211,27 @@ static char* in_get_parameters(const struct audio_stream *stream,
 
     voice_extn_in_get_parameters(in, query, reply);
 
+    if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_LATENCY_STATS)) {
+        char stats[512];
+
+        format_stream_latency_stats(&in->stats, "read", stats, sizeof(stats));
+        str_parms_add_str(reply, AUDIO_PARAMETER_KEY_LATENCY_STATS, stats);
+    }
+
+    if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_CAPTURE_POSITION_FRAMES) ||
+        str_parms_has_key(query, AUDIO_PARAMETER_KEY_CAPTURE_POSITION_TIME_NS)) {
+        int64_t frames, time_ns;
+
+        if (in_get_capture_position(&in->stream, &frames, &time_ns) == 0) {
+            snprintf(value, sizeof(value), "%lld", (long long)frames);
+            str_parms_add_str(reply, AUDIO_PARAMETER_KEY_CAPTURE_POSITION_FRAMES,
+                              value);
+            snprintf(value, sizeof(value), "%lld", (long long)time_ns);
+            str_parms_add_str(reply, AUDIO_PARAMETER_KEY_CAPTURE_POSITION_TIME_NS,
+                              value);
+        }
+    }
+
     str = str_parms_to_str(reply);
     str_parms_destroy(query);
     str_parms_destroy(reply);
@@ -2669,8 +4253,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
     struct audio_device *adev = in->dev;
     int i, ret = -1;
     int snd_scard_state = get_snd_card_state(adev);
+    bool parked = false;
+    int64_t read_start_us = latency_now_us();
 
-    pthread_mutex_lock(&in->lock);
+    timed_mutex_lock(&in->lock, &in->stats.lock_wait);
 
     if (in->pcm) {
         if(SND_CARD_STATE_OFFLINE == snd_scard_state) {
@@ -2682,20 +4268,32 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
 
     if (in->standby) {
         if (!in->is_st_session) {
-            pthread_mutex_lock(&adev->lock);
+            int64_t start_us = latency_now_us();
+
+            if (!stream_error_may_retry(adev, &in->error)) {
+                parked = true;
+                ret = -EIO;
+                goto exit;
+            }
+            timed_mutex_lock(&adev->lock, &in->stats.adev_lock_wait);
             if (in->usecase == USECASE_COMPRESS_VOIP_CALL)
                 ret = voice_extn_compress_voip_start_input_stream(in);
             else
                 ret = start_input_stream(in);
             pthread_mutex_unlock(&adev->lock);
+            latency_hist_add_since(&in->stats.start, start_us);
             if (ret != 0) {
                 goto exit;
             }
+            if (in->use_ring && in->pcm)
+                capture_reader_start_l(in);
         }
         in->standby = 0;
     }
 
-    if (in->pcm) {
+    if (in->pcm && in->use_ring) {
+        ret = capture_reader_read_l(in, buffer, bytes);
+    } else if (in->pcm) {
         if (audio_extn_ssr_get_enabled() &&
                 audio_channel_count_from_in_mask(in->channel_mask) == 6)
             ret = audio_extn_ssr_read(stream, buffer, bytes);
@@ -2715,6 +4313,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
      */
     if (ret == 0 && voice_get_mic_mute(adev) && !voice_is_in_call_rec_stream(in))
         memset(buffer, 0, bytes);
+    if (ret == 0) {
+        in->frames_read += bytes / audio_stream_in_frame_size(stream);
+        pcm_tap_write(in->tap, buffer, bytes);
+    }
 
 exit:
     /* ToDo: There may be a corner case when SSR happens back to back during
@@ -2723,26 +4325,45 @@ exit:
         set_snd_card_state(adev,SND_CARD_STATE_OFFLINE);
     }
     pthread_mutex_unlock(&in->lock);
+    latency_hist_add_since(&in->stats.io, read_start_us);
 
     if (ret != 0) {
-        if (in->usecase == USECASE_COMPRESS_VOIP_CALL) {
-            pthread_mutex_lock(&adev->lock);
-            voice_extn_compress_voip_close_input_stream(&in->stream.common);
-            pthread_mutex_unlock(&adev->lock);
-            in->standby = true;
+        int64_t buffer_us = (int64_t)bytes * 1000000 /
+                            audio_stream_in_frame_size(stream) /
+                            in_get_sample_rate(&in->stream.common);
+
+        if (!parked) {
+            if (in->usecase == USECASE_COMPRESS_VOIP_CALL) {
+                pthread_mutex_lock(&adev->lock);
+                voice_extn_compress_voip_close_input_stream(&in->stream.common);
+                pthread_mutex_unlock(&adev->lock);
+                in->standby = true;
+            }
+            in_standby(&in->stream.common);
         }
         memset(buffer, 0, bytes);
-        in_standby(&in->stream.common);
-        ALOGV("%s: read failed status %d- sleeping for buffer duration", __func__, ret);
-        usleep(bytes * 1000000 / audio_stream_in_frame_size(stream) /
-                                   in_get_sample_rate(&in->stream.common));
+        ALOGV("%s: read failed status %d- parking for buffer duration", __func__, ret);
+        stream_error_park(adev, &in->error, buffer_us, !parked);
+    } else {
+        stream_error_clear(adev, &in->error, use_case_table[in->usecase]);
     }
     return bytes;
 }
 
-static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream __unused)
+static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream)
 {
-    return 0;
+    struct stream_in *in = (struct stream_in *)stream;
+    uint32_t frames_lost;
+
+    if (!in->use_ring)
+        return 0;
+
+    pthread_mutex_lock(&in->ring_lock);
+    frames_lost = in->frames_lost;
+    in->frames_lost = 0;
+    pthread_mutex_unlock(&in->ring_lock);
+
+    return frames_lost;
 }
 
 static int add_remove_audio_effect(const struct audio_stream *stream,
@@ -2792,15 +4413,20 @@ static int in_remove_audio_effect(const struct audio_stream *stream,
     return add_remove_audio_effect(stream, effect, false);
 }
 
+#define STREAM_HANDLE_SLOT(handle) ((unsigned int)(handle) % STREAM_HANDLE_INDEX_SIZE)
+
+/* must be called with hw device mutex locked */
 static streams_input_ctxt_t *in_get_stream(struct audio_device *dev,
                                   audio_io_handle_t input)
 {
+    streams_input_ctxt_t *in_ctxt = dev->input_index[STREAM_HANDLE_SLOT(input)];
     struct listnode *node;
 
+    if (in_ctxt != NULL && in_ctxt->input->capture_handle == input)
+        return in_ctxt;
+
     list_for_each(node, &dev->active_inputs_list) {
-        streams_input_ctxt_t *in_ctxt = node_to_item(node,
-                                                     streams_input_ctxt_t,
-                                                     list);
+        in_ctxt = node_to_item(node, streams_input_ctxt_t, list);
         if (in_ctxt->input->capture_handle == input) {
             return in_ctxt;
         }
@@ -2808,15 +4434,18 @@ static streams_input_ctxt_t *in_get_stream(struct audio_device *dev,
     return NULL;
 }
 
+/* must be called with hw device mutex locked */
 static streams_output_ctxt_t *out_get_stream(struct audio_device *dev,
                                   audio_io_handle_t output)
 {
+    streams_output_ctxt_t *out_ctxt = dev->output_index[STREAM_HANDLE_SLOT(output)];
     struct listnode *node;
 
+    if (out_ctxt != NULL && out_ctxt->output->handle == output)
+        return out_ctxt;
+
     list_for_each(node, &dev->active_outputs_list) {
-        streams_output_ctxt_t *out_ctxt = node_to_item(node,
-                                                     streams_output_ctxt_t,
-                                                     list);
+        out_ctxt = node_to_item(node, streams_output_ctxt_t, list);
         if (out_ctxt->output->handle == output) {
             return out_ctxt;
         }
@@ -2824,6 +4453,66 @@ static streams_output_ctxt_t *out_get_stream(struct audio_device *dev,
     return NULL;
 }
 
+/* must be called with hw device mutex locked */
+static void in_add_stream(struct audio_device *dev, streams_input_ctxt_t *in_ctxt)
+{
+    unsigned int slot = STREAM_HANDLE_SLOT(in_ctxt->input->capture_handle);
+
+    list_add_tail(&dev->active_inputs_list, &in_ctxt->list);
+    if (dev->input_index[slot] == NULL)
+        dev->input_index[slot] = in_ctxt;
+}
+
+/* must be called with hw device mutex locked */
+static void in_remove_stream(struct audio_device *dev, streams_input_ctxt_t *in_ctxt)
+{
+    unsigned int slot = STREAM_HANDLE_SLOT(in_ctxt->input->capture_handle);
+    struct listnode *node;
+
+    list_remove(&in_ctxt->list);
+    if (dev->input_index[slot] != in_ctxt)
+        return;
+
+    dev->input_index[slot] = NULL;
+    list_for_each(node, &dev->active_inputs_list) {
+        streams_input_ctxt_t *other = node_to_item(node, streams_input_ctxt_t, list);
+        if (STREAM_HANDLE_SLOT(other->input->capture_handle) == slot) {
+            dev->input_index[slot] = other;
+            break;
+        }
+    }
+}
+
+/* must be called with hw device mutex locked */
+static void out_add_stream(struct audio_device *dev, streams_output_ctxt_t *out_ctxt)
+{
+    unsigned int slot = STREAM_HANDLE_SLOT(out_ctxt->output->handle);
+
+    list_add_tail(&dev->active_outputs_list, &out_ctxt->list);
+    if (dev->output_index[slot] == NULL)
+        dev->output_index[slot] = out_ctxt;
+}
+
+/* must be called with hw device mutex locked */
+static void out_remove_stream(struct audio_device *dev, streams_output_ctxt_t *out_ctxt)
+{
+    unsigned int slot = STREAM_HANDLE_SLOT(out_ctxt->output->handle);
+    struct listnode *node;
+
+    list_remove(&out_ctxt->list);
+    if (dev->output_index[slot] != out_ctxt)
+        return;
+
+    dev->output_index[slot] = NULL;
+    list_for_each(node, &dev->active_outputs_list) {
+        streams_output_ctxt_t *other = node_to_item(node, streams_output_ctxt_t, list);
+        if (STREAM_HANDLE_SLOT(other->output->handle) == slot) {
+            dev->output_index[slot] = other;
+            break;
+        }
+    }
+}
+
 static int adev_open_output_stream(struct audio_hw_device *dev,
                                    audio_io_handle_t handle,
                                    audio_devices_t devices,
@@ -2836,6 +4525,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     struct stream_out *out;
     int i, ret = 0;
     audio_format_t format;
+    char tap_name[64];
 
     *stream_out = NULL;
 
@@ -2994,6 +4684,16 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
                     compress_get_alsa_rate(config->offload_info.sample_rate);
         out->compr_config.codec->bit_rate =
                     config->offload_info.bit_rate;
+        /* AV sync and passthrough sessions keep the platform's sizing */
+        if ((config->offload_info.format & AUDIO_FORMAT_MAIN_MASK) != AUDIO_FORMAT_PCM_OFFLOAD &&
+            !audio_extn_dolby_is_passthrough_stream(out->flags) &&
+            !config->offload_info.has_video) {
+            char value[PROPERTY_VALUE_MAX] = {0};
+
+            property_get("audio.offload.adaptive.enabled", value, NULL);
+            out->adapt_fragments = atoi(value) || !strncmp("true", value, 4);
+            out_adapt_offload_fragments_l(out, true);
+        }
         out->compr_config.codec->ch_in =
                 audio_channel_count_from_out_mask(config->channel_mask);
         out->compr_config.codec->ch_out = out->compr_config.codec->ch_in;
@@ -3152,6 +4852,19 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     pthread_mutex_init(&out->lock, (const pthread_mutexattr_t *) NULL);
     pthread_cond_init(&out->cond, (const pthread_condattr_t *) NULL);
 
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_LOW_LATENCY ||
+        out->usecase == USECASE_AUDIO_PLAYBACK_DEEP_BUFFER) {
+        char value[PROPERTY_VALUE_MAX] = {0};
+
+        property_get("audio.playback.mmap.enabled", value, NULL);
+        out->use_mmap = atoi(value) || !strncmp("true", value, 4);
+    }
+
+    if (out->usecase == USECASE_AUDIO_PLAYBACK_DEEP_BUFFER &&
+        create_ring_writer_thread(out) != 0)
+        ALOGW("%s: deep buffer ring not available, writing to pcm directly",
+              __func__);
+
     config->format = out->stream.common.get_format(&out->stream.common);
     config->channel_mask = out->stream.common.get_channels(&out->stream.common);
     config->sample_rate = out->stream.common.get_sample_rate(&out->stream.common);
@@ -3173,8 +4886,11 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     }
     out_ctxt->output = out;
 
+    snprintf(tap_name, sizeof(tap_name), "out_%s", use_case_table[out->usecase]);
+    out->tap = pcm_tap_open(tap_name);
+
     pthread_mutex_lock(&adev->lock);
-    list_add_tail(&adev->active_outputs_list, &out_ctxt->list);
+    out_add_stream(adev, out_ctxt);
     pthread_mutex_unlock(&adev->lock);
 
     ALOGV("%s: exit", __func__);
@@ -3206,6 +4922,12 @@ static void adev_close_output_stream(struct audio_hw_device *dev __unused,
     } else
         out_standby(&stream->common);
 
+    pthread_mutex_lock(&out->lock);
+    struct pcm *warm_pcm = out_unpark_pcm_l(out);
+    if (warm_pcm != NULL)
+        pcm_close(warm_pcm);
+    pthread_mutex_unlock(&out->lock);
+
     if (is_offload_usecase(out->usecase)) {
         audio_extn_dts_remove_state_notifier_node(out->usecase);
         destroy_offload_callback_thread(out);
@@ -3216,6 +4938,9 @@ static void adev_close_output_stream(struct audio_hw_device *dev __unused,
             free(out->compr_config.codec);
     }
 
+    destroy_ring_writer_thread(out);
+    pcm_tap_close(out->tap);
+
     if (adev->voice_tx_output == out)
         adev->voice_tx_output = NULL;
 
@@ -3224,7 +4949,7 @@ static void adev_close_output_stream(struct audio_hw_device *dev __unused,
     pthread_mutex_lock(&adev->lock);
     streams_output_ctxt_t *out_ctxt = out_get_stream(adev, out->handle);
     if (out_ctxt != NULL) {
-        list_remove(&out_ctxt->list);
+        out_remove_stream(adev, out_ctxt);
         free(out_ctxt);
     } else {
         ALOGW("%s, output stream already closed", __func__);
@@ -3281,8 +5006,12 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
             set_snd_card_state(adev,SND_CARD_STATE_OFFLINE);
             //close compress sessions on OFFLINE status
             close_compress_sessions(adev);
+            warm_standby_expire_all(adev);
         } else if (strstr(snd_card_status, "ONLINE")) {
             ALOGD("Received sound card ONLINE status");
+            /* controls are re-created along with the card */
+            platform_reset_mixer_ctl_cache(adev->platform);
+            audio_extn_utils_reset_calibration_cache();
             set_snd_card_state(adev,SND_CARD_STATE_ONLINE);
         }
     }
@@ -3292,6 +5021,7 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
     if (status != 0)
         goto done;
 
+    audio_extn_utils_wait_for_calibration();
     status = platform_set_parameters(adev->platform, parms);
     if (status != 0)
         goto done;
@@ -3411,9 +5141,18 @@ static char* adev_get_parameters(const struct audio_hw_device *dev,
         goto exit;
     }
 
+    if (str_parms_has_key(query, AUDIO_PARAMETER_KEY_LATENCY_STATS)) {
+        value[0] = '\0';
+        latency_hist_format(&adev->device_switch_hist, "device_switch",
+                            value, sizeof(value));
+        str_parms_add_str(reply, AUDIO_PARAMETER_KEY_LATENCY_STATS, value);
+        goto exit;
+    }
+
     pthread_mutex_lock(&adev->lock);
     audio_extn_get_parameters(adev, query, reply);
     voice_get_parameters(adev, query, reply);
+    audio_extn_utils_wait_for_calibration();
     platform_get_parameters(adev->platform, query, reply);
     pthread_mutex_unlock(&adev->lock);
 
@@ -3435,8 +5174,8 @@ static int adev_set_voice_volume(struct audio_hw_device *dev, float volume)
 {
     int ret;
     struct audio_device *adev = (struct audio_device *)dev;
+
     pthread_mutex_lock(&adev->lock);
-    /* cache volume */
     ret = voice_set_volume(adev, volume);
     pthread_mutex_unlock(&adev->lock);
     return ret;
@@ -3528,6 +5267,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     int ret = 0, buffer_size, frame_size;
     int channel_count = audio_channel_count_from_in_mask(config->channel_mask);
     bool is_low_latency = false;
+    char tap_name[64];
 
     *stream_in = NULL;
     if (check_input_parameters(config->sample_rate, config->format, channel_count) != 0)
@@ -3651,8 +5391,15 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     }
     in_ctxt->input = in;
 
+    snprintf(tap_name, sizeof(tap_name), "in_%s", use_case_table[in->usecase]);
+    in->tap = pcm_tap_open(tap_name);
+
+    if (create_capture_reader_thread(in) != 0)
+        ALOGW("%s: capture ring not available, reading from pcm directly",
+              __func__);
+
     pthread_mutex_lock(&adev->lock);
-    list_add_tail(&adev->active_inputs_list, &in_ctxt->list);
+    in_add_stream(adev, in_ctxt);
     pthread_mutex_unlock(&adev->lock);
 
     ALOGV("%s: exit", __func__);
@@ -3695,10 +5442,13 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
             audio_extn_compr_cap_format_supported(in->config.format))
         audio_extn_compr_cap_deinit();
 
+    destroy_capture_reader_thread(in);
+    pcm_tap_close(in->tap);
+
     pthread_mutex_lock(&adev->lock);
     streams_input_ctxt_t *in_ctxt = in_get_stream(adev, in->capture_handle);
     if (in_ctxt != NULL) {
-        list_remove(&in_ctxt->list);
+        in_remove_stream(adev, in_ctxt);
         free(in_ctxt);
     } else {
         ALOGW("%s, input stream already closed", __func__);
@@ -3708,9 +5458,34 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
     return;
 }
 
-static int adev_dump(const audio_hw_device_t *device __unused,
-                     int fd __unused)
+static int adev_dump(const audio_hw_device_t *device, int fd)
 {
+    struct audio_device *adev = (struct audio_device *)device;
+    streams_output_ctxt_t *out_ctxt;
+    streams_input_ctxt_t *in_ctxt;
+    struct listnode *node;
+
+    dprintf(fd, "\nAudio HAL latency stats (us):\n");
+    latency_hist_dump(&adev->device_switch_hist, "device_switch", fd);
+    latency_hist_dump(&adev->snd_card_status.offline_hist, "card_offline", fd);
+    latency_hist_dump(&adev->snd_card_status.restart_hist, "stream_restart", fd);
+    pcm_tap_dump(fd);
+    proxy_capture_dump(fd);
+
+    /* do not hang dumpsys behind a stuck thread */
+    if (pthread_mutex_trylock(&adev->lock) != 0) {
+        dprintf(fd, "  adev->lock is busy, streams skipped\n");
+        return 0;
+    }
+    list_for_each(node, &adev->active_outputs_list) {
+        out_ctxt = node_to_item(node, streams_output_ctxt_t, list);
+        out_dump(&out_ctxt->output->stream.common, fd);
+    }
+    list_for_each(node, &adev->active_inputs_list) {
+        in_ctxt = node_to_item(node, streams_input_ctxt_t, list);
+        in_dump(&in_ctxt->input->stream.common, fd);
+    }
+    pthread_mutex_unlock(&adev->lock);
     return 0;
 }
 
@@ -3849,7 +5624,7 @@ static int adev_create_audio_patch(struct audio_hw_device *dev,
         }
         usecase = uc_info->id;
         pthread_mutex_lock(&adev->lock);
-        list_add_tail(&adev->usecase_list, &uc_info->list);
+        add_usecase_to_list(adev, uc_info);
         pthread_mutex_unlock(&adev->lock);
     } else {
         ALOGW("%s: not supported audio patch setting", __func__);
@@ -3869,8 +5644,11 @@ static int adev_create_audio_patch(struct audio_hw_device *dev,
     if (!patch_record) {
         ALOGE("%s fail to allocate patch_record", __func__);
         ret = -ENOMEM;
-        if (uc_info)
-            list_remove(&uc_info->list);
+        if (uc_info) {
+            pthread_mutex_lock(&adev->lock);
+            remove_usecase_from_list(adev, uc_info);
+            pthread_mutex_unlock(&adev->lock);
+        }
         goto error_config;
     }
 
@@ -3952,7 +5730,7 @@ static int adev_release_audio_patch(struct audio_hw_device *dev,
             }
 
             /* remove usecase from list and free it */
-            list_remove(&uc_info->list);
+            remove_usecase_from_list(adev, uc_info);
             free(uc_info);
         }
     }
@@ -3981,6 +5759,13 @@ static int adev_close(hw_device_t *device)
         audio_extn_utils_release_streams_output_cfg_list(&adev->streams_output_cfg_list);
         audio_route_free(adev->audio_route);
         free(adev->snd_dev_ref_cnt);
+        audio_extn_utils_calibration_deinit();
+        warm_standby_deinit(adev);
+        while (!list_empty(&adev->usecase_free_list)) {
+            struct listnode *node = list_head(&adev->usecase_free_list);
+            list_remove(node);
+            free(node_to_item(node, struct audio_usecase, list));
+        }
         platform_deinit(adev->platform);
         if(adev->ext_hw_plugin)
             audio_extn_ext_hw_plugin_deinit(adev->ext_hw_plugin);
@@ -4013,6 +5798,8 @@ static int adev_open(const hw_module_t *module, const char *name,
                      hw_device_t **device)
 {
     int i, ret;
+    pthread_condattr_t cond_attr;
+    void (*set_proxy_capture)(const struct proxy_capture_ops *);
 
     ALOGD("%s: enter", __func__);
     if (strcmp(name, AUDIO_HARDWARE_INTERFACE) != 0) return -EINVAL;
@@ -4035,6 +5822,7 @@ static int adev_open(const hw_module_t *module, const char *name,
     }
 
     pthread_mutex_init(&adev->lock, (const pthread_mutexattr_t *) NULL);
+    pthread_mutex_init(&adev->mixer_lock, (const pthread_mutexattr_t *) NULL);
 
     adev->device.common.tag = HARDWARE_DEVICE_TAG;
     adev->device.common.version = AUDIO_DEVICE_API_VERSION_3_0;
@@ -4077,10 +5865,16 @@ static int adev_open(const hw_module_t *module, const char *name,
     list_init(&adev->audio_patch_record_list);
     list_init(&adev->active_inputs_list);
     list_init(&adev->active_outputs_list);
+    list_init(&adev->usecase_free_list);
+    warm_standby_init(adev);
     adev->cur_wfd_channels = 2;
     adev->offload_usecases_state = 0;
 
     pthread_mutex_init(&adev->snd_card_status.lock, (const pthread_mutexattr_t *) NULL);
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&adev->snd_card_status.cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
     adev->snd_card_status.state = SND_CARD_STATE_OFFLINE;
     /* Loads platform specific libraries dynamically */
     adev->platform = platform_init(adev);
@@ -4094,9 +5888,11 @@ static int adev_open(const hw_module_t *module, const char *name,
     }
 
     adev->ext_hw_plugin = audio_extn_ext_hw_plugin_init(adev);
+    audio_extn_utils_calibration_init(adev);
 
     adev->snd_card_status.state = SND_CARD_STATE_ONLINE;
 
+    proxy_capture_init(adev->snd_card);
     if (access(VISUALIZER_LIBRARY_PATH, R_OK) == 0) {
         adev->visualizer_lib = dlopen(VISUALIZER_LIBRARY_PATH, RTLD_NOW);
         if (adev->visualizer_lib == NULL) {
@@ -4109,6 +5905,11 @@ static int adev_open(const hw_module_t *module, const char *name,
             adev->visualizer_stop_output =
                         (int (*)(audio_io_handle_t, int))dlsym(adev->visualizer_lib,
                                                         "visualizer_hal_stop_output");
+            set_proxy_capture =
+                        (void (*)(const struct proxy_capture_ops *))dlsym(adev->visualizer_lib,
+                                                        "visualizer_hal_set_proxy_capture");
+            if (set_proxy_capture != NULL)
+                set_proxy_capture(proxy_capture_get_ops());
         }
     }
     audio_extn_listen_init(adev, adev->snd_card);
@@ -46,6 +46,10 @@
 #include <audio_route/audio_route.h>
 #include "audio_defs.h"
 #include "voice.h"
+#include "ring_buffer.h"
+#include "latency_stats.h"
+#include "clock_model.h"
+#include "pcm_tap.h"
 
 #define VISUALIZER_LIBRARY_PATH "/system/lib/soundfx/libqcomvisualizer.so"
 #define OFFLOAD_EFFECTS_BUNDLE_LIBRARY_PATH "/system/lib/soundfx/libqcompostprocbundle.so"
@@ -150,6 +154,10 @@ enum {
 
 const char * const use_case_table[AUDIO_USECASE_MAX];
 
+#define USECASE_MASK_WORDS ((AUDIO_USECASE_MAX + 31) / 32)
+/* handle slots for the active stream lookup, collisions fall back to the list */
+#define STREAM_HANDLE_INDEX_SIZE 32
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 /*
@@ -174,10 +182,34 @@ enum {
     OFFLOAD_STATE_PAUSED,
 };
 
+enum {
+    RING_STATE_IDLE,                /* no pcm, ring thread parked */
+    RING_STATE_RUNNING,             /* ring thread moves data to/from the pcm */
+    RING_STATE_EXIT,                /* exit ring thread loop */
+};
+
+/* pending offload commands live in a fixed ring in stream_out */
+#define OFFLOAD_CMD_QUEUE_SIZE 8
+
 struct offload_cmd {
-    struct listnode node;
     int cmd;
-    int data[];
+    int64_t queued_us;
+};
+
+/* always on timing of the stream hot paths, see out_dump()/in_dump() */
+struct stream_latency_stats {
+    struct latency_hist io;             /* out_write()/in_read() duration */
+    struct latency_hist lock_wait;      /* wait for the stream lock */
+    struct latency_hist adev_lock_wait; /* wait for adev->lock on start */
+    struct latency_hist start;          /* standby exit */
+    struct latency_hist offload_cmd;    /* offload command queueing delay */
+};
+
+/* a stream whose io failed, see stream_error_park() */
+struct stream_error_state {
+    uint32_t failures;                  /* consecutive, 0 when healthy */
+    int64_t retry_us;                   /* no restart before this */
+    uint32_t online_seq;                /* card generation of the failures */
 };
 
 struct stream_app_type_cfg {
@@ -216,7 +248,9 @@ struct stream_out {
     int offload_state;
     pthread_cond_t offload_cond;
     pthread_t offload_thread;
-    struct listnode offload_cmd_list;
+    struct offload_cmd offload_cmds[OFFLOAD_CMD_QUEUE_SIZE];
+    unsigned int offload_cmd_head;
+    unsigned int offload_cmd_count;
     bool offload_thread_blocked;
 
     stream_callback_t offload_callback;
@@ -225,6 +259,50 @@ struct stream_out {
     int send_new_metadata;
     unsigned int bit_width;
 
+    /* metadata of the next track given while the current one drains,
+     * see offload_switch_track() */
+    bool partial_draining;
+    bool next_mdata_valid;
+    struct compr_gapless_mdata next_mdata;
+
+    /* pcm opened MMAP|NOIRQ, see out_pcm_mmap_write() */
+    bool use_mmap;
+    bool mmap_started;
+
+    /* deep buffer ring, out_write() only copies into it and the writer
+     * thread is the one blocking in pcm_write() */
+    bool use_ring;
+    struct ring_buffer ring;
+    pthread_t ring_thread;
+    pthread_mutex_t ring_lock;
+    pthread_cond_t ring_cond;        /* signalled when data is queued */
+    pthread_cond_t ring_space_cond;  /* signalled when data is consumed */
+    int ring_state;
+    bool ring_thread_busy;
+    int ring_error;
+    uint32_t ring_underruns;
+
+    struct stream_latency_stats stats;
+
+    /* offload fragment sizing, see out_adapt_offload_fragments_l() */
+    bool adapt_fragments;
+    uint64_t offload_bytes_written;
+    uint32_t offload_wakeups;
+    uint32_t offload_byte_rate;       /* measured by the last session */
+    uint32_t offload_wakeups_per_min; /* measured by the last session */
+
+    /* rendered frames against time, see out_get_presentation_position() */
+    struct clock_model position_model;
+    uint64_t last_position;
+
+    /* pcm kept open across standby, see out_park_pcm_l() */
+    struct pcm *warm_pcm;
+    struct listnode warm_node;
+    int64_t warm_deadline_us;
+
+    struct pcm_tap *tap;
+    struct stream_error_state error;
+
     struct audio_device *dev;
 };
 
@@ -245,6 +323,29 @@ struct stream_in {
     audio_io_handle_t capture_handle;
     bool is_st_session;
 
+    /* capture ring, the reader thread is the one blocking in pcm_read()
+     * and in_read() only copies out, see capture_reader_thread_loop() */
+    bool use_ring;
+    struct ring_buffer ring;
+    pthread_t ring_thread;
+    pthread_mutex_t ring_lock;
+    pthread_cond_t ring_cond;        /* signalled on state changes */
+    pthread_cond_t ring_data_cond;   /* signalled when a chunk is captured */
+    int ring_state;
+    bool ring_thread_busy;
+    int ring_error;
+    /* capture timeline of the session, in frames read by the client */
+    int64_t capture_frames;          /* next frame pulled from the pcm */
+    int64_t capture_anchor_frames;   /* frame at the hw pointer ... */
+    int64_t capture_anchor_ns;       /* ... and when it was there */
+    int64_t session_frames_lost;     /* never reached the client */
+    uint32_t frames_lost;            /* since in_get_input_frames_lost() */
+    uint64_t frames_read;            /* returned by in_read() */
+
+    struct stream_latency_stats stats;
+    struct pcm_tap *tap;
+    struct stream_error_state error;
+
     struct audio_device *dev;
 };
 
@@ -274,9 +375,17 @@ struct audio_usecase {
 
 struct sound_card_status {
     pthread_mutex_t lock;
+    pthread_cond_t cond;                /* broadcast on every state change */
     int state;
+    uint32_t state_seq;                 /* bumped on every state change */
+    uint32_t online_seq;                /* bumped when the card comes back */
+    int64_t offline_us;
+    int64_t online_us;
+    struct latency_hist offline_hist;   /* OFFLINE to ONLINE */
+    struct latency_hist restart_hist;   /* ONLINE to a parked stream's io */
 };
 
+
 struct stream_format {
     struct listnode list;
     audio_format_t format;
@@ -308,6 +417,7 @@ typedef struct streams_output_ctxt {
 struct audio_device {
     struct audio_hw_device device;
     pthread_mutex_t lock; /* see note below on mutex acquisition order */
+    pthread_mutex_t mixer_lock; /* volume control writes */
     struct mixer *mixer;
     audio_mode_t mode;
     audio_devices_t out_device;
@@ -319,8 +429,13 @@ struct audio_device {
     bool screen_off;
     int *snd_dev_ref_cnt;
     struct listnode usecase_list;
+    /* kept in sync with usecase_list, see add_usecase_to_list() */
+    struct audio_usecase *usecase_index[AUDIO_USECASE_MAX];
+    uint32_t active_usecases[USECASE_MASK_WORDS];
     struct listnode streams_output_cfg_list;
     struct audio_route *audio_route;
+    int route_txn_depth; /* pending audio_route updates, see select_devices() */
+    struct latency_hist device_switch_hist;
     int acdb_settings;
     bool speaker_lr_swap;
     struct voice voice;
@@ -347,6 +462,20 @@ struct audio_device {
     unsigned int audio_patch_index;
     struct listnode active_inputs_list;
     struct listnode active_outputs_list;
+    streams_input_ctxt_t *input_index[STREAM_HANDLE_INDEX_SIZE];
+    streams_output_ctxt_t *output_index[STREAM_HANDLE_INDEX_SIZE];
+
+    /* recycled audio_usecase nodes, see alloc_usecase() */
+    struct listnode usecase_free_list;
+    unsigned int usecase_free_count;
+
+    /* outputs parked in warm standby, closed by warm_thread on expiry */
+    unsigned int warm_standby_ms;
+    pthread_t warm_thread;
+    pthread_mutex_t warm_lock;
+    pthread_cond_t warm_cond;
+    struct listnode warm_list;
+    bool warm_exit;
 };
 
 struct audio_patch_record {
@@ -368,10 +497,27 @@ int enable_snd_device(struct audio_device *adev,
 
 int enable_audio_route(struct audio_device *adev,
                        struct audio_usecase *usecase);
+void flush_route_transaction(struct audio_device *adev);
+
+struct audio_usecase *alloc_usecase(struct audio_device *adev);
+void release_usecase(struct audio_device *adev, struct audio_usecase *usecase);
 
 struct audio_usecase *get_usecase_from_list(struct audio_device *adev,
                                                    audio_usecase_t uc_id);
 
+void add_usecase_to_list(struct audio_device *adev,
+                         struct audio_usecase *uc_info);
+
+void remove_usecase_from_list(struct audio_device *adev,
+                              struct audio_usecase *uc_info);
+
+int next_active_usecase(struct audio_device *adev, int uc_id);
+
+#define for_each_active_usecase(adev, uc_id) \
+    for ((uc_id) = next_active_usecase((adev), 0); \
+         (uc_id) < AUDIO_USECASE_MAX; \
+         (uc_id) = next_active_usecase((adev), (uc_id) + 1))
+
 bool is_offload_usecase(audio_usecase_t uc_id);
 
 int pcm_ioctl(struct pcm *pcm, int request, ...);
@@ -385,7 +531,21 @@ int get_snd_card_state(struct audio_device *adev);
 
 /*
  * NOTE: when multiple mutexes have to be acquired, always take the
- * stream_in or stream_out mutex first, followed by the audio_device mutex.
+ * stream_in or stream_out mutex first, followed by the audio_device mutex,
+ * followed by the audio_device mixer_lock.
+ *
+ * audio_device lock protects the routing state: mode, voice sessions, the
+ * usecase list and the snd device reference counts. It is not held while a
+ * pcm or compress session is opened or closed, those handles belong to the
+ * stream mutex. mixer_lock only serializes the volume control writes, voice
+ * volume takes it under audio_device lock and offload volume without it.
+ *
+ * stream_out ring_lock is a leaf lock: it is never held while taking another
+ * mutex and never held across pcm_write().
+ *
+ * audio_device warm_lock is taken after the stream mutex. The warm standby
+ * thread holds it while closing parked pcms and only ever trylocks the
+ * stream mutex from there.
  */
 
 #endif // QCOM_AUDIO_HW_H
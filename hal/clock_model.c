@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "audio_hw_clock_model"
+/*#define LOG_NDEBUG 0*/
+
+#include <string.h>
+#include <cutils/log.h>
+
+#include "clock_model.h"
+
+/* the fitted rate is trusted only this close to the nominal one */
+#define CLOCK_MODEL_MAX_SKEW 0.05
+/* below this span the points say nothing about the rate */
+#define CLOCK_MODEL_MIN_SPAN_NS 5000000LL
+
+void clock_model_reset(struct clock_model *cm, uint32_t sample_rate)
+{
+    memset(cm, 0, sizeof(*cm));
+    cm->sample_rate = sample_rate;
+    cm->slope = sample_rate / 1000000000.0;
+}
+
+static void clock_model_fit(struct clock_model *cm)
+{
+    double nominal = cm->sample_rate / 1000000000.0;
+    double mean_t = 0, mean_f = 0, sxx = 0, sxy = 0, dt, df;
+    int64_t base_ns = cm->last_ns, base_frames = 0;
+    unsigned int i;
+
+    /* work relative to the newest point to keep the doubles precise */
+    for (i = 0; i < cm->num_points; i++) {
+        if (cm->time_ns[i] == cm->last_ns)
+            base_frames = cm->frames[i];
+    }
+    for (i = 0; i < cm->num_points; i++) {
+        mean_t += (double)(cm->time_ns[i] - base_ns);
+        mean_f += (double)(cm->frames[i] - base_frames);
+    }
+    mean_t /= cm->num_points;
+    mean_f /= cm->num_points;
+    for (i = 0; i < cm->num_points; i++) {
+        dt = (double)(cm->time_ns[i] - base_ns) - mean_t;
+        df = (double)(cm->frames[i] - base_frames) - mean_f;
+        sxx += dt * dt;
+        sxy += dt * df;
+    }
+
+    cm->slope = nominal;
+    if (cm->num_points >= 2 &&
+        sxx >= (double)CLOCK_MODEL_MIN_SPAN_NS * CLOCK_MODEL_MIN_SPAN_NS) {
+        double slope = sxy / sxx;
+
+        if (slope > nominal * (1 - CLOCK_MODEL_MAX_SKEW) &&
+            slope < nominal * (1 + CLOCK_MODEL_MAX_SKEW))
+            cm->slope = slope;
+        else
+            ALOGV("%s: rejecting rate %f, nominal %f", __func__,
+                  slope * 1000000000.0, nominal * 1000000000.0);
+    }
+    cm->base_ns = base_ns;
+    cm->offset = base_frames + mean_f - cm->slope * mean_t;
+}
+
+void clock_model_add(struct clock_model *cm, int64_t time_ns, int64_t frames)
+{
+    bool stalled;
+
+    if (cm->num_points > 0 && time_ns <= cm->last_ns)
+        return;
+
+    /* points from before a stall or from during it say nothing about after */
+    stalled = cm->num_points > 0 && frames <= cm->last_frames;
+    if (cm->num_points > 0 && stalled != cm->stalled) {
+        ALOGV("%s: clock %s at %lld frames", __func__,
+              stalled ? "stopped" : "restarted", (long long)frames);
+        clock_model_reset(cm, cm->sample_rate);
+        cm->stalled = stalled;
+    }
+
+    cm->time_ns[cm->next] = time_ns;
+    cm->frames[cm->next] = frames;
+    cm->next = (cm->next + 1) % CLOCK_MODEL_POINTS;
+    if (cm->num_points < CLOCK_MODEL_POINTS)
+        cm->num_points++;
+    cm->last_ns = time_ns;
+    cm->last_frames = frames;
+
+    clock_model_fit(cm);
+}
+
+bool clock_model_valid(const struct clock_model *cm)
+{
+    return cm->num_points > 0;
+}
+
+int64_t clock_model_predict(const struct clock_model *cm, int64_t time_ns)
+{
+    double frames = cm->offset + cm->slope * (double)(time_ns - cm->base_ns);
+
+    if (cm->stalled)
+        return cm->last_frames > 0 ? cm->last_frames : 0;
+    return frames > 0 ? (int64_t)(frames + 0.5) : 0;
+}
+
+int64_t clock_model_age_ns(const struct clock_model *cm, int64_t now_ns)
+{
+    if (cm->num_points == 0)
+        return INT64_MAX;
+    return now_ns - cm->last_ns;
+}
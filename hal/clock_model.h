@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CLOCK_MODEL_H
+#define CLOCK_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Linear model of a stream clock, rendered frames against CLOCK_MONOTONIC.
+ *
+ * Timestamped frame counts from the kernel or the DSP are added as they are
+ * read and the model is refitted by least squares over the last few of them,
+ * so the reported position follows the real hardware rate instead of the
+ * nominal one and a single late sample does not make it jump. Positions in
+ * between are predicted from the fit without going back to the driver.
+ * A point that does not advance on the previous one means the clock stopped
+ * (underrun, end of stream), the model then holds that count instead of
+ * extrapolating and starts a new fit once the clock moves again.
+ * Not thread safe, callers hold the stream lock.
+ */
+#define CLOCK_MODEL_POINTS 8
+
+struct clock_model {
+    uint32_t sample_rate;
+    unsigned int num_points;
+    unsigned int next;
+    int64_t time_ns[CLOCK_MODEL_POINTS];
+    int64_t frames[CLOCK_MODEL_POINTS];
+    /* fit relative to base_ns: frames = offset + slope * (t - base_ns) */
+    int64_t base_ns;
+    double offset;
+    double slope;
+    int64_t last_ns; /* time of the newest point */
+    int64_t last_frames; /* frames of the newest point */
+    bool stalled;
+};
+
+void clock_model_reset(struct clock_model *cm, uint32_t sample_rate);
+void clock_model_add(struct clock_model *cm, int64_t time_ns, int64_t frames);
+bool clock_model_valid(const struct clock_model *cm);
+int64_t clock_model_predict(const struct clock_model *cm, int64_t time_ns);
+
+/* time since the newest point, or INT64_MAX without any point */
+int64_t clock_model_age_ns(const struct clock_model *cm, int64_t now_ns);
+
+#endif /* CLOCK_MODEL_H */
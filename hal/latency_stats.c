@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "audio_hw_latency_stats"
+/*#define LOG_NDEBUG 0*/
+
+#include <stdio.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+
+#include "latency_stats.h"
+
+void latency_hist_reset(struct latency_hist *hist)
+{
+    int i;
+
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+        android_atomic_release_store(0, &hist->buckets[i]);
+    android_atomic_release_store(0, &hist->max_us);
+    android_atomic_release_store(0, &hist->count);
+}
+
+void latency_hist_add(struct latency_hist *hist, int64_t us)
+{
+    int32_t val, max;
+    int bucket = 0;
+
+    if (us < 0)
+        us = 0;
+    val = us > INT32_MAX ? INT32_MAX : (int32_t)us;
+
+    while (bucket < LATENCY_HIST_BUCKETS - 1 && (val >> (bucket + 1)) != 0)
+        bucket++;
+
+    android_atomic_inc(&hist->buckets[bucket]);
+    android_atomic_inc(&hist->count);
+
+    max = android_atomic_acquire_load(&hist->max_us);
+    while (val > max) {
+        if (android_atomic_release_cas(max, val, &hist->max_us) == 0)
+            break;
+        max = android_atomic_acquire_load(&hist->max_us);
+    }
+}
+
+uint32_t latency_hist_percentile(struct latency_hist *hist, int percent)
+{
+    int32_t count = android_atomic_acquire_load(&hist->count);
+    int64_t target, seen = 0;
+    int i;
+
+    if (count <= 0)
+        return 0;
+
+    target = ((int64_t)count * percent + 99) / 100;
+    for (i = 0; i < LATENCY_HIST_BUCKETS - 1; i++) {
+        seen += android_atomic_acquire_load(&hist->buckets[i]);
+        if (seen >= target)
+            return 1U << (i + 1);
+    }
+    return (uint32_t)android_atomic_acquire_load(&hist->max_us);
+}
+
+void latency_hist_dump(struct latency_hist *hist, const char *name, int fd)
+{
+    int32_t count = android_atomic_acquire_load(&hist->count);
+    int32_t n;
+    int i;
+
+    dprintf(fd, "    %s: count %d p50 %uus p90 %uus p99 %uus max %dus\n",
+            name, count, latency_hist_percentile(hist, 50),
+            latency_hist_percentile(hist, 90),
+            latency_hist_percentile(hist, 99),
+            android_atomic_acquire_load(&hist->max_us));
+    if (count <= 0)
+        return;
+
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        n = android_atomic_acquire_load(&hist->buckets[i]);
+        if (n == 0)
+            continue;
+        if (i == LATENCY_HIST_BUCKETS - 1)
+            dprintf(fd, "      >= %uus: %d\n", 1U << i, n);
+        else
+            dprintf(fd, "      < %uus: %d\n", 1U << (i + 1), n);
+    }
+}
+
+void latency_hist_format(struct latency_hist *hist, const char *name,
+                         char *buf, size_t size)
+{
+    size_t len = strlen(buf);
+
+    if (len >= size)
+        return;
+
+    snprintf(buf + len, size - len, "%s%s,%d,%u,%u,%u,%d",
+             len ? "|" : "", name,
+             android_atomic_acquire_load(&hist->count),
+             latency_hist_percentile(hist, 50),
+             latency_hist_percentile(hist, 90),
+             latency_hist_percentile(hist, 99),
+             android_atomic_acquire_load(&hist->max_us));
+}
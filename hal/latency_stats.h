@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Latency histogram with power of two buckets in microseconds: bucket 0
+ * counts samples below 2us, bucket i samples in [2^i, 2^(i+1)) and the last
+ * bucket everything above. Updates are lock free, so any thread may record
+ * into a histogram while another one dumps it.
+ */
+#define LATENCY_HIST_BUCKETS 24
+
+struct latency_hist {
+    volatile int32_t count;
+    volatile int32_t max_us;
+    volatile int32_t buckets[LATENCY_HIST_BUCKETS];
+};
+
+static inline int64_t latency_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_hist_reset(struct latency_hist *hist);
+void latency_hist_add(struct latency_hist *hist, int64_t us);
+
+static inline void latency_hist_add_since(struct latency_hist *hist,
+                                          int64_t start_us)
+{
+    latency_hist_add(hist, latency_now_us() - start_us);
+}
+
+/* upper bound in us of the bucket holding the given percentile */
+uint32_t latency_hist_percentile(struct latency_hist *hist, int percent);
+
+void latency_hist_dump(struct latency_hist *hist, const char *name, int fd);
+
+/* appends "name,count,p50,p90,p99,max" to buf, '|' separated */
+void latency_hist_format(struct latency_hist *hist, const char *name,
+                         char *buf, size_t size);
+
+#endif /* LATENCY_STATS_H */
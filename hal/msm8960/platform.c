@@ -22,6 +22,8 @@
 #define LOG_NDDEBUG 0
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <dlfcn.h>
 #include <sys/ioctl.h>
 #include <cutils/log.h>
@@ -120,6 +122,14 @@ typedef int (*acdb_reload_vocvoltable_t)(int);
 typedef int  (*acdb_get_default_app_type_t)(void);
 
 
+/* name to control lookups, see platform_get_mixer_ctl() */
+#define MIXER_CTL_CACHE_SIZE 64
+
+struct mixer_ctl_cache_entry {
+    char *name;
+    struct mixer_ctl *ctl;
+};
+
 struct platform_data {
     struct audio_device *adev;
     bool fluence_in_spkr_mode;
@@ -146,6 +156,8 @@ struct platform_data {
 
     void *hw_info;
     struct csd_data *csd;
+    pthread_mutex_t mixer_ctl_cache_lock;
+    struct mixer_ctl_cache_entry mixer_ctl_cache[MIXER_CTL_CACHE_SIZE];
 };
 
 static int pcm_device_table[AUDIO_USECASE_MAX][2] = {
@@ -760,6 +772,8 @@ void *platform_init(struct audio_device *adev)
         ALOGE("failed to allocate platform data");
         return NULL;
     }
+    pthread_mutex_init(&my_data->mixer_ctl_cache_lock,
+                       (const pthread_mutexattr_t *) NULL);
 
     while (snd_card_num < MAX_SND_CARD) {
         adev->mixer = mixer_open(snd_card_num);
@@ -950,11 +964,69 @@ void platform_deinit(void *platform)
         }
     }
 
+    platform_reset_mixer_ctl_cache(platform);
+    pthread_mutex_destroy(&my_data->mixer_ctl_cache_lock);
+
     free(platform);
     /* deinit usb */
     audio_extn_usb_deinit();
 }
 
+static unsigned int mixer_ctl_name_hash(const char *name)
+{
+    unsigned int hash = 5381;
+
+    while (*name)
+        hash = (hash << 5) + hash + (unsigned char)*name++;
+    return hash;
+}
+
+struct mixer_ctl *platform_get_mixer_ctl(void *platform, const char *name)
+{
+    struct platform_data *my_data = (struct platform_data *)platform;
+    unsigned int i, slot = mixer_ctl_name_hash(name) % MIXER_CTL_CACHE_SIZE;
+    struct mixer_ctl_cache_entry *entry;
+    struct mixer_ctl *ctl = NULL;
+
+    pthread_mutex_lock(&my_data->mixer_ctl_cache_lock);
+    for (i = 0; i < MIXER_CTL_CACHE_SIZE; i++) {
+        entry = &my_data->mixer_ctl_cache[(slot + i) % MIXER_CTL_CACHE_SIZE];
+        if (entry->name == NULL) {
+            /* misses are not cached, the control may show up after SSR */
+            ctl = mixer_get_ctl_by_name(my_data->adev->mixer, name);
+            if (ctl != NULL) {
+                entry->name = strdup(name);
+                if (entry->name != NULL)
+                    entry->ctl = ctl;
+            }
+            goto done;
+        }
+        if (!strcmp(entry->name, name)) {
+            ctl = entry->ctl;
+            goto done;
+        }
+    }
+    /* cache is full, resolve without caching */
+    ctl = mixer_get_ctl_by_name(my_data->adev->mixer, name);
+done:
+    pthread_mutex_unlock(&my_data->mixer_ctl_cache_lock);
+    return ctl;
+}
+
+void platform_reset_mixer_ctl_cache(void *platform)
+{
+    struct platform_data *my_data = (struct platform_data *)platform;
+    int i;
+
+    pthread_mutex_lock(&my_data->mixer_ctl_cache_lock);
+    for (i = 0; i < MIXER_CTL_CACHE_SIZE; i++) {
+        free(my_data->mixer_ctl_cache[i].name);
+        my_data->mixer_ctl_cache[i].name = NULL;
+        my_data->mixer_ctl_cache[i].ctl = NULL;
+    }
+    pthread_mutex_unlock(&my_data->mixer_ctl_cache_lock);
+}
+
 
 const char *platform_get_snd_device_name(snd_device_t snd_device)
 {
@@ -1467,7 +1539,7 @@ int platform_set_voice_volume(void *platform, int volume)
     vol_index = (int)percent_to_index(volume, MIN_VOL_INDEX, MAX_VOL_INDEX);
     set_values[0] = vol_index;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -1498,7 +1570,7 @@ int platform_set_mic_mute(void *platform, bool state)
                               DEFAULT_MUTE_RAMP_DURATION_MS};
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -1541,7 +1613,7 @@ int platform_set_device_mute(void *platform, bool state, char *dir)
     }
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2010,7 +2082,7 @@ int platform_set_hdmi_channels(void *platform,  int channel_count)
     default:
         channel_cnt_str = "Two"; break;
     }
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2034,7 +2106,7 @@ int platform_edid_get_max_channels(void *platform __unused)
 
     struct mixer_ctl *ctl;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, AUDIO_DATA_BLOCK_MIXER_CTL);
+    ctl = platform_get_mixer_ctl(adev->platform, AUDIO_DATA_BLOCK_MIXER_CTL);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, AUDIO_DATA_BLOCK_MIXER_CTL);
@@ -2086,7 +2158,7 @@ static int platform_set_slowtalk(struct platform_data *my_data, bool state)
                               ALL_SESSION_VSID};
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2209,7 +2281,7 @@ int platform_set_incall_recording_session_id(void *platform,
     int num_ctl_values;
     int i;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2385,6 +2457,21 @@ uint32_t platform_get_compress_offload_buffer_size(audio_offload_info_t* info)
     return fragment_size;
 }
 
+/* false when the size is pinned by audio.offload.buffer.size.kb */
+bool platform_get_compress_offload_fragment_limits(uint32_t *min_size,
+                                                   uint32_t *max_size)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+
+    if ((property_get("audio.offload.buffer.size.kb", value, "")) &&
+            atoi(value))
+        return false;
+
+    *min_size = MIN_COMPRESS_OFFLOAD_FRAGMENT_SIZE;
+    *max_size = MAX_COMPRESS_OFFLOAD_FRAGMENT_SIZE;
+    return true;
+}
+
 uint32_t platform_get_pcm_offload_buffer_size(audio_offload_info_t* info)
 {
     uint32_t fragment_size = 0;
@@ -2429,7 +2516,7 @@ int platform_set_codec_backend_cfg(struct audio_device* adev,
     if (bit_width != adev->cur_codec_backend_bit_width) {
         const char * mixer_ctl_name = "MI2S_0_RX Format";
         struct  mixer_ctl *ctl;
-        ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+        ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
         if (!ctl) {
             ALOGE("%s: Could not get ctl for mixer command - %s",
                     __func__, mixer_ctl_name);
@@ -2496,7 +2583,7 @@ int platform_set_codec_backend_cfg(struct audio_device* adev,
                 break;
             }
 
-            ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+            ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
             if(!ctl) {
                 ALOGE("%s: Could not get ctl for mixer command - %s",
                     __func__, mixer_ctl_name);
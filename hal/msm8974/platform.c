@@ -28,6 +28,8 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -164,6 +166,14 @@ acdb_loader_get_calibration_t acdb_loader_get_calibration;
 typedef int (*acdb_set_audio_cal_t) (void *, void *, uint32_t);
 typedef int (*acdb_get_audio_cal_t) (void *, void *, uint32_t*);
 
+/* name to control lookups, see platform_get_mixer_ctl() */
+#define MIXER_CTL_CACHE_SIZE 64
+
+struct mixer_ctl_cache_entry {
+    char *name;
+    struct mixer_ctl *ctl;
+};
+
 struct platform_data {
     struct audio_device *adev;
     bool fluence_in_spkr_mode;
@@ -196,6 +206,8 @@ struct platform_data {
     struct csd_data *csd;
     void *edid_info;
     bool edid_valid;
+    pthread_mutex_t mixer_ctl_cache_lock;
+    struct mixer_ctl_cache_entry mixer_ctl_cache[MIXER_CTL_CACHE_SIZE];
 };
 
 static int pcm_device_table[AUDIO_USECASE_MAX][2] = {
@@ -998,6 +1010,8 @@ void *platform_init(struct audio_device *adev)
         ALOGE("failed to allocate platform data");
         return NULL;
     }
+    pthread_mutex_init(&my_data->mixer_ctl_cache_lock,
+                       (const pthread_mutexattr_t *) NULL);
 
     while (snd_card_num < MAX_SND_CARD) {
         adev->mixer = mixer_open(snd_card_num);
@@ -1247,12 +1261,70 @@ void platform_deinit(void *platform)
         my_data->edid_info = NULL;
     }
 
+    platform_reset_mixer_ctl_cache(platform);
+    pthread_mutex_destroy(&my_data->mixer_ctl_cache_lock);
+
     free(platform);
     /* deinit usb */
     audio_extn_usb_deinit();
     audio_extn_dap_hal_deinit();
 }
 
+static unsigned int mixer_ctl_name_hash(const char *name)
+{
+    unsigned int hash = 5381;
+
+    while (*name)
+        hash = (hash << 5) + hash + (unsigned char)*name++;
+    return hash;
+}
+
+struct mixer_ctl *platform_get_mixer_ctl(void *platform, const char *name)
+{
+    struct platform_data *my_data = (struct platform_data *)platform;
+    unsigned int i, slot = mixer_ctl_name_hash(name) % MIXER_CTL_CACHE_SIZE;
+    struct mixer_ctl_cache_entry *entry;
+    struct mixer_ctl *ctl = NULL;
+
+    pthread_mutex_lock(&my_data->mixer_ctl_cache_lock);
+    for (i = 0; i < MIXER_CTL_CACHE_SIZE; i++) {
+        entry = &my_data->mixer_ctl_cache[(slot + i) % MIXER_CTL_CACHE_SIZE];
+        if (entry->name == NULL) {
+            /* misses are not cached, the control may show up after SSR */
+            ctl = mixer_get_ctl_by_name(my_data->adev->mixer, name);
+            if (ctl != NULL) {
+                entry->name = strdup(name);
+                if (entry->name != NULL)
+                    entry->ctl = ctl;
+            }
+            goto done;
+        }
+        if (!strcmp(entry->name, name)) {
+            ctl = entry->ctl;
+            goto done;
+        }
+    }
+    /* cache is full, resolve without caching */
+    ctl = mixer_get_ctl_by_name(my_data->adev->mixer, name);
+done:
+    pthread_mutex_unlock(&my_data->mixer_ctl_cache_lock);
+    return ctl;
+}
+
+void platform_reset_mixer_ctl_cache(void *platform)
+{
+    struct platform_data *my_data = (struct platform_data *)platform;
+    int i;
+
+    pthread_mutex_lock(&my_data->mixer_ctl_cache_lock);
+    for (i = 0; i < MIXER_CTL_CACHE_SIZE; i++) {
+        free(my_data->mixer_ctl_cache[i].name);
+        my_data->mixer_ctl_cache[i].name = NULL;
+        my_data->mixer_ctl_cache[i].ctl = NULL;
+    }
+    pthread_mutex_unlock(&my_data->mixer_ctl_cache_lock);
+}
+
 const char *platform_get_snd_device_name(snd_device_t snd_device)
 {
     if (snd_device >= SND_DEVICE_MIN && snd_device < SND_DEVICE_MAX)
@@ -1666,7 +1738,7 @@ int platform_set_voice_volume(void *platform, int volume)
     vol_index = (int)percent_to_index(volume, MIN_VOL_INDEX, MAX_VOL_INDEX);
     set_values[0] = vol_index;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -1697,7 +1769,7 @@ int platform_set_mic_mute(void *platform, bool state)
                               DEFAULT_MUTE_RAMP_DURATION_MS};
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -1740,7 +1812,7 @@ int platform_set_device_mute(void *platform, bool state, char *dir)
     }
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2236,7 +2308,7 @@ int platform_set_hdmi_channels(void *platform,  int channel_count)
     default:
         channel_cnt_str = "Two"; break;
     }
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2284,7 +2356,7 @@ static int platform_set_slowtalk(struct platform_data *my_data, bool state)
                               ALL_SESSION_VSID};
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2315,7 +2387,7 @@ static int set_hd_voice(struct platform_data *my_data, bool state)
                               ALL_SESSION_VSID};
 
     set_values[0] = state;
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2587,7 +2659,7 @@ int platform_set_incall_recording_session_id(void *platform,
     int num_ctl_values;
     int i;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -2908,6 +2980,21 @@ uint32_t platform_get_compress_offload_buffer_size(audio_offload_info_t* info)
     return fragment_size;
 }
 
+/* false when the size is pinned by audio.offload.buffer.size.kb */
+bool platform_get_compress_offload_fragment_limits(uint32_t *min_size,
+                                                   uint32_t *max_size)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+
+    if ((property_get("audio.offload.buffer.size.kb", value, "")) &&
+            atoi(value))
+        return false;
+
+    *min_size = MIN_COMPRESS_OFFLOAD_FRAGMENT_SIZE;
+    *max_size = MAX_COMPRESS_OFFLOAD_FRAGMENT_SIZE;
+    return true;
+}
+
 uint32_t platform_get_pcm_offload_buffer_size(audio_offload_info_t* info)
 {
     uint32_t fragment_size = MIN_PCM_OFFLOAD_FRAGMENT_SIZE;
@@ -2965,7 +3052,7 @@ int platform_set_codec_backend_cfg(struct audio_device* adev,
     if (bit_width != adev->cur_codec_backend_bit_width) {
         const char * mixer_ctl_name = "SLIM_0_RX Format";
         struct  mixer_ctl *ctl;
-        ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+        ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
         if (!ctl) {
             ALOGE("%s: Could not get ctl for mixer command - %s",
                     __func__, mixer_ctl_name);
@@ -3020,7 +3107,7 @@ int platform_set_codec_backend_cfg(struct audio_device* adev,
                 break;
             }
 
-            ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+            ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
             if(!ctl) {
                 ALOGE("%s: Could not get ctl for mixer command - %s",
                     __func__, mixer_ctl_name);
@@ -3287,7 +3374,7 @@ int platform_get_edid_info(void *platform)
 
     info = my_data->edid_info;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, AUDIO_DATA_BLOCK_MIXER_CTL);
+    ctl = platform_get_mixer_ctl(adev->platform, AUDIO_DATA_BLOCK_MIXER_CTL);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, AUDIO_DATA_BLOCK_MIXER_CTL);
@@ -3335,7 +3422,7 @@ int platform_set_channel_allocation(void *platform, int channel_alloc)
     struct platform_data *my_data = (struct platform_data *)platform;
     struct audio_device *adev = my_data->adev;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -3374,7 +3461,7 @@ int platform_set_channel_map(void *platform, int ch_count, char *ch_map, int snd
 
     ALOGD("%s mixer_ctl_name:%s", __func__, mixer_ctl_name);
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -3537,7 +3624,7 @@ int platform_set_mixer_control(struct stream_out *out, const char * mixer_ctl_na
     struct audio_device *adev = out->dev;
     struct mixer_ctl *ctl = NULL;
     ALOGD("setting mixer ctl %s with value %s", mixer_ctl_name, mixer_val);
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -3644,7 +3731,7 @@ int platform_set_device_params(struct stream_out *out, int param, int value)
     set_values[0] = param;
     set_values[1] = value;
 
-    ctl = mixer_get_ctl_by_name(adev->mixer, mixer_ctl_name);
+    ctl = platform_get_mixer_ctl(adev->platform, mixer_ctl_name);
     if (!ctl) {
         ALOGE("%s: Could not get ctl for mixer cmd - %s",
               __func__, mixer_ctl_name);
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define LOG_TAG "audio_hw_pcm_tap"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <cutils/atomic.h>
+#include <cutils/list.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <system/thread_defs.h>
+
+#include "pcm_tap.h"
+#include "ring_buffer.h"
+
+#define PCM_TAP_DIR              "/data/misc/audio"
+#define PCM_TAP_NAME_MAX         48
+/* a bit over a second of 48kHz stereo 16 bit, drained every 50ms */
+#define PCM_TAP_RING_SIZE        (256 * 1024)
+#define PCM_TAP_DRAIN_US         50000
+
+struct pcm_tap {
+    struct listnode node;
+    char name[PCM_TAP_NAME_MAX];
+    int fd;
+    struct ring_buffer ring;
+    volatile int32_t dropped;   /* bytes, from the producer */
+    uint64_t written;           /* bytes, under tap_lock */
+};
+
+static pthread_mutex_t tap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct listnode tap_list = { &tap_list, &tap_list };
+static bool tap_writer_running;
+
+static bool pcm_tap_enabled(const char *name)
+{
+    char value[PROPERTY_VALUE_MAX] = {0};
+    char *token, *saveptr;
+
+    if (property_get("audio.pcm.tap", value, "") <= 0)
+        return false;
+    if (!strcmp(value, "all"))
+        return true;
+    for (token = strtok_r(value, ",", &saveptr); token != NULL;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (!strcmp(token, name))
+            return true;
+    }
+    return false;
+}
+
+/* must be called with tap_lock locked */
+static void pcm_tap_drain_l(struct pcm_tap *tap)
+{
+    void *ptr;
+    size_t avail;
+    ssize_t ret;
+
+    while ((avail = ring_buffer_read_ptr(&tap->ring, &ptr)) > 0) {
+        ret = write(tap->fd, ptr, avail);
+        if (ret < 0) {
+            ALOGW("%s: %s: write failed %d", __func__, tap->name, errno);
+            android_atomic_add(avail, &tap->dropped);
+        } else {
+            tap->written += ret;
+        }
+        ring_buffer_consume(&tap->ring, avail);
+    }
+}
+
+static void *pcm_tap_writer_loop(void *context __unused)
+{
+    struct listnode *node;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"Audio PCM Tap", 0, 0, 0);
+
+    pthread_mutex_lock(&tap_lock);
+    while (!list_empty(&tap_list)) {
+        list_for_each(node, &tap_list)
+            pcm_tap_drain_l(node_to_item(node, struct pcm_tap, node));
+        pthread_mutex_unlock(&tap_lock);
+        usleep(PCM_TAP_DRAIN_US);
+        pthread_mutex_lock(&tap_lock);
+    }
+    tap_writer_running = false;
+    pthread_mutex_unlock(&tap_lock);
+    return NULL;
+}
+
+struct pcm_tap *pcm_tap_open(const char *name)
+{
+    struct pcm_tap *tap;
+    pthread_attr_t attr;
+    pthread_t thread;
+    char path[128];
+
+    if (!pcm_tap_enabled(name))
+        return NULL;
+
+    tap = (struct pcm_tap *)calloc(1, sizeof(struct pcm_tap));
+    if (tap == NULL)
+        return NULL;
+    strlcpy(tap->name, name, sizeof(tap->name));
+    if (ring_buffer_init(&tap->ring, PCM_TAP_RING_SIZE) != 0) {
+        free(tap);
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/%s.pcm", PCM_TAP_DIR, name);
+    tap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (tap->fd < 0) {
+        ALOGE("%s: cannot open %s: %d", __func__, path, errno);
+        ring_buffer_deinit(&tap->ring);
+        free(tap);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tap_lock);
+    list_add_tail(&tap_list, &tap->node);
+    if (!tap_writer_running) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, pcm_tap_writer_loop, NULL) == 0)
+            tap_writer_running = true;
+        else
+            ALOGE("%s: cannot start the writer thread", __func__);
+        pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&tap_lock);
+
+    ALOGD("%s: %s -> %s", __func__, name, path);
+    return tap;
+}
+
+void pcm_tap_close(struct pcm_tap *tap)
+{
+    if (tap == NULL)
+        return;
+
+    pthread_mutex_lock(&tap_lock);
+    list_remove(&tap->node);
+    pcm_tap_drain_l(tap);
+    pthread_mutex_unlock(&tap_lock);
+
+    ALOGD("%s: %s: %llu bytes written, %d dropped", __func__, tap->name,
+          (unsigned long long)tap->written,
+          android_atomic_acquire_load(&tap->dropped));
+    close(tap->fd);
+    ring_buffer_deinit(&tap->ring);
+    free(tap);
+}
+
+void pcm_tap_write(struct pcm_tap *tap, const void *buf, size_t bytes)
+{
+    size_t copied;
+
+    if (tap == NULL)
+        return;
+    copied = ring_buffer_write(&tap->ring, buf, bytes);
+    if (copied < bytes)
+        android_atomic_add(bytes - copied, &tap->dropped);
+}
+
+void pcm_tap_dump(int fd)
+{
+    struct listnode *node;
+    struct pcm_tap *tap;
+
+    pthread_mutex_lock(&tap_lock);
+    if (!list_empty(&tap_list))
+        dprintf(fd, "\nAudio HAL pcm taps (bytes):\n");
+    list_for_each(node, &tap_list) {
+        tap = node_to_item(node, struct pcm_tap, node);
+        dprintf(fd, "  %s: written %llu dropped %d\n", tap->name,
+                (unsigned long long)tap->written,
+                android_atomic_acquire_load(&tap->dropped));
+    }
+    pthread_mutex_unlock(&tap_lock);
+}
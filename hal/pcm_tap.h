@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PCM_TAP_H
+#define PCM_TAP_H
+
+#include <stddef.h>
+
+/*
+ * Debug taps on the audio data path. A tap copies whatever passes its point
+ * into a ring of its own without ever blocking, and one low priority thread
+ * drains all rings into /data/misc/audio/<name>.pcm in batches. Data that
+ * finds its ring full is counted as dropped rather than stalling the caller.
+ *
+ * audio.pcm.tap selects the taps, either a comma separated list of names or
+ * "all". pcm_tap_open() returns NULL for the others and pcm_tap_write()
+ * takes NULL, so a disabled tap costs a branch.
+ *
+ * Each tap must have a single writer at a time.
+ */
+struct pcm_tap;
+
+struct pcm_tap *pcm_tap_open(const char *name);
+void pcm_tap_close(struct pcm_tap *tap);
+void pcm_tap_write(struct pcm_tap *tap, const void *buf, size_t bytes);
+
+/* bytes written out and dropped, for every open tap */
+void pcm_tap_dump(int fd);
+
+#endif /* PCM_TAP_H */
@@ -25,6 +25,9 @@
 
 void *platform_init(struct audio_device *adev);
 void platform_deinit(void *platform);
+/* cached mixer_get_ctl_by_name(), the cache is dropped on SSR */
+struct mixer_ctl *platform_get_mixer_ctl(void *platform, const char *name);
+void platform_reset_mixer_ctl_cache(void *platform);
 const char *platform_get_snd_device_name(snd_device_t snd_device);
 int platform_get_snd_device_name_extn(void *platform, snd_device_t snd_device,
                                       char *device_name);
@@ -90,6 +93,8 @@ int platform_info_init(const char *filename);
 struct audio_offload_info_t;
 uint32_t platform_get_compress_offload_buffer_size(audio_offload_info_t* info);
 uint32_t platform_get_pcm_offload_buffer_size(audio_offload_info_t* info);
+bool platform_get_compress_offload_fragment_limits(uint32_t *min_size,
+                                                   uint32_t *max_size);
 bool platform_use_small_buffer(audio_offload_info_t* info);
 uint32_t platform_get_compress_passthrough_buffer_size(audio_offload_info_t* info);
 
@@ -31,7 +31,14 @@
 #define LOG_NDDEBUG 0
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <expat.h>
 #include <cutils/log.h>
 #include <audio_hw.h>
@@ -40,6 +47,39 @@
 
 #define BUF_SIZE                    1024
 
+/*
+ * Compiled form of the platform info xml. It holds the attribute lists that
+ * were handed to the section process functions while parsing, so a later
+ * boot can replay them without running expat. The cache is only used when
+ * the hash and size of the source xml match the ones recorded in it.
+ *
+ * layout: header, then num_records records of
+ *   uint8_t section, uint8_t num_attrs, num_attrs NUL terminated strings
+ */
+#define PLATFORM_INFO_CACHE_DIR     "/data/misc/audio/"
+#define PLATFORM_INFO_CACHE_SUFFIX  ".cache"
+#define PLATFORM_INFO_CACHE_MAGIC   0x41504943 /* "APIC" */
+#define PLATFORM_INFO_CACHE_VERSION 1
+#define PLATFORM_INFO_MAX_ATTRS     16
+
+struct platform_info_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint32_t source_size;
+    uint32_t num_records;
+    uint32_t payload_size;
+    uint32_t reserved;
+};
+
+struct platform_info_record_buf {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+    uint32_t num_records;
+    bool failed;
+};
+
 typedef enum {
     ROOT,
     ACDB,
@@ -65,6 +105,7 @@ static section_process_fn section_table[] = {
 };
 
 static section_t section;
+static struct platform_info_record_buf record_buf;
 
 /*
  * <audio_platform_info>
@@ -237,6 +278,52 @@ done:
     return;
 }
 
+static void record_append(const void *data, size_t len)
+{
+    uint8_t *new_data;
+    size_t new_size;
+
+    if (record_buf.failed)
+        return;
+
+    if (record_buf.len + len > record_buf.size) {
+        new_size = record_buf.size ? record_buf.size : BUF_SIZE;
+        while (new_size < record_buf.len + len)
+            new_size <<= 1;
+        new_data = (uint8_t *)realloc(record_buf.data, new_size);
+        if (new_data == NULL) {
+            record_buf.failed = true;
+            return;
+        }
+        record_buf.data = new_data;
+        record_buf.size = new_size;
+    }
+    memcpy(record_buf.data + record_buf.len, data, len);
+    record_buf.len += len;
+}
+
+static void record_section(section_t sec, const XML_Char **attr)
+{
+    uint8_t hdr[2];
+    unsigned int i, num_attrs = 0;
+
+    while (attr[num_attrs] != NULL && num_attrs < PLATFORM_INFO_MAX_ATTRS)
+        num_attrs++;
+
+    hdr[0] = (uint8_t)sec;
+    hdr[1] = (uint8_t)num_attrs;
+    record_append(hdr, sizeof(hdr));
+    for (i = 0; i < num_attrs; i++)
+        record_append(attr[i], strlen(attr[i]) + 1);
+    record_buf.num_records++;
+}
+
+static void process_section(section_t sec, const XML_Char **attr)
+{
+    record_section(sec, attr);
+    section_table[sec](attr);
+}
+
 static void start_tag(void *userdata __unused, const XML_Char *tag_name,
                       const XML_Char **attr)
 {
@@ -259,16 +346,14 @@ static void start_tag(void *userdata __unused, const XML_Char *tag_name,
         }
 
         /* call into process function for the current section */
-        section_process_fn fn = section_table[section];
-        fn(attr);
+        process_section(section, attr);
     } else if (strcmp(tag_name, "usecase") == 0) {
         if (section != PCM_ID) {
             ALOGE("usecase tag only supported with PCM_ID section");
             return;
         }
 
-        section_process_fn fn = section_table[PCM_ID];
-        fn(attr);
+        process_section(PCM_ID, attr);
     }
 
     return;
@@ -287,13 +372,195 @@ static void end_tag(void *userdata __unused, const XML_Char *tag_name)
     }
 }
 
+static uint64_t platform_info_hash(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    /* 64 bit FNV-1a */
+    for (i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void platform_info_cache_path(const char *filename, char *path,
+                                     size_t size)
+{
+    const char *base = strrchr(filename, '/');
+
+    base = base ? base + 1 : filename;
+    snprintf(path, size, "%s%s%s", PLATFORM_INFO_CACHE_DIR, base,
+             PLATFORM_INFO_CACHE_SUFFIX);
+}
+
+/*
+ * Walks the records of a mapped cache, replaying them only when replay is
+ * set. Returns the number of records or -EINVAL if the payload is malformed.
+ */
+static int platform_info_walk_cache(const uint8_t *payload, size_t len,
+                                    bool replay)
+{
+    const XML_Char *attr[PLATFORM_INFO_MAX_ATTRS + 1];
+    size_t pos = 0, str_len;
+    unsigned int i, num_attrs;
+    section_t sec;
+    int count = 0;
+
+    while (pos < len) {
+        if (len - pos < 2)
+            return -EINVAL;
+        sec = (section_t)payload[pos];
+        num_attrs = payload[pos + 1];
+        pos += 2;
+        if ((sec != ACDB && sec != BITWIDTH && sec != PCM_ID &&
+             sec != BACKEND_NAME) || num_attrs > PLATFORM_INFO_MAX_ATTRS)
+            return -EINVAL;
+
+        for (i = 0; i < num_attrs; i++) {
+            str_len = strnlen((const char *)payload + pos, len - pos);
+            if (str_len == len - pos)
+                return -EINVAL;
+            attr[i] = (const XML_Char *)(payload + pos);
+            pos += str_len + 1;
+        }
+        attr[num_attrs] = NULL;
+
+        /* the process functions index attr without checking its length */
+        if (num_attrs < (sec == PCM_ID ? 6 : 4))
+            return -EINVAL;
+
+        if (replay)
+            section_table[sec](attr);
+        count++;
+    }
+    return count;
+}
+
+static int platform_info_load_cache(const char *cache_path, uint64_t hash,
+                                    size_t source_size)
+{
+    struct platform_info_cache_header *hdr;
+    struct stat st;
+    void *map;
+    int fd, ret = -EINVAL;
+
+    fd = open(cache_path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < (off_t)sizeof(struct platform_info_cache_header)) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -errno;
+
+    hdr = (struct platform_info_cache_header *)map;
+    if (hdr->magic != PLATFORM_INFO_CACHE_MAGIC ||
+        hdr->version != PLATFORM_INFO_CACHE_VERSION ||
+        hdr->source_hash != hash ||
+        hdr->source_size != source_size ||
+        hdr->payload_size != st.st_size - sizeof(*hdr)) {
+        ALOGD("%s: %s is stale", __func__, cache_path);
+        goto done;
+    }
+
+    /* validate everything before touching the platform tables */
+    if (platform_info_walk_cache((uint8_t *)(hdr + 1), hdr->payload_size,
+                                 false) != (int)hdr->num_records) {
+        ALOGE("%s: %s is corrupt", __func__, cache_path);
+        goto done;
+    }
+
+    platform_info_walk_cache((uint8_t *)(hdr + 1), hdr->payload_size, true);
+    ALOGD("%s: loaded %u records from %s", __func__, hdr->num_records,
+          cache_path);
+    ret = 0;
+
+done:
+    munmap(map, st.st_size);
+    return ret;
+}
+
+static void platform_info_store_cache(const char *cache_path, uint64_t hash,
+                                      size_t source_size)
+{
+    struct platform_info_cache_header hdr;
+    char tmp_path[PATH_MAX];
+    int fd;
+
+    if (record_buf.failed)
+        return;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PLATFORM_INFO_CACHE_MAGIC;
+    hdr.version = PLATFORM_INFO_CACHE_VERSION;
+    hdr.source_hash = hash;
+    hdr.source_size = source_size;
+    hdr.num_records = record_buf.num_records;
+    hdr.payload_size = record_buf.len;
+
+    /* write to a temporary file first so a reader never sees a partial cache */
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ALOGD("%s: cannot create %s, %s", __func__, tmp_path, strerror(errno));
+        return;
+    }
+
+    if (write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        (record_buf.len > 0 &&
+         write(fd, record_buf.data, record_buf.len) != (ssize_t)record_buf.len) ||
+        fsync(fd) < 0) {
+        ALOGE("%s: failed to write %s", __func__, tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return;
+    }
+    close(fd);
+
+    if (rename(tmp_path, cache_path) < 0) {
+        ALOGE("%s: failed to rename %s, %s", __func__, tmp_path, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+static int platform_info_read_file(FILE *file, uint8_t **data, size_t *len)
+{
+    struct stat st;
+    uint8_t *buf;
+
+    if (fstat(fileno(file), &st) < 0)
+        return -errno;
+
+    buf = (uint8_t *)malloc(st.st_size > 0 ? st.st_size : 1);
+    if (buf == NULL)
+        return -ENOMEM;
+
+    if (fread(buf, 1, st.st_size, file) != (size_t)st.st_size) {
+        free(buf);
+        return -EIO;
+    }
+    *data = buf;
+    *len = st.st_size;
+    return 0;
+}
+
 int platform_info_init(const char *filename)
 {
     XML_Parser      parser;
     FILE            *file;
     int             ret = 0;
-    int             bytes_read;
-    void            *buf;
+    uint8_t         *data = NULL;
+    size_t          len = 0;
+    uint64_t        hash;
+    char            cache_path[PATH_MAX];
 
     file = fopen(filename, "r");
     section = ROOT;
@@ -305,44 +572,42 @@ int platform_info_init(const char *filename)
         goto done;
     }
 
+    ret = platform_info_read_file(file, &data, &len);
+    if (ret < 0) {
+        ALOGE("%s: failed to read %s, %d", __func__, filename, ret);
+        goto err_close_file;
+    }
+
+    hash = platform_info_hash(data, len);
+    platform_info_cache_path(filename, cache_path, sizeof(cache_path));
+    if (platform_info_load_cache(cache_path, hash, len) == 0)
+        goto err_free_data;
+
     parser = XML_ParserCreate(NULL);
     if (!parser) {
         ALOGE("%s: Failed to create XML parser!", __func__);
         ret = -ENODEV;
-        goto err_close_file;
+        goto err_free_data;
     }
 
     XML_SetElementHandler(parser, start_tag, end_tag);
 
-    while (1) {
-        buf = XML_GetBuffer(parser, BUF_SIZE);
-        if (buf == NULL) {
-            ALOGE("%s: XML_GetBuffer failed", __func__);
-            ret = -ENOMEM;
-            goto err_free_parser;
-        }
-
-        bytes_read = fread(buf, 1, BUF_SIZE, file);
-        if (bytes_read < 0) {
-            ALOGE("%s: fread failed, bytes read = %d", __func__, bytes_read);
-             ret = bytes_read;
-            goto err_free_parser;
-        }
-
-        if (XML_ParseBuffer(parser, bytes_read,
-                            bytes_read == 0) == XML_STATUS_ERROR) {
-            ALOGE("%s: XML_ParseBuffer failed, for %s",
-                __func__, filename);
-            ret = -EINVAL;
-            goto err_free_parser;
-        }
-
-        if (bytes_read == 0)
-            break;
+    memset(&record_buf, 0, sizeof(record_buf));
+    if (XML_Parse(parser, (const char *)data, len, 1) == XML_STATUS_ERROR) {
+        ALOGE("%s: XML_Parse failed, for %s",
+            __func__, filename);
+        ret = -EINVAL;
+        goto err_free_parser;
     }
 
+    platform_info_store_cache(cache_path, hash, len);
+
 err_free_parser:
+    free(record_buf.data);
+    memset(&record_buf, 0, sizeof(record_buf));
     XML_ParserFree(parser);
+err_free_data:
+    free(data);
 err_close_file:
     fclose(file);
 done:
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define LOG_TAG "audio_hw_proxy_capture"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <cutils/list.h>
+#include <cutils/log.h>
+#include <cutils/sched_policy.h>
+#include <system/thread_defs.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "proxy_capture.h"
+#include "pcm_tap.h"
+#include "ring_buffer.h"
+
+#define PROXY_CAPTURE_DEVICE        8
+#define PROXY_CAPTURE_PERIOD_COUNT  32
+#define PROXY_CAPTURE_ROUTE         "AFE_PCM_RX Audio Mixer MultiMedia4"
+#define PROXY_CAPTURE_PERIOD_BYTES \
+    (PROXY_CAPTURE_PERIOD_SIZE * PROXY_CAPTURE_CHANNEL_COUNT * sizeof(int16_t))
+/* a quarter of a second per client */
+#define PROXY_CAPTURE_RING_PERIODS  16
+/* the port may be held by another path, or the card not be up yet */
+#define PROXY_CAPTURE_RETRY_MS      500
+#define PROXY_CAPTURE_NAME_MAX      32
+
+struct proxy_capture_client {
+    struct listnode node;
+    char name[PROXY_CAPTURE_NAME_MAX];
+    struct ring_buffer ring;
+    uint64_t dropped;           /* bytes, under capture_lock */
+};
+
+/* Proxy port supports only MMAP read and those fixed parameters */
+static struct pcm_config pcm_config_proxy_capture = {
+    .channels = PROXY_CAPTURE_CHANNEL_COUNT,
+    .rate = PROXY_CAPTURE_SAMPLE_RATE,
+    .period_size = PROXY_CAPTURE_PERIOD_SIZE,
+    .period_count = PROXY_CAPTURE_PERIOD_COUNT,
+    .format = PCM_FORMAT_S16_LE,
+    .start_threshold = PROXY_CAPTURE_PERIOD_SIZE / 4,
+    .stop_threshold = INT_MAX,
+    .avail_min = PROXY_CAPTURE_PERIOD_SIZE / 4,
+};
+
+/* thread_lock must be held when starting or stopping the capture thread.
+ * Locking order: thread_lock -> capture_lock */
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+/* capture_lock protects the client list, the counters and exit_thread */
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+/* broadcast when a period has been fanned out or the thread must exit */
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static struct listnode client_list = { &client_list, &client_list };
+static pthread_t capture_thread;
+static bool capture_thread_running;
+static bool exit_thread;
+static int capture_card;
+static uint64_t capture_periods;
+static uint32_t capture_errors;
+
+static void proxy_capture_deadline(struct timespec *ts, int timeout_ms)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static int proxy_capture_route(struct mixer *mixer, int value)
+{
+    struct mixer_ctl *ctl;
+
+    ctl = mixer_get_ctl_by_name(mixer, PROXY_CAPTURE_ROUTE);
+    if (ctl == NULL) {
+        ALOGW("%s: could not get %s ctl", __func__, PROXY_CAPTURE_ROUTE);
+        return -EINVAL;
+    }
+    if (mixer_ctl_set_value(ctl, 0, value) != 0)
+        ALOGW("%s: error setting value %d on %s ", __func__, value, PROXY_CAPTURE_ROUTE);
+
+    return 0;
+}
+
+static struct pcm *proxy_capture_start(struct mixer *mixer)
+{
+    struct pcm *pcm;
+
+    if (proxy_capture_route(mixer, 1) != 0)
+        return NULL;
+    pcm = pcm_open(capture_card, PROXY_CAPTURE_DEVICE,
+                   PCM_IN | PCM_MMAP | PCM_NOIRQ, &pcm_config_proxy_capture);
+    if (pcm && !pcm_is_ready(pcm)) {
+        ALOGW("%s: %s", __func__, pcm_get_error(pcm));
+        pcm_close(pcm);
+        pcm = NULL;
+    }
+    if (pcm == NULL)
+        proxy_capture_route(mixer, 0);
+    return pcm;
+}
+
+static void proxy_capture_stop(struct mixer *mixer, struct pcm *pcm)
+{
+    pcm_close(pcm);
+    proxy_capture_route(mixer, 0);
+}
+
+static void *proxy_capture_thread_loop(void *context __unused)
+{
+    int16_t data[PROXY_CAPTURE_PERIOD_BYTES / sizeof(int16_t)];
+    struct pcm_tap *tap = pcm_tap_open("proxy_capture");
+    struct mixer *mixer = NULL;
+    struct pcm *pcm = NULL;
+    struct listnode *node;
+    struct timespec ts;
+    int ret;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_AUDIO);
+    set_sched_policy(0, SP_FOREGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"Proxy Capture", 0, 0, 0);
+
+    ALOGD("%s: enter", __func__);
+
+    pthread_mutex_lock(&capture_lock);
+    while (!exit_thread) {
+        if (pcm == NULL) {
+            pthread_mutex_unlock(&capture_lock);
+            if (mixer == NULL)
+                mixer = mixer_open(capture_card);
+            if (mixer != NULL)
+                pcm = proxy_capture_start(mixer);
+            pthread_mutex_lock(&capture_lock);
+            if (pcm == NULL) {
+                if (capture_errors++ == 0)
+                    ALOGW("%s: cannot open proxy %d:%d, retrying", __func__,
+                          capture_card, PROXY_CAPTURE_DEVICE);
+                proxy_capture_deadline(&ts, PROXY_CAPTURE_RETRY_MS);
+                if (!exit_thread)
+                    pthread_cond_timedwait(&capture_cond, &capture_lock, &ts);
+                continue;
+            }
+            ALOGD("%s: capture ENABLED", __func__);
+        }
+
+        pthread_mutex_unlock(&capture_lock);
+        ret = pcm_mmap_read(pcm, data, sizeof(data));
+        if (ret == 0)
+            pcm_tap_write(tap, data, sizeof(data));
+        pthread_mutex_lock(&capture_lock);
+
+        if (ret != 0) {
+            ALOGW("%s: read status %d %s", __func__, ret, pcm_get_error(pcm));
+            capture_errors++;
+            proxy_capture_stop(mixer, pcm);
+            pcm = NULL;
+            continue;
+        }
+
+        capture_periods++;
+        list_for_each(node, &client_list) {
+            struct proxy_capture_client *client =
+                    node_to_item(node, struct proxy_capture_client, node);
+
+            client->dropped += sizeof(data) -
+                    ring_buffer_write(&client->ring, data, sizeof(data));
+        }
+        pthread_cond_broadcast(&capture_cond);
+    }
+    pthread_mutex_unlock(&capture_lock);
+
+    if (pcm != NULL) {
+        proxy_capture_stop(mixer, pcm);
+        ALOGD("%s: capture DISABLED", __func__);
+    }
+    if (mixer != NULL)
+        mixer_close(mixer);
+    pcm_tap_close(tap);
+
+    ALOGD("%s: exit", __func__);
+    return NULL;
+}
+
+void proxy_capture_init(int card)
+{
+    capture_card = card;
+}
+
+struct proxy_capture_client *proxy_capture_open(const char *name)
+{
+    struct proxy_capture_client *client;
+
+    client = (struct proxy_capture_client *)calloc(1, sizeof(struct proxy_capture_client));
+    if (client == NULL)
+        return NULL;
+    strlcpy(client->name, name, sizeof(client->name));
+    if (ring_buffer_init(&client->ring,
+                         PROXY_CAPTURE_PERIOD_BYTES * PROXY_CAPTURE_RING_PERIODS) != 0) {
+        free(client);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&thread_lock);
+    pthread_mutex_lock(&capture_lock);
+    if (!capture_thread_running) {
+        exit_thread = false;
+        if (pthread_create(&capture_thread, (const pthread_attr_t *) NULL,
+                           proxy_capture_thread_loop, NULL) != 0) {
+            ALOGE("%s: cannot start the capture thread", __func__);
+            pthread_mutex_unlock(&capture_lock);
+            pthread_mutex_unlock(&thread_lock);
+            ring_buffer_deinit(&client->ring);
+            free(client);
+            return NULL;
+        }
+        capture_thread_running = true;
+    }
+    list_add_tail(&client_list, &client->node);
+    pthread_mutex_unlock(&capture_lock);
+    pthread_mutex_unlock(&thread_lock);
+
+    ALOGD("%s: %s", __func__, name);
+    return client;
+}
+
+void proxy_capture_close(struct proxy_capture_client *client)
+{
+    if (client == NULL)
+        return;
+
+    pthread_mutex_lock(&thread_lock);
+    pthread_mutex_lock(&capture_lock);
+    list_remove(&client->node);
+    if (list_empty(&client_list) && capture_thread_running) {
+        exit_thread = true;
+        pthread_cond_broadcast(&capture_cond);
+        pthread_mutex_unlock(&capture_lock);
+        pthread_join(capture_thread, (void **) NULL);
+        pthread_mutex_lock(&capture_lock);
+        capture_thread_running = false;
+    }
+    pthread_mutex_unlock(&capture_lock);
+    pthread_mutex_unlock(&thread_lock);
+
+    ALOGD("%s: %s: %llu bytes dropped", __func__, client->name,
+          (unsigned long long)client->dropped);
+    ring_buffer_deinit(&client->ring);
+    free(client);
+}
+
+int proxy_capture_read(struct proxy_capture_client *client, void *buf, size_t bytes,
+                       int timeout_ms)
+{
+    struct timespec ts;
+    int ret = 0;
+
+    if (client == NULL || bytes > client->ring.size)
+        return -EINVAL;
+
+    /* the ring is lock free, capture_lock only serves the wait */
+    if (ring_buffer_avail_read(&client->ring) < bytes) {
+        proxy_capture_deadline(&ts, timeout_ms);
+        pthread_mutex_lock(&capture_lock);
+        while (ring_buffer_avail_read(&client->ring) < bytes && ret == 0)
+            ret = pthread_cond_timedwait(&capture_cond, &capture_lock, &ts);
+        pthread_mutex_unlock(&capture_lock);
+        if (ret != 0 && ring_buffer_avail_read(&client->ring) < bytes)
+            return -ETIMEDOUT;
+    }
+    ring_buffer_read(&client->ring, buf, bytes);
+    return 0;
+}
+
+void proxy_capture_dump(int fd)
+{
+    struct listnode *node;
+
+    pthread_mutex_lock(&capture_lock);
+    if (capture_periods != 0 || capture_errors != 0 || !list_empty(&client_list)) {
+        dprintf(fd, "\nAFE proxy capture: %llu periods, %u errors\n",
+                (unsigned long long)capture_periods, capture_errors);
+        list_for_each(node, &client_list) {
+            struct proxy_capture_client *client =
+                    node_to_item(node, struct proxy_capture_client, node);
+
+            dprintf(fd, "  %s: buffered %zu dropped %llu bytes\n", client->name,
+                    ring_buffer_avail_read(&client->ring),
+                    (unsigned long long)client->dropped);
+        }
+    }
+    pthread_mutex_unlock(&capture_lock);
+}
+
+static const struct proxy_capture_ops capture_ops = {
+    .open = proxy_capture_open,
+    .close = proxy_capture_close,
+    .read = proxy_capture_read,
+};
+
+const struct proxy_capture_ops *proxy_capture_get_ops(void)
+{
+    return &capture_ops;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PROXY_CAPTURE_H
+#define PROXY_CAPTURE_H
+
+#include <stddef.h>
+
+/* the AFE proxy port only runs at this format */
+#define PROXY_CAPTURE_CHANNEL_COUNT 2
+#define PROXY_CAPTURE_SAMPLE_RATE   48000
+#define PROXY_CAPTURE_PERIOD_SIZE   768     /* frames */
+
+/*
+ * One capture of the AFE proxy port shared by every consumer of the mixed
+ * playback (visualizer, analysis, pcm taps). The first client opens the port
+ * and starts a capture thread, the last one stops it. The thread fans each
+ * period out into a ring per client and wakes up the readers, a client that
+ * falls behind loses data rather than stalling the others.
+ *
+ * A client must be read and closed from a single thread.
+ */
+struct proxy_capture_client;
+
+void proxy_capture_init(int card);
+
+struct proxy_capture_client *proxy_capture_open(const char *name);
+void proxy_capture_close(struct proxy_capture_client *client);
+/* waits up to timeout_ms for bytes to be available, returns 0 or -ETIMEDOUT */
+int proxy_capture_read(struct proxy_capture_client *client, void *buf, size_t bytes,
+                       int timeout_ms);
+
+void proxy_capture_dump(int fd);
+
+/* handed to effect libraries, which cannot link against the HAL */
+struct proxy_capture_ops {
+    struct proxy_capture_client *(*open)(const char *name);
+    void (*close)(struct proxy_capture_client *client);
+    int (*read)(struct proxy_capture_client *client, void *buf, size_t bytes,
+                int timeout_ms);
+};
+
+const struct proxy_capture_ops *proxy_capture_get_ops(void);
+
+#endif /* PROXY_CAPTURE_H */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LOG_TAG "audio_hw_ring_buffer"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+
+#include "ring_buffer.h"
+
+int ring_buffer_init(struct ring_buffer *rb, size_t min_size)
+{
+    uint32_t size = 1;
+
+    if (min_size == 0 || min_size > (1U << 30))
+        return -EINVAL;
+
+    while (size < min_size)
+        size <<= 1;
+
+    rb->data = (uint8_t *)calloc(1, size);
+    if (rb->data == NULL) {
+        ALOGE("%s: failed to allocate %u bytes", __func__, size);
+        return -ENOMEM;
+    }
+    rb->size = size;
+    rb->rd = 0;
+    rb->wr = 0;
+
+    ALOGV("%s: size %u", __func__, size);
+    return 0;
+}
+
+void ring_buffer_deinit(struct ring_buffer *rb)
+{
+    free(rb->data);
+    rb->data = NULL;
+    rb->size = 0;
+    rb->rd = 0;
+    rb->wr = 0;
+}
+
+void ring_buffer_reset(struct ring_buffer *rb)
+{
+    android_atomic_release_store(0, &rb->rd);
+    android_atomic_release_store(0, &rb->wr);
+}
+
+size_t ring_buffer_avail_read(struct ring_buffer *rb)
+{
+    uint32_t wr = (uint32_t)android_atomic_acquire_load(&rb->wr);
+    uint32_t rd = (uint32_t)android_atomic_acquire_load(&rb->rd);
+
+    return wr - rd;
+}
+
+size_t ring_buffer_avail_write(struct ring_buffer *rb)
+{
+    return rb->size - ring_buffer_avail_read(rb);
+}
+
+size_t ring_buffer_write(struct ring_buffer *rb, const void *buf, size_t bytes)
+{
+    /* only the producer moves wr, the acquire on rd orders the reuse of
+     * space against the consumer's reads of it */
+    uint32_t wr = (uint32_t)rb->wr;
+    uint32_t rd = (uint32_t)android_atomic_acquire_load(&rb->rd);
+    uint32_t offset = wr & (rb->size - 1);
+    size_t space = rb->size - (wr - rd);
+    size_t first;
+
+    if (bytes > space)
+        bytes = space;
+    if (bytes == 0)
+        return 0;
+
+    first = rb->size - offset;
+    if (first > bytes)
+        first = bytes;
+    memcpy(rb->data + offset, buf, first);
+    if (bytes > first)
+        memcpy(rb->data, (const uint8_t *)buf + first, bytes - first);
+
+    android_atomic_release_store((int32_t)(wr + bytes), &rb->wr);
+    return bytes;
+}
+
+size_t ring_buffer_read_ptr(struct ring_buffer *rb, void **ptr)
+{
+    uint32_t rd = (uint32_t)rb->rd;
+    uint32_t wr = (uint32_t)android_atomic_acquire_load(&rb->wr);
+    uint32_t offset = rd & (rb->size - 1);
+    size_t avail = wr - rd;
+
+    *ptr = rb->data + offset;
+    if (avail > rb->size - offset)
+        avail = rb->size - offset;
+    return avail;
+}
+
+void ring_buffer_consume(struct ring_buffer *rb, size_t bytes)
+{
+    uint32_t rd = (uint32_t)rb->rd;
+
+    android_atomic_release_store((int32_t)(rd + bytes), &rb->rd);
+}
+
+size_t ring_buffer_read(struct ring_buffer *rb, void *buf, size_t bytes)
+{
+    size_t copied = 0;
+
+    while (copied < bytes) {
+        void *src;
+        size_t avail = ring_buffer_read_ptr(rb, &src);
+
+        if (avail == 0)
+            break;
+        if (avail > bytes - copied)
+            avail = bytes - copied;
+        memcpy((uint8_t *)buf + copied, src, avail);
+        ring_buffer_consume(rb, avail);
+        copied += avail;
+    }
+    return copied;
+}
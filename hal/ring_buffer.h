@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Single producer / single consumer byte ring.
+ *
+ * The producer only advances wr and the consumer only advances rd, so no
+ * lock is needed on the data path as long as there is exactly one thread
+ * on each side. Both indices are free running and wrap at 2^32; size is
+ * always a power of two so that (wr - rd) is the fill level.
+ * ring_buffer_reset() is only safe while both sides are quiesced.
+ */
+struct ring_buffer {
+    uint8_t *data;
+    uint32_t size;
+    volatile int32_t rd;
+    volatile int32_t wr;
+};
+
+int ring_buffer_init(struct ring_buffer *rb, size_t min_size);
+void ring_buffer_deinit(struct ring_buffer *rb);
+void ring_buffer_reset(struct ring_buffer *rb);
+
+size_t ring_buffer_avail_read(struct ring_buffer *rb);
+size_t ring_buffer_avail_write(struct ring_buffer *rb);
+
+/* producer side, returns the number of bytes copied */
+size_t ring_buffer_write(struct ring_buffer *rb, const void *buf, size_t bytes);
+
+/* consumer side */
+size_t ring_buffer_read(struct ring_buffer *rb, void *buf, size_t bytes);
+size_t ring_buffer_read_ptr(struct ring_buffer *rb, void **ptr);
+void ring_buffer_consume(struct ring_buffer *rb, size_t bytes);
+
+#endif /* RING_BUFFER_H */
@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks and times the SSR engine.
+ *
+ *   audio-ssr-engine-test
+ *       compares the engine with a direct time domain convolution of the
+ *       same filters, for filters of 513 and of 1024 taps
+ *   audio-ssr-engine-test -b seconds
+ *       times the engine on that much 48 kHz audio
+ *   audio-ssr-engine-test -g [-f] [-d filter_dir] [-l lag]
+ *                         in_4ch.raw out_6ch.raw
+ *       runs the device filters over a 4 channel capture and correlates the
+ *       result with the 6 channel output libsurround_proc made of it, as
+ *       dumped by the ssr_4ch and ssr_6ch pcm taps. The filters are band
+ *       limited the way audio_extn/ssr.c sets up the library, -f leaves
+ *       them full band. Each reference channel, LFE included, should match
+ *       the engine output in the same slot with a correlation of at least
+ *       GOLDEN_MIN_CORRELATION, which confirms both the channel map and
+ *       the band limits. lag is how many frames later the engine output
+ *       is than the reference.
+ *
+ * Exits non zero when a check fails.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ssr_engine.h"
+
+#define TEST_RATE               48000
+#define TEST_HOPS               24
+#define TEST_FRAMES             (SSR_ENGINE_HOP * TEST_HOPS)
+#define TEST_AMPLITUDE          8000
+#define TEST_MAX_ERROR          2
+#define GOLDEN_MIN_CORRELATION  0.99
+#define BENCH_CHUNK_FRAMES      1024
+#define DEFAULT_FILTER_DIR      "/system/etc/surround_sound"
+
+/* AAC/DTS order, as in audio_extn/ssr.c */
+static const int default_chan_map[SSR_ENGINE_OUTPUTS] = { 1, 2, 4, 3, 0, 5 };
+
+/* what libsurround_proc is set up with, as in audio_extn/ssr.c */
+static const struct ssr_engine_bands lib_bands = {
+    .sub_woofer = 0,
+    .low_freq = 4,
+    .high_freq = 100,
+    .lfe_output = 5,
+};
+
+static uint32_t rand_state = 1;
+
+static double test_rand(void)
+{
+    rand_state = rand_state * 1664525 + 1013904223;
+    return (double)(rand_state >> 8) / (double)(1 << 24) * 2.0 - 1.0;
+}
+
+struct test_filters {
+    int16_t *re[SSR_ENGINE_INPUTS];
+    int16_t *im[SSR_ENGINE_INPUTS];
+};
+
+static int filters_alloc(struct test_filters *f)
+{
+    int i;
+
+    memset(f, 0, sizeof(*f));
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        f->re[i] = (int16_t *)calloc(SSR_ENGINE_COEFF_SIZE, sizeof(int16_t));
+        f->im[i] = (int16_t *)calloc(SSR_ENGINE_COEFF_SIZE, sizeof(int16_t));
+        if (f->re[i] == NULL || f->im[i] == NULL)
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+static void filters_free(struct test_filters *f)
+{
+    int i;
+
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        free(f->re[i]);
+        free(f->im[i]);
+    }
+}
+
+/* Q15 spectrum of taps[0..SSR_ENGINE_TAPS), as the filter files hold it */
+static void taps_to_bins(const double *taps, int16_t *re, int16_t *im)
+{
+    int k, n;
+
+    for (k = 0; k < SSR_ENGINE_BINS; k++) {
+        double sr = 0, si = 0;
+
+        for (n = 0; n < SSR_ENGINE_TAPS; n++) {
+            double a = -2.0 * M_PI * k * n / SSR_ENGINE_TAPS;
+
+            sr += taps[n] * cos(a);
+            si += taps[n] * sin(a);
+        }
+        re[k] = (int16_t)lrint(sr * 32767.0);
+        im[k] = (int16_t)lrint(si * 32767.0);
+    }
+}
+
+/* the taps a Q15 spectrum stands for, how the engine reads the files */
+static void bins_to_taps(const int16_t *re, const int16_t *im, double *taps)
+{
+    int k, n;
+
+    for (n = 0; n < SSR_ENGINE_TAPS; n++) {
+        double sum = re[0] + re[SSR_ENGINE_BINS - 1] * ((n & 1) ? -1.0 : 1.0);
+
+        for (k = 1; k < SSR_ENGINE_BINS - 1; k++) {
+            double a = 2.0 * M_PI * k * n / SSR_ENGINE_TAPS;
+
+            sum += 2.0 * (re[k] * cos(a) - im[k] * sin(a));
+        }
+        taps[n] = sum / (32768.0 * SSR_ENGINE_TAPS);
+    }
+}
+
+/* decaying noise over the first length taps, sum of magnitudes 1/4 */
+static void make_filters(struct test_filters *f, int length)
+{
+    double taps[SSR_ENGINE_TAPS];
+    int i, o, n;
+
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+            double norm = 0;
+
+            memset(taps, 0, sizeof(taps));
+            for (n = 0; n < length; n++) {
+                taps[n] = test_rand() * exp(-2.0 * n / length);
+                norm += fabs(taps[n]);
+            }
+            for (n = 0; n < length; n++)
+                taps[n] *= 0.25 / norm;
+            taps_to_bins(taps, f->re[i] + o * SSR_ENGINE_BINS,
+                         f->im[i] + o * SSR_ENGINE_BINS);
+        }
+    }
+}
+
+static int16_t clamp16(double v)
+{
+    if (v >= 32767.0)
+        return 32767;
+    if (v <= -32768.0)
+        return -32768;
+    return (int16_t)lrint(v);
+}
+
+/* the engine against a direct convolution, output lagging by one hop */
+static int test_equivalence(int length, const int chan_map[SSR_ENGINE_OUTPUTS],
+                            const struct ssr_engine_bands *bands)
+{
+    struct test_filters f;
+    struct ssr_engine *engine;
+    int16_t *in, *out;
+    double *taps;
+    int i, o, n, t, max_error = 0, ret = -1;
+
+    in = (int16_t *)malloc(TEST_FRAMES * SSR_ENGINE_INPUTS * sizeof(int16_t));
+    out = (int16_t *)malloc(TEST_FRAMES * SSR_ENGINE_OUTPUTS * sizeof(int16_t));
+    taps = (double *)malloc(SSR_ENGINE_INPUTS * SSR_ENGINE_OUTPUTS *
+                            SSR_ENGINE_TAPS * sizeof(double));
+    if (in == NULL || out == NULL || taps == NULL || filters_alloc(&f) != 0) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+
+    make_filters(&f, length);
+    if (bands != NULL && ssr_engine_limit_bands(f.re, f.im, bands) != 0) {
+        fprintf(stderr, "ssr_engine_limit_bands failed\n");
+        goto done;
+    }
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++)
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++)
+            bins_to_taps(f.re[i] + o * SSR_ENGINE_BINS,
+                         f.im[i] + o * SSR_ENGINE_BINS,
+                         taps + (i * SSR_ENGINE_OUTPUTS + o) * SSR_ENGINE_TAPS);
+    for (n = 0; n < TEST_FRAMES * SSR_ENGINE_INPUTS; n++)
+        in[n] = (int16_t)lrint(test_rand() * TEST_AMPLITUDE);
+
+    engine = ssr_engine_create(f.re, f.im, chan_map);
+    if (engine == NULL) {
+        fprintf(stderr, "ssr_engine_create failed\n");
+        goto done;
+    }
+    /* odd sized calls, the engine buffers to its hop */
+    for (n = 0; n < TEST_FRAMES; n += 300) {
+        int count = TEST_FRAMES - n < 300 ? TEST_FRAMES - n : 300;
+
+        ssr_engine_process(engine, in + n * SSR_ENGINE_INPUTS,
+                           out + n * SSR_ENGINE_OUTPUTS, count);
+    }
+    ssr_engine_destroy(engine);
+
+    for (n = 0; n + SSR_ENGINE_HOP < TEST_FRAMES; n++) {
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+            double sum = 0;
+            int error;
+
+            for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+                const double *h = taps + (i * SSR_ENGINE_OUTPUTS + o) *
+                                         SSR_ENGINE_TAPS;
+
+                for (t = 0; t < SSR_ENGINE_TAPS && t <= n; t++)
+                    sum += h[t] * in[(n - t) * SSR_ENGINE_INPUTS + i];
+            }
+            error = abs(out[(n + SSR_ENGINE_HOP) * SSR_ENGINE_OUTPUTS +
+                            chan_map[o]] - clamp16(sum));
+            if (error > max_error)
+                max_error = error;
+        }
+    }
+
+    printf("%-4d tap filters%s: max error %d lsb %s\n", length,
+           bands != NULL ? ", band limited" : "", max_error,
+           max_error <= TEST_MAX_ERROR ? "ok" : "FAILED");
+    ret = max_error <= TEST_MAX_ERROR ? 0 : -1;
+
+done:
+    filters_free(&f);
+    free(taps);
+    free(out);
+    free(in);
+    return ret;
+}
+
+/* what the band limits leave of random filters */
+static int test_limit_bands(void)
+{
+    struct test_filters f, orig;
+    int i, o, k, bad = 0, ret = -1;
+
+    memset(&orig, 0, sizeof(orig));
+    if (filters_alloc(&f) != 0 || filters_alloc(&orig) != 0) {
+        fprintf(stderr, "out of memory\n");
+        goto done;
+    }
+    make_filters(&f, SSR_ENGINE_TAPS);
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        memcpy(orig.re[i], f.re[i], SSR_ENGINE_COEFF_SIZE * sizeof(int16_t));
+        memcpy(orig.im[i], f.im[i], SSR_ENGINE_COEFF_SIZE * sizeof(int16_t));
+    }
+    if (ssr_engine_limit_bands(f.re, f.im, &lib_bands) != 0)
+        goto done;
+
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        int16_t pass = i == lib_bands.sub_woofer ? 32767 : 0;
+
+        for (o = 0; o < SSR_ENGINE_OUTPUTS; o++) {
+            const int16_t *re = f.re[i] + o * SSR_ENGINE_BINS;
+            const int16_t *im = f.im[i] + o * SSR_ENGINE_BINS;
+            const int16_t *ore = orig.re[i] + o * SSR_ENGINE_BINS;
+            const int16_t *oim = orig.im[i] + o * SSR_ENGINE_BINS;
+
+            for (k = 0; k < SSR_ENGINE_BINS; k++) {
+                int16_t want_re, want_im = 0;
+
+                if (o == lib_bands.lfe_output) {
+                    want_re = k < lib_bands.low_freq ? pass : 0;
+                } else if (k < lib_bands.high_freq) {
+                    want_re = ore[k];
+                    want_im = oim[k];
+                } else {
+                    want_re = pass;
+                }
+                if (re[k] != want_re || im[k] != want_im)
+                    bad++;
+            }
+        }
+    }
+    /* and bands out of range are refused */
+    {
+        struct ssr_engine_bands b = lib_bands;
+
+        b.high_freq = SSR_ENGINE_BINS + 1;
+        if (ssr_engine_limit_bands(f.re, f.im, &b) != -EINVAL)
+            bad++;
+        b = lib_bands;
+        b.sub_woofer = SSR_ENGINE_INPUTS;
+        if (ssr_engine_limit_bands(f.re, f.im, &b) != -EINVAL)
+            bad++;
+    }
+    printf("band limits: %d bad bins %s\n", bad, bad == 0 ? "ok" : "FAILED");
+    ret = bad == 0 ? 0 : -1;
+
+done:
+    filters_free(&orig);
+    filters_free(&f);
+    return ret;
+}
+
+static int run_tests(void)
+{
+    static const int shuffled_map[SSR_ENGINE_OUTPUTS] = { 5, 3, 0, 1, 4, 2 };
+    int failed = 0;
+
+    printf("ssr engine, %s kernels\n", ssr_engine_kernels());
+    failed |= test_equivalence(SSR_ENGINE_HOP + 1, default_chan_map, NULL);
+    failed |= test_equivalence(SSR_ENGINE_TAPS, default_chan_map, NULL);
+    failed |= test_equivalence(SSR_ENGINE_TAPS, shuffled_map, NULL);
+    failed |= test_limit_bands();
+    failed |= test_equivalence(SSR_ENGINE_TAPS, default_chan_map, &lib_bands);
+    return failed ? 1 : 0;
+}
+
+static int run_benchmark(double seconds)
+{
+    struct test_filters f;
+    struct ssr_engine *engine;
+    int16_t in[BENCH_CHUNK_FRAMES * SSR_ENGINE_INPUTS];
+    int16_t out[BENCH_CHUNK_FRAMES * SSR_ENGINE_OUTPUTS];
+    struct timespec start, end;
+    long chunks = (long)(seconds * TEST_RATE / BENCH_CHUNK_FRAMES), c;
+    double elapsed;
+    int n;
+
+    if (filters_alloc(&f) != 0) {
+        filters_free(&f);
+        return 1;
+    }
+    make_filters(&f, SSR_ENGINE_TAPS);
+    engine = ssr_engine_create(f.re, f.im, default_chan_map);
+    filters_free(&f);
+    if (engine == NULL)
+        return 1;
+    for (n = 0; n < BENCH_CHUNK_FRAMES * SSR_ENGINE_INPUTS; n++)
+        in[n] = (int16_t)lrint(test_rand() * TEST_AMPLITUDE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (c = 0; c < chunks; c++)
+        ssr_engine_process(engine, in, out, BENCH_CHUNK_FRAMES);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ssr_engine_destroy(engine);
+
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s kernels: %.2f s of audio in %.3f s, %.1fx realtime\n",
+           ssr_engine_kernels(), seconds, elapsed,
+           elapsed > 0 ? seconds / elapsed : 0.0);
+    return 0;
+}
+
+static int16_t *read_raw(const char *path, int channels, size_t *frames)
+{
+    FILE *fp = fopen(path, "rb");
+    int16_t *data;
+    long size;
+
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    *frames = size / (channels * sizeof(int16_t));
+    data = (int16_t *)malloc(*frames * channels * sizeof(int16_t) + 1);
+    if (data != NULL &&
+        fread(data, channels * sizeof(int16_t), *frames, fp) != *frames) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+static int read_filters(const char *dir, struct test_filters *f)
+{
+    char path[256];
+    FILE *fp;
+    int i, part;
+
+    for (i = 0; i < SSR_ENGINE_INPUTS; i++) {
+        for (part = 0; part < 2; part++) {
+            snprintf(path, sizeof(path), "%s/filter%d%c.pcm", dir, i + 1,
+                     part ? 'i' : 'r');
+            fp = fopen(path, "rb");
+            if (fp == NULL ||
+                fread(part ? f->im[i] : f->re[i], sizeof(int16_t),
+                      SSR_ENGINE_COEFF_SIZE, fp) != SSR_ENGINE_COEFF_SIZE) {
+                fprintf(stderr, "cannot read %s\n", path);
+                if (fp != NULL)
+                    fclose(fp);
+                return -EINVAL;
+            }
+            fclose(fp);
+        }
+    }
+    return 0;
+}
+
+/* correlates every reference slot with every engine slot */
+static int run_golden(const char *in_path, const char *ref_path,
+                      const char *dir, long lag, bool full_band)
+{
+    struct test_filters f;
+    struct ssr_engine *engine = NULL;
+    int16_t *in = NULL, *ref = NULL, *out = NULL;
+    size_t in_frames, ref_frames, frames, n;
+    int g, e, best, ret = 1;
+
+    in = read_raw(in_path, SSR_ENGINE_INPUTS, &in_frames);
+    ref = read_raw(ref_path, SSR_ENGINE_OUTPUTS, &ref_frames);
+    if (filters_alloc(&f) != 0 || in == NULL || ref == NULL ||
+        read_filters(dir, &f) != 0)
+        goto done;
+    if (!full_band && ssr_engine_limit_bands(f.re, f.im, &lib_bands) != 0)
+        goto done;
+    frames = in_frames < ref_frames ? in_frames : ref_frames;
+    if ((long)frames <= labs(lag)) {
+        fprintf(stderr, "captures shorter than the lag\n");
+        goto done;
+    }
+
+    out = (int16_t *)malloc(frames * SSR_ENGINE_OUTPUTS * sizeof(int16_t));
+    engine = ssr_engine_create(f.re, f.im, default_chan_map);
+    if (out == NULL || engine == NULL)
+        goto done;
+    ssr_engine_process(engine, in, out, frames);
+
+    printf("%zu frames, %s filters, correlation of reference (rows) and "
+           "engine (columns)\n", frames,
+           full_band ? "full band" : "band limited");
+    ret = 0;
+    for (g = 0; g < SSR_ENGINE_OUTPUTS; g++) {
+        double corr[SSR_ENGINE_OUTPUTS];
+
+        for (e = 0; e < SSR_ENGINE_OUTPUTS; e++) {
+            double srr = 0, see = 0, sre = 0;
+
+            for (n = 0; n < frames; n++) {
+                long m = (long)n + lag;
+                double r, x;
+
+                if (m < 0 || m >= (long)frames)
+                    continue;
+                r = ref[n * SSR_ENGINE_OUTPUTS + g];
+                x = out[m * SSR_ENGINE_OUTPUTS + e];
+                srr += r * r;
+                see += x * x;
+                sre += r * x;
+            }
+            corr[e] = (srr > 0 && see > 0) ? sre / sqrt(srr * see) : 0.0;
+        }
+        best = 0;
+        printf("  %d:", g);
+        for (e = 0; e < SSR_ENGINE_OUTPUTS; e++) {
+            printf(" %6.3f", corr[e]);
+            if (corr[e] > corr[best])
+                best = e;
+        }
+        if (best != g) {
+            printf("  best %d MISMATCH\n", best);
+            ret = 1;
+        } else if (corr[g] < GOLDEN_MIN_CORRELATION) {
+            printf("  best %d LOW\n", best);
+            ret = 1;
+        } else {
+            printf("  best %d ok\n", best);
+        }
+    }
+
+done:
+    ssr_engine_destroy(engine);
+    filters_free(&f);
+    free(out);
+    free(ref);
+    free(in);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = DEFAULT_FILTER_DIR;
+    bool golden = false, full_band = false;
+    long lag = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:gfd:l:")) != -1) {
+        switch (opt) {
+        case 'b':
+            return run_benchmark(atof(optarg));
+        case 'd':
+            dir = optarg;
+            break;
+        case 'l':
+            lag = atol(optarg);
+            break;
+        case 'g':
+            golden = true;
+            break;
+        case 'f':
+            full_band = true;
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (golden && optind + 2 == argc)
+        return run_golden(argv[optind], argv[optind + 1], dir, lag,
+                          full_band);
+    if (!golden && optind == argc)
+        return run_tests();
+
+usage:
+    fprintf(stderr, "usage: %s [-b seconds] [-g [-f] [-d filter_dir] "
+            "[-l lag] in_4ch.raw out_6ch.raw]\n", argv[0]);
+    return 2;
+}
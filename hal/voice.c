@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <cutils/log.h>
 #include <cutils/str_parms.h>
 
@@ -105,7 +106,7 @@ int voice_stop_usecase(struct audio_device *adev, audio_usecase_t usecase_id)
     disable_snd_device(adev, uc_info->out_snd_device);
     disable_snd_device(adev, uc_info->in_snd_device);
 
-    list_remove(&uc_info->list);
+    remove_usecase_from_list(adev, uc_info);
     free(uc_info);
 
     ALOGD("%s: exit: status(%d)", __func__, ret);
@@ -142,7 +143,7 @@ int voice_start_usecase(struct audio_device *adev, audio_usecase_t usecase_id)
     uc_info->in_snd_device = SND_DEVICE_NONE;
     uc_info->out_snd_device = SND_DEVICE_NONE;
 
-    list_add_tail(&adev->usecase_list, &uc_info->list);
+    add_usecase_to_list(adev, uc_info);
 
     select_devices(adev, usecase_id);
 
@@ -383,6 +384,7 @@ bool voice_get_mic_mute(struct audio_device *adev)
     return adev->voice.mic_mute;
 }
 
+/* must be called with adev->lock locked */
 int voice_set_volume(struct audio_device *adev, float volume)
 {
     int vol, err = 0;
@@ -402,11 +404,15 @@ int voice_set_volume(struct audio_device *adev, float volume)
         // So adjust the volume to get the correct volume index in driver
         vol = 100 - vol;
 
+        pthread_mutex_lock(&adev->mixer_lock);
         err = platform_set_voice_volume(adev->platform, vol);
+        pthread_mutex_unlock(&adev->mixer_lock);
     }
-    if (adev->mode == AUDIO_MODE_IN_COMMUNICATION)
+    if (adev->mode == AUDIO_MODE_IN_COMMUNICATION) {
+        pthread_mutex_lock(&adev->mixer_lock);
         err = voice_extn_compress_voip_set_volume(adev, volume);
-
+        pthread_mutex_unlock(&adev->mixer_lock);
+    }
 
     return err;
 }
@@ -318,7 +318,7 @@ static int voip_stop_call(struct audio_device *adev)
         disable_snd_device(adev, uc_info->out_snd_device);
         disable_snd_device(adev, uc_info->in_snd_device);
 
-        list_remove(&uc_info->list);
+        remove_usecase_from_list(adev, uc_info);
         free(uc_info);
     } else
         ALOGV("%s: NO-OP because out_stream_count=%d, in_stream_count=%d",
@@ -356,7 +356,7 @@ static int voip_start_call(struct audio_device *adev,
         uc_info->in_snd_device = SND_DEVICE_NONE;
         uc_info->out_snd_device = SND_DEVICE_NONE;
 
-        list_add_tail(&adev->usecase_list, &uc_info->list);
+        add_usecase_to_list(adev, uc_info);
 
         select_devices(adev, USECASE_COMPRESS_VOIP_CALL);
 
@@ -409,7 +409,9 @@ static int voip_start_call(struct audio_device *adev,
         pcm_start(voip_data.pcm_rx);
         pcm_start(voip_data.pcm_tx);
 
+        pthread_mutex_lock(&adev->mixer_lock);
         voice_extn_compress_voip_set_volume(adev, adev->voice.volume);
+        pthread_mutex_unlock(&adev->mixer_lock);
 
         if (ret < 0) {
             ALOGE("%s: error %d\n", __func__, ret);
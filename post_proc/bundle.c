@@ -257,6 +257,8 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output, int pcm_id
             goto exit;
         }
     }
+    /* effects starting together share commits to the DSP */
+    offload_effects_txn_open(out_ctxt->ctl);
 
     list_init(&out_ctxt->effects_list);
 
@@ -298,6 +300,7 @@ int offload_effects_bundle_hal_stop_output(audio_io_handle_t output, int pcm_id)
         goto exit;
     }
 
+    offload_effects_txn_close(out_ctxt->ctl);
     if (out_ctxt->mixer)
         mixer_close(out_ctxt->mixer);
 
@@ -54,7 +54,14 @@
 #define ALOGVV(a...) do { } while(0)
 #endif
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <cutils/list.h>
 #include <cutils/log.h>
 #include <tinyalsa/asoundlib.h>
 #include <sound/audio_effects.h>
@@ -67,6 +74,42 @@
 
 #define ARRAY_SIZE(array) (sizeof array / sizeof array[0])
 
+#define OFFLOAD_PARAM_VALUES_MAX    128
+/* module, device and number of commands lead each array */
+#define OFFLOAD_PARAM_HEADER_LEN    3
+/* param id, config, offset and payload length lead each command */
+#define OFFLOAD_COMMAND_HEADER_LEN  4
+/* bass boost, virtualizer, equalizer and reverb */
+#define OFFLOAD_TXN_MODULES_MAX     4
+
+/* commands for one module, laid out as they are sent to the driver */
+struct offload_module_batch {
+    bool used;
+    int len;
+    int values[OFFLOAD_PARAM_VALUES_MAX];
+};
+
+struct offload_effects_txn {
+    struct listnode node;
+    struct mixer_ctl *ctl;
+    pthread_mutex_t lock;
+    /* signaled when a commit is deferred or the thread must exit */
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool exit;
+    bool pending;
+    uint64_t last_commit_us;
+    /* pending commands */
+    struct offload_module_batch batch[OFFLOAD_TXN_MODULES_MAX];
+    /* last command committed for each param, what the DSP holds */
+    struct offload_module_batch shadow[OFFLOAD_TXN_MODULES_MAX];
+};
+
+/* txn_list_lock must be held when walking or modifying txn_list.
+ * Locking order: txn_list_lock -> txn->lock */
+static pthread_mutex_t txn_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct listnode txn_list = { &txn_list, &txn_list };
+
 #define OFFLOAD_PRESET_START_OFFSET_FOR_OPENSL 19
 const int map_eq_opensl_preset_2_offload_preset[] = {
     OFFLOAD_PRESET_START_OFFSET_FOR_OPENSL,   /* Normal Preset */
@@ -124,6 +167,327 @@ void offload_close_mixer(struct mixer *mixer)
     mixer_close(mixer);
 }
 
+static uint64_t offload_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void offload_batch_init(struct offload_module_batch *batch,
+                               int module, int device)
+{
+    batch->values[0] = module;
+    batch->values[1] = device;
+    batch->values[2] = 0; /* num of commands*/
+    batch->len = OFFLOAD_PARAM_HEADER_LEN;
+    batch->used = true;
+}
+
+static int *offload_batch_find(struct offload_module_batch *batch, int param_id)
+{
+    int *cmd = batch->values + OFFLOAD_PARAM_HEADER_LEN;
+    int *end = batch->values + batch->len;
+
+    while (cmd < end) {
+        if (cmd[0] == param_id)
+            return cmd;
+        cmd += OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+    }
+    return NULL;
+}
+
+static void offload_batch_remove(struct offload_module_batch *batch, int param_id)
+{
+    int *cmd = offload_batch_find(batch, param_id);
+    int *end = batch->values + batch->len;
+    int cmd_len;
+
+    if (cmd == NULL)
+        return;
+    cmd_len = OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+    memmove(cmd, cmd + cmd_len, (end - cmd - cmd_len) * sizeof(int));
+    batch->len -= cmd_len;
+    batch->values[2] -= 1;
+}
+
+/* false if cmd does not fit */
+static bool offload_batch_append(struct offload_module_batch *batch, const int *cmd)
+{
+    int cmd_len = OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+
+    if (batch->len + cmd_len > OFFLOAD_PARAM_VALUES_MAX)
+        return false;
+    memcpy(batch->values + batch->len, cmd, cmd_len * sizeof(int));
+    batch->len += cmd_len;
+    batch->values[2] += 1;
+    return true;
+}
+
+/* must be called with txn->lock held */
+static struct offload_module_batch *offload_txn_shadow_l(struct offload_effects_txn *txn,
+                                                         int module, int device)
+{
+    struct offload_module_batch *shadow = NULL;
+    int i;
+
+    for (i = 0; i < OFFLOAD_TXN_MODULES_MAX; i++) {
+        if (txn->shadow[i].used && txn->shadow[i].values[0] == module) {
+            shadow = &txn->shadow[i];
+            break;
+        }
+        if (!txn->shadow[i].used && shadow == NULL)
+            shadow = &txn->shadow[i];
+    }
+    if (shadow == NULL)
+        shadow = &txn->shadow[0];
+    /* nothing is known of the module on another device */
+    if (!shadow->used || shadow->values[0] != module || shadow->values[1] != device)
+        offload_batch_init(shadow, module, device);
+    return shadow;
+}
+
+/* must be called with txn->lock held */
+static void offload_batch_commit_l(struct offload_effects_txn *txn,
+                                   struct offload_module_batch *batch)
+{
+    struct offload_module_batch *shadow;
+    int *cmd, *prev;
+    int cmd_len;
+
+    shadow = offload_txn_shadow_l(txn, batch->values[0], batch->values[1]);
+
+    /* only send what differs from the last committed value */
+    cmd = batch->values + OFFLOAD_PARAM_HEADER_LEN;
+    while (cmd < batch->values + batch->len) {
+        cmd_len = OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+        prev = offload_batch_find(shadow, cmd[0]);
+        if (prev != NULL && !memcmp(prev, cmd, cmd_len * sizeof(int)))
+            offload_batch_remove(batch, cmd[0]);
+        else
+            cmd += cmd_len;
+    }
+    batch->used = false;
+    if (batch->values[2] == 0)
+        return;
+
+    ALOGV("%s: module 0x%x, %d commands, %d values", __func__, batch->values[0],
+          batch->values[2], batch->len);
+    /* the control is zero filled past what is used */
+    if (mixer_ctl_set_array(txn->ctl, batch->values, batch->len) != 0) {
+        /* what the DSP holds is unknown, resend everything next time */
+        ALOGE("%s: module 0x%x, failed to set params", __func__, batch->values[0]);
+        offload_batch_init(shadow, batch->values[0], batch->values[1]);
+        return;
+    }
+
+    cmd = batch->values + OFFLOAD_PARAM_HEADER_LEN;
+    while (cmd < batch->values + batch->len) {
+        offload_batch_remove(shadow, cmd[0]);
+        if (!offload_batch_append(shadow, cmd)) {
+            offload_batch_init(shadow, batch->values[0], batch->values[1]);
+            offload_batch_append(shadow, cmd);
+        }
+        cmd += OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+    }
+}
+
+/* must be called with txn->lock held */
+static void offload_txn_commit_l(struct offload_effects_txn *txn)
+{
+    int i;
+
+    for (i = 0; i < OFFLOAD_TXN_MODULES_MAX; i++) {
+        if (txn->batch[i].used)
+            offload_batch_commit_l(txn, &txn->batch[i]);
+    }
+    txn->pending = false;
+    txn->last_commit_us = offload_now_us();
+}
+
+/* must be called with txn->lock held */
+static void offload_txn_merge_l(struct offload_effects_txn *txn,
+                                const int *values)
+{
+    struct offload_module_batch *batch = NULL;
+    const int *cmd = values + OFFLOAD_PARAM_HEADER_LEN;
+    int i;
+
+    for (i = 0; i < OFFLOAD_TXN_MODULES_MAX; i++) {
+        if (txn->batch[i].used && txn->batch[i].values[0] == values[0]) {
+            batch = &txn->batch[i];
+            break;
+        }
+        if (!txn->batch[i].used && batch == NULL)
+            batch = &txn->batch[i];
+    }
+    if (batch == NULL) {
+        offload_txn_commit_l(txn);
+        batch = &txn->batch[0];
+    }
+    /* the device applies to the whole array */
+    if (batch->used && batch->values[1] != values[1])
+        offload_batch_commit_l(txn, batch);
+    if (!batch->used)
+        offload_batch_init(batch, values[0], values[1]);
+
+    /* a new value supersedes the pending one */
+    for (i = 0; i < values[2]; i++) {
+        offload_batch_remove(batch, cmd[0]);
+        if (!offload_batch_append(batch, cmd)) {
+            offload_batch_commit_l(txn, batch);
+            offload_batch_init(batch, values[0], values[1]);
+            offload_batch_append(batch, cmd);
+        }
+        cmd += OFFLOAD_COMMAND_HEADER_LEN + cmd[3];
+    }
+}
+
+/* returns the transaction open on ctl with its lock held, or NULL */
+static struct offload_effects_txn *offload_effects_txn_get(struct mixer_ctl *ctl)
+{
+    struct offload_effects_txn *txn;
+    struct listnode *node;
+
+    pthread_mutex_lock(&txn_list_lock);
+    list_for_each(node, &txn_list) {
+        txn = node_to_item(node, struct offload_effects_txn, node);
+        if (txn->ctl == ctl) {
+            pthread_mutex_lock(&txn->lock);
+            pthread_mutex_unlock(&txn_list_lock);
+            return txn;
+        }
+    }
+    pthread_mutex_unlock(&txn_list_lock);
+    return NULL;
+}
+
+static void offload_send_param_values(struct mixer_ctl *ctl, int *values)
+{
+    struct offload_effects_txn *txn;
+
+    if (!values[2] || !ctl)
+        return;
+
+    txn = offload_effects_txn_get(ctl);
+    if (txn == NULL) {
+        mixer_ctl_set_array(ctl, values, OFFLOAD_PARAM_VALUES_MAX);
+        return;
+    }
+    offload_txn_merge_l(txn, values);
+    if (offload_now_us() - txn->last_commit_us >=
+            OFFLOAD_EFFECTS_COMMIT_PERIOD_MS * 1000) {
+        offload_txn_commit_l(txn);
+    } else if (!txn->pending) {
+        txn->pending = true;
+        pthread_cond_signal(&txn->cond);
+    }
+    pthread_mutex_unlock(&txn->lock);
+}
+
+static void *offload_txn_thread_loop(void *context)
+{
+    struct offload_effects_txn *txn = (struct offload_effects_txn *)context;
+    struct timespec ts;
+    uint64_t now, due;
+
+    prctl(PR_SET_NAME, (unsigned long)"Offload Effects", 0, 0, 0);
+
+    pthread_mutex_lock(&txn->lock);
+    while (!txn->exit) {
+        if (!txn->pending) {
+            pthread_cond_wait(&txn->cond, &txn->lock);
+            continue;
+        }
+        now = offload_now_us();
+        due = txn->last_commit_us + OFFLOAD_EFFECTS_COMMIT_PERIOD_MS * 1000;
+        if (now < due) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += (due - now) * 1000;
+            while (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&txn->cond, &txn->lock, &ts);
+            continue;
+        }
+        offload_txn_commit_l(txn);
+    }
+    pthread_mutex_unlock(&txn->lock);
+    return NULL;
+}
+
+int offload_effects_txn_open(struct mixer_ctl *ctl)
+{
+    struct offload_effects_txn *txn;
+
+    if (!ctl)
+        return -EINVAL;
+
+    txn = offload_effects_txn_get(ctl);
+    if (txn != NULL) {
+        pthread_mutex_unlock(&txn->lock);
+        return 0;
+    }
+
+    txn = (struct offload_effects_txn *)calloc(1, sizeof(*txn));
+    if (!txn) {
+        ALOGE("%s: fail to allocate transaction", __func__);
+        return -ENOMEM;
+    }
+    txn->ctl = ctl;
+    pthread_mutex_init(&txn->lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&txn->cond, (const pthread_condattr_t *) NULL);
+    if (pthread_create(&txn->thread, (const pthread_attr_t *) NULL,
+                       offload_txn_thread_loop, txn) != 0) {
+        ALOGE("%s: fail to create commit thread", __func__);
+        pthread_cond_destroy(&txn->cond);
+        pthread_mutex_destroy(&txn->lock);
+        free(txn);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&txn_list_lock);
+    list_add_tail(&txn_list, &txn->node);
+    pthread_mutex_unlock(&txn_list_lock);
+
+    ALOGV("%s: ctl %p", __func__, ctl);
+    return 0;
+}
+
+void offload_effects_txn_close(struct mixer_ctl *ctl)
+{
+    struct offload_effects_txn *txn = NULL;
+    struct listnode *node;
+
+    pthread_mutex_lock(&txn_list_lock);
+    list_for_each(node, &txn_list) {
+        if (node_to_item(node, struct offload_effects_txn, node)->ctl == ctl) {
+            txn = node_to_item(node, struct offload_effects_txn, node);
+            list_remove(&txn->node);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&txn_list_lock);
+    if (txn == NULL)
+        return;
+
+    /* a sender that found it before has the lock until done */
+    pthread_mutex_lock(&txn->lock);
+    if (txn->pending)
+        offload_txn_commit_l(txn);
+    txn->exit = true;
+    pthread_cond_signal(&txn->cond);
+    pthread_mutex_unlock(&txn->lock);
+    pthread_join(txn->thread, (void **) NULL);
+
+    ALOGV("%s: ctl %p", __func__, ctl);
+    pthread_cond_destroy(&txn->cond);
+    pthread_mutex_destroy(&txn->lock);
+    free(txn);
+}
+
 void offload_bassboost_set_device(struct bass_boost_params *bassboost,
                                   uint32_t device)
 {
@@ -202,8 +566,7 @@ int offload_bassboost_send_params(struct mixer_ctl *ctl,
         param_values[2] += 1;
     }
 
-    if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+    offload_send_param_values(ctl, param_values);
 
     return 0;
 }
@@ -301,8 +664,7 @@ int offload_virtualizer_send_params(struct mixer_ctl *ctl,
         param_values[2] += 1;
     }
 
-    if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+    offload_send_param_values(ctl, param_values);
 
     return 0;
 }
@@ -410,8 +772,7 @@ int offload_eq_send_params(struct mixer_ctl *ctl, struct eq_params eq,
         param_values[2] += 1;
     }
 
-    if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+    offload_send_param_values(ctl, param_values);
 
     return 0;
 }
@@ -658,8 +1019,7 @@ int offload_reverb_send_params(struct mixer_ctl *ctl,
         param_values[2] += 1;
     }
 
-    if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+    offload_send_param_values(ctl, param_values);
 
     return 0;
 }
@@ -35,6 +35,21 @@ int offload_update_mixer_and_effects_ctl(int card, int device_id,
                                          struct mixer_ctl *ctl);
 void offload_close_mixer(struct mixer *mixer);
 
+/*
+ * Batches what the send_params calls below write to ctl. Commands are merged
+ * per module, a new value of a parameter replacing the pending one, and each
+ * dirty module goes out in one mixer_ctl_set_array per commit. A commit is
+ * sent right away when the previous one is at least
+ * OFFLOAD_EFFECTS_COMMIT_PERIOD_MS old, otherwise once that period is over.
+ * Commands identical to the last committed ones for their param are dropped
+ * and the array is cut after the last command.
+ * Params sent on a ctl without a transaction are written immediately.
+ */
+#define OFFLOAD_EFFECTS_COMMIT_PERIOD_MS        20
+int offload_effects_txn_open(struct mixer_ctl *ctl);
+/* commits whatever is pending, ctl must still be valid */
+void offload_effects_txn_close(struct mixer_ctl *ctl);
+
 #define OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG      (1 << 0)
 #define OFFLOAD_SEND_BASSBOOST_STRENGTH         \
                                           (OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG << 1)
@@ -17,20 +17,40 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
-	offload_visualizer.c
+	offload_visualizer.c \
+	visualizer_kernels.c
 
 LOCAL_CFLAGS+= -O2 -fvisibility=hidden
 
 LOCAL_SHARED_LIBRARIES := \
 	libcutils \
-	liblog \
-	libtinyalsa
+	liblog
 
 LOCAL_MODULE_RELATIVE_PATH := soundfx
 LOCAL_MODULE:= libqcomvisualizer
 
 LOCAL_C_INCLUDES := \
-	external/tinyalsa/include \
+	$(LOCAL_PATH)/../hal \
 	$(call include-path-for, audio-effects)
 
 include $(BUILD_SHARED_LIBRARY)
+
+# ---------------------------------------------------------------------------------
+#             Make the apps-test (visualizer-kernels-test)
+# ---------------------------------------------------------------------------------
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	test/visualizer_kernels_test.c \
+	visualizer_kernels.c
+
+LOCAL_CFLAGS+= -O2
+
+LOCAL_MODULE:= visualizer-kernels-test
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)
+
+include $(BUILD_EXECUTABLE)
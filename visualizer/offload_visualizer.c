@@ -18,17 +18,21 @@
 /*#define LOG_NDEBUG 0*/
 #include <assert.h>
 #include <math.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/prctl.h>
 
+#include <cutils/atomic.h>
 #include <cutils/list.h>
 #include <cutils/log.h>
 #include <system/thread_defs.h>
-#include <tinyalsa/asoundlib.h>
 #include <audio_effects/effect_visualizer.h>
 
+#include "proxy_capture.h"
+#include "visualizer_kernels.h"
+
 
 enum {
     EFFECT_STATE_UNINITIALIZED,
@@ -86,6 +90,9 @@ typedef struct output_context_s {
 
 #define DISCARD_MEASUREMENTS_TIME_MS 2000 /* discard measurements older than this number of ms */
 
+/* attempts at a consistent capture snapshot, the last one is made with lock held */
+#define CAPTURE_READ_RETRY_MAX 4
+
 /* maximum number of buffers for which we keep track of the measurements */
 #define MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS 25 /* note: buffer index is stored in uint8_t */
 
@@ -95,14 +102,19 @@ typedef struct buffer_stats_s {
     float rms_squared; /* the average square of the samples in a buffer */
 } buffer_stats_t;
 
+/* The capture state below capture_seq is only written with lock held (capture thread,
+ * reset) and is read without it by VISUALIZER_CMD_CAPTURE and VISUALIZER_CMD_MEASURE.
+ * capture_seq is odd while an update is in progress: readers copy what they need and
+ * start over if the sequence was odd or moved meanwhile, until the last attempt which
+ * keeps the writers out. */
 typedef struct visualizer_context_s {
     effect_context_t common;
 
-    uint32_t capture_idx;
     uint32_t capture_size;
     uint32_t scaling_mode;
-    uint32_t last_capture_idx;
     uint32_t latency;
+    volatile int32_t capture_seq;
+    uint32_t capture_idx;
     struct timespec buffer_update_time;
     uint8_t capture_buf[CAPTURE_BUF_SIZE];
     /* for measurements */
@@ -159,34 +171,15 @@ pthread_cond_t cond;
 bool exit_thread;
 /* 0 if the capture thread was created successfully */
 int thread_status;
+/* AFE proxy capture shared with the other consumers in the audio HAL, set by
+ * visualizer_hal_set_proxy_capture() */
+const struct proxy_capture_ops *proxy_capture;
 
 
 #define DSP_OUTPUT_LATENCY_MS 0 /* Fudge factor for latency after capture point in audio DSP */
 
-/* Retry for delay for mixer open */
-#define RETRY_NUMBER 10
-#define RETRY_US 500000
-
-#define MIXER_CARD 0
-#define SOUND_CARD 0
-#define CAPTURE_DEVICE 8
-
-/* Proxy port supports only MMAP read and those fixed parameters*/
-#define AUDIO_CAPTURE_CHANNEL_COUNT 2
-#define AUDIO_CAPTURE_SMP_RATE 48000
-#define AUDIO_CAPTURE_PERIOD_SIZE (768)
-#define AUDIO_CAPTURE_PERIOD_COUNT 32
-
-struct pcm_config pcm_config_capture = {
-    .channels = AUDIO_CAPTURE_CHANNEL_COUNT,
-    .rate = AUDIO_CAPTURE_SMP_RATE,
-    .period_size = AUDIO_CAPTURE_PERIOD_SIZE,
-    .period_count = AUDIO_CAPTURE_PERIOD_COUNT,
-    .format = PCM_FORMAT_S16_LE,
-    .start_threshold = AUDIO_CAPTURE_PERIOD_SIZE / 4,
-    .stop_threshold = INT_MAX,
-    .avail_min = AUDIO_CAPTURE_PERIOD_SIZE / 4,
-};
+/* bounds how long the capture thread waits for the proxy before reevaluating its state */
+#define CAPTURE_READ_TIMEOUT_MS 100
 
 
 /*
@@ -290,33 +283,14 @@ bool effects_enabled() {
     return false;
 }
 
-int configure_proxy_capture(struct mixer *mixer, int value) {
-    const char *proxy_ctl_name = "AFE_PCM_RX Audio Mixer MultiMedia4";
-    struct mixer_ctl *ctl;
-
-    ctl = mixer_get_ctl_by_name(mixer, proxy_ctl_name);
-    if (ctl == NULL) {
-        ALOGW("%s: could not get %s ctl", __func__, proxy_ctl_name);
-        return -EINVAL;
-    }
-    if (mixer_ctl_set_value(ctl, 0, value) != 0)
-        ALOGW("%s: error setting value %d on %s ", __func__, value, proxy_ctl_name);
-
-    return 0;
-}
-
-
 void *capture_thread_loop(void *arg)
 {
-    int16_t data[AUDIO_CAPTURE_PERIOD_SIZE * AUDIO_CAPTURE_CHANNEL_COUNT * sizeof(int16_t)];
+    int16_t data[PROXY_CAPTURE_PERIOD_SIZE * PROXY_CAPTURE_CHANNEL_COUNT];
     audio_buffer_t buf;
-    buf.frameCount = AUDIO_CAPTURE_PERIOD_SIZE;
+    buf.frameCount = PROXY_CAPTURE_PERIOD_SIZE;
     buf.s16 = data;
-    bool capture_enabled = false;
-    struct mixer *mixer;
-    struct pcm *pcm = NULL;
+    struct proxy_capture_client *client = NULL;
     int ret;
-    int retry_num = 0;
 
     ALOGD("thread enter");
 
@@ -324,13 +298,8 @@ void *capture_thread_loop(void *arg)
 
     pthread_mutex_lock(&lock);
 
-    mixer = mixer_open(MIXER_CARD);
-    while (mixer == NULL && retry_num < RETRY_NUMBER) {
-        usleep(RETRY_US);
-        mixer = mixer_open(MIXER_CARD);
-        retry_num++;
-    }
-    if (mixer == NULL) {
+    if (proxy_capture == NULL) {
+        ALOGW("%s: no proxy capture from the audio HAL", __func__);
         pthread_mutex_unlock(&lock);
         return NULL;
     }
@@ -340,37 +309,26 @@ void *capture_thread_loop(void *arg)
             break;
         }
         if (effects_enabled()) {
-            if (!capture_enabled) {
-                ret = configure_proxy_capture(mixer, 1);
-                if (ret == 0) {
-                    pcm = pcm_open(SOUND_CARD, CAPTURE_DEVICE,
-                                   PCM_IN|PCM_MMAP|PCM_NOIRQ, &pcm_config_capture);
-                    if (pcm && !pcm_is_ready(pcm)) {
-                        ALOGW("%s: %s", __func__, pcm_get_error(pcm));
-                        pcm_close(pcm);
-                        pcm = NULL;
-                        configure_proxy_capture(mixer, 0);
-                    } else {
-                        capture_enabled = true;
-                        ALOGD("%s: capture ENABLED", __func__);
-                    }
-                }
+            if (client == NULL) {
+                client = proxy_capture->open("visualizer");
+                if (client != NULL)
+                    ALOGD("%s: capture ENABLED", __func__);
+                else
+                    pthread_cond_wait(&cond, &lock);
             }
         } else {
-            if (capture_enabled) {
-                if (pcm != NULL)
-                    pcm_close(pcm);
-                configure_proxy_capture(mixer, 0);
+            if (client != NULL) {
+                proxy_capture->close(client);
+                client = NULL;
                 ALOGD("%s: capture DISABLED", __func__);
-                capture_enabled = false;
             }
             pthread_cond_wait(&cond, &lock);
         }
-        if (!capture_enabled)
+        if (client == NULL)
             continue;
 
         pthread_mutex_unlock(&lock);
-        ret = pcm_mmap_read(pcm, data, sizeof(data));
+        ret = proxy_capture->read(client, data, sizeof(data), CAPTURE_READ_TIMEOUT_MS);
         pthread_mutex_lock(&lock);
 
         if (ret == 0) {
@@ -390,17 +348,13 @@ void *capture_thread_loop(void *arg)
                         fx_ctxt->ops.process(fx_ctxt, &buf, &buf);
                 }
             }
-        } else {
-            ALOGW("%s: read status %d %s", __func__, ret, pcm_get_error(pcm));
+        } else if (ret != -ETIMEDOUT) {
+            ALOGW("%s: read status %d", __func__, ret);
         }
     }
 
-    if (capture_enabled) {
-        if (pcm != NULL)
-            pcm_close(pcm);
-        configure_proxy_capture(mixer, 0);
-    }
-    mixer_close(mixer);
+    if (client != NULL)
+        proxy_capture->close(client);
     pthread_mutex_unlock(&lock);
 
     ALOGD("thread exit");
@@ -412,6 +366,16 @@ void *capture_thread_loop(void *arg)
  * Interface from audio HAL
  */
 
+__attribute__ ((visibility ("default")))
+void visualizer_hal_set_proxy_capture(const struct proxy_capture_ops *ops) {
+    if (lib_init() != 0)
+        return;
+
+    pthread_mutex_lock(&lock);
+    proxy_capture = ops;
+    pthread_mutex_unlock(&lock);
+}
+
 __attribute__ ((visibility ("default")))
 int visualizer_hal_start_output(audio_io_handle_t output, int pcm_id) {
     int ret;
@@ -546,13 +510,13 @@ void get_config(effect_context_t *context, effect_config_t *config)
  * Visualizer operations
  */
 
-uint32_t visualizer_get_delta_time_ms_from_updated_time(visualizer_context_t* visu_ctxt) {
+uint32_t visualizer_get_delta_time_ms_from_updated_time(const struct timespec *update_time) {
     uint32_t delta_ms = 0;
-    if (visu_ctxt->buffer_update_time.tv_sec != 0) {
+    if (update_time->tv_sec != 0) {
         struct timespec ts;
         if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
-            time_t secs = ts.tv_sec - visu_ctxt->buffer_update_time.tv_sec;
-            long nsec = ts.tv_nsec - visu_ctxt->buffer_update_time.tv_nsec;
+            time_t secs = ts.tv_sec - update_time->tv_sec;
+            long nsec = ts.tv_nsec - update_time->tv_nsec;
             if (nsec < 0) {
                 --secs;
                 nsec += 1000000000;
@@ -563,15 +527,52 @@ uint32_t visualizer_get_delta_time_ms_from_updated_time(visualizer_context_t* vi
     return delta_ms;
 }
 
+/* must be called with lock held */
+static void capture_write_begin(visualizer_context_t *visu_ctxt)
+{
+    android_atomic_inc(&visu_ctxt->capture_seq);
+}
+
+/* must be called with lock held */
+static void capture_write_end(visualizer_context_t *visu_ctxt)
+{
+    android_atomic_inc(&visu_ctxt->capture_seq);
+}
+
+/* attempt counts from 0, the last one locks out the writers until capture_read_retry() */
+static int32_t capture_read_begin(visualizer_context_t *visu_ctxt, int attempt)
+{
+    if (attempt == CAPTURE_READ_RETRY_MAX - 1) {
+        ALOGV("%s taking lock after %d attempts", __func__, attempt);
+        pthread_mutex_lock(&lock);
+    }
+    return android_atomic_acquire_load(&visu_ctxt->capture_seq);
+}
+
+/* true if what was read since capture_read_begin() may be torn, attempt counts from 1 */
+static bool capture_read_retry(visualizer_context_t *visu_ctxt, int32_t seq, int attempt)
+{
+    if (attempt == CAPTURE_READ_RETRY_MAX) {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+    android_memory_barrier();
+    if (!(seq & 1) && visu_ctxt->capture_seq == seq)
+        return false;
+    sched_yield();
+    return true;
+}
+
 int visualizer_reset(effect_context_t *context)
 {
     visualizer_context_t * visu_ctxt = (visualizer_context_t *)context;
 
+    capture_write_begin(visu_ctxt);
     visu_ctxt->capture_idx = 0;
-    visu_ctxt->last_capture_idx = 0;
     visu_ctxt->buffer_update_time.tv_sec = 0;
     visu_ctxt->latency = DSP_OUTPUT_LATENCY_MS;
     memset(visu_ctxt->capture_buf, 0x80, CAPTURE_BUF_SIZE);
+    capture_write_end(visu_ctxt);
     return 0;
 }
 
@@ -605,12 +606,14 @@ int visualizer_init(effect_context_t *context)
     visu_ctxt->channel_count = popcount(context->config.inputCfg.channels);
     visu_ctxt->meas_mode = MEASUREMENT_MODE_NONE;
     visu_ctxt->meas_wndw_size_in_buffers = MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS;
+    capture_write_begin(visu_ctxt);
     visu_ctxt->meas_buffer_idx = 0;
     for (i=0 ; i<visu_ctxt->meas_wndw_size_in_buffers ; i++) {
         visu_ctxt->past_meas[i].is_valid = false;
         visu_ctxt->past_meas[i].peak_u16 = 0;
         visu_ctxt->past_meas[i].rms_squared = 0;
     }
+    capture_write_end(visu_ctxt);
 
     set_config(context, &context->config);
 
@@ -700,28 +703,24 @@ int visualizer_process(effect_context_t *context,
         return -EINVAL;
     }
 
-    // perform measurements if needed
-    if (visu_ctxt->meas_mode & MEASUREMENT_MODE_PEAK_RMS) {
-        // find the peak and RMS squared for the new buffer
-        uint32_t inIdx;
-        int16_t max_sample = 0;
-        float rms_squared_acc = 0;
-        for (inIdx = 0 ; inIdx < inBuffer->frameCount * visu_ctxt->channel_count ; inIdx++) {
-            if (inBuffer->s16[inIdx] > max_sample) {
-                max_sample = inBuffer->s16[inIdx];
-            } else if (-inBuffer->s16[inIdx] > max_sample) {
-                max_sample = -inBuffer->s16[inIdx];
-            }
-            rms_squared_acc += (inBuffer->s16[inIdx] * inBuffer->s16[inIdx]);
-        }
-        // store the measurement
-        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].peak_u16 = (uint16_t)max_sample;
-        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].rms_squared =
-                rms_squared_acc / (inBuffer->frameCount * visu_ctxt->channel_count);
-        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].is_valid = true;
-        if (++visu_ctxt->meas_buffer_idx >= visu_ctxt->meas_wndw_size_in_buffers) {
-            visu_ctxt->meas_buffer_idx = 0;
-        }
+    /* one pass gathers the measurements and the normalized scaling, the
+     * latter always looks at stereo samples */
+    visualizer_scan_t scan;
+    uint32_t meas_count = inBuffer->frameCount * visu_ctxt->channel_count;
+    bool normalized = visu_ctxt->scaling_mode == VISUALIZER_SCALING_MODE_NORMALIZED;
+    bool measure = visu_ctxt->meas_mode & MEASUREMENT_MODE_PEAK_RMS;
+
+    if (normalized || measure)
+        visualizer_scan(inBuffer->s16,
+                        measure ? meas_count : inBuffer->frameCount * 2, &scan);
+
+    // perform measurements if needed, they are stored along with the capture below
+    uint16_t meas_peak_u16 = 0;
+    float meas_rms_squared = 0;
+    if (measure) {
+        // peak saturates at 16 bits like it is reported
+        meas_peak_u16 = scan.peak > 32767 ? 32767 : (uint16_t)scan.peak;
+        meas_rms_squared = (float)scan.sum_squares / meas_count;
     }
 
     /* all code below assumes stereo 16 bit PCM output and input */
@@ -730,15 +729,11 @@ int visualizer_process(effect_context_t *context,
     if (visu_ctxt->scaling_mode == VISUALIZER_SCALING_MODE_NORMALIZED) {
         /* derive capture scaling factor from peak value in current buffer
          * this gives more interesting captures for display. */
-        shift = 32;
-        int len = inBuffer->frameCount * 2;
-        int i;
-        for (i = 0; i < len; i++) {
-            int32_t smp = inBuffer->s16[i];
-            if (smp < 0) smp = -smp - 1; /* take care to keep the max negative in range */
-            int32_t clz = __builtin_clz(smp);
-            if (shift > clz) shift = clz;
-        }
+        if (measure && meas_count != inBuffer->frameCount * 2)
+            visualizer_scan(inBuffer->s16, inBuffer->frameCount * 2, &scan);
+        /* the smallest leading zero count is the one of all samples or'ed,
+         * negatives were taken as -x - 1 to keep the max negative in range */
+        shift = scan.mag_bits ? __builtin_clz(scan.mag_bits) : 32;
         /* A maximum amplitude signal will have 17 leading zeros, which we want to
          * translate to a shift of 8 (for converting 16 bit to 8 bit) */
         shift = 25 - shift;
@@ -754,29 +749,54 @@ int visualizer_process(effect_context_t *context,
         shift = 9;
     }
 
-    uint32_t capt_idx;
-    uint32_t in_idx;
+    capture_write_begin(visu_ctxt);
+
+    if (measure) {
+        /* measurements from before playback paused would bias the new ones */
+        if (visualizer_get_delta_time_ms_from_updated_time(&visu_ctxt->buffer_update_time) >
+                DISCARD_MEASUREMENTS_TIME_MS) {
+            uint32_t i;
+            ALOGV("Discarding measurements older than %dms", DISCARD_MEASUREMENTS_TIME_MS);
+            for (i=0 ; i<visu_ctxt->meas_wndw_size_in_buffers ; i++) {
+                visu_ctxt->past_meas[i].is_valid = false;
+                visu_ctxt->past_meas[i].peak_u16 = 0;
+                visu_ctxt->past_meas[i].rms_squared = 0;
+            }
+            visu_ctxt->meas_buffer_idx = 0;
+        }
+        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].peak_u16 = meas_peak_u16;
+        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].rms_squared = meas_rms_squared;
+        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].is_valid = true;
+        if (++visu_ctxt->meas_buffer_idx >= visu_ctxt->meas_wndw_size_in_buffers) {
+            visu_ctxt->meas_buffer_idx = 0;
+        }
+    }
+
+    uint32_t capt_idx = visu_ctxt->capture_idx;
+    uint32_t in_idx = 0;
     uint8_t *buf = visu_ctxt->capture_buf;
-    for (in_idx = 0, capt_idx = visu_ctxt->capture_idx;
-         in_idx < inBuffer->frameCount;
-         in_idx++, capt_idx++) {
+    while (in_idx < inBuffer->frameCount) {
+        uint32_t count = inBuffer->frameCount - in_idx;
+
         if (capt_idx >= CAPTURE_BUF_SIZE) {
             /* wrap around */
             capt_idx = 0;
         }
-        int32_t smp = inBuffer->s16[2 * in_idx] + inBuffer->s16[2 * in_idx + 1];
-        smp = smp >> shift;
-        buf[capt_idx] = ((uint8_t)smp)^0x80;
+        if (count > CAPTURE_BUF_SIZE - capt_idx)
+            count = CAPTURE_BUF_SIZE - capt_idx;
+        visualizer_downmix(inBuffer->s16 + 2 * in_idx, buf + capt_idx, count, shift);
+        in_idx += count;
+        capt_idx += count;
     }
 
-    /* XXX the following two should really be atomic, though it probably doesn't
-     * matter much for visualization purposes */
     visu_ctxt->capture_idx = capt_idx;
     /* update last buffer update time stamp */
     if (clock_gettime(CLOCK_MONOTONIC, &visu_ctxt->buffer_update_time) < 0) {
         visu_ctxt->buffer_update_time.tv_sec = 0;
     }
 
+    capture_write_end(visu_ctxt);
+
     if (context->state != EFFECT_STATE_ACTIVE) {
         ALOGV("%s DONE inactive", __func__);
         return -ENODATA;
@@ -791,10 +811,12 @@ int visualizer_command(effect_context_t * context, uint32_t cmdCode, uint32_t cm
     visualizer_context_t * visu_ctxt = (visualizer_context_t *)context;
 
     switch (cmdCode) {
-    case VISUALIZER_CMD_CAPTURE:
-        if (pReplyData == NULL || *replySize != visu_ctxt->capture_size) {
+    case VISUALIZER_CMD_CAPTURE: {
+        const uint32_t capture_size = visu_ctxt->capture_size;
+
+        if (pReplyData == NULL || *replySize != capture_size) {
             ALOGV("%s VISUALIZER_CMD_CAPTURE error *replySize %d context->capture_size %d",
-                  __func__, *replySize, visu_ctxt->capture_size);
+                  __func__, *replySize, capture_size);
             return -EINVAL;
         }
 
@@ -802,80 +824,98 @@ int visualizer_command(effect_context_t * context, uint32_t cmdCode, uint32_t cm
             break;
 
         if (context->state == EFFECT_STATE_ACTIVE) {
-            int32_t latency_ms = visu_ctxt->latency;
-            const uint32_t delta_ms = visualizer_get_delta_time_ms_from_updated_time(visu_ctxt);
-            latency_ms -= delta_ms;
-            if (latency_ms < 0) {
-                latency_ms = 0;
-            }
-            const uint32_t delta_smp = context->config.inputCfg.samplingRate * latency_ms / 1000;
-
-            int32_t capture_point = visu_ctxt->capture_idx - visu_ctxt->capture_size - delta_smp;
-            int32_t capture_size = visu_ctxt->capture_size;
-            if (capture_point < 0) {
-                int32_t size = -capture_point;
-                if (size > capture_size)
-                    size = capture_size;
-
-                memcpy(pReplyData,
-                       visu_ctxt->capture_buf + CAPTURE_BUF_SIZE + capture_point,
-                       size);
-                pReplyData = (void *)((size_t)pReplyData + size);
-                capture_size -= size;
-                capture_point = 0;
-            }
-            memcpy(pReplyData,
-                   visu_ctxt->capture_buf + capture_point,
-                   capture_size);
-
+            struct timespec update_time;
+            uint32_t delta_ms;
+            int32_t seq;
+            int attempt = 0;
+
+            do {
+                uint8_t *reply = (uint8_t *)pReplyData;
+
+                seq = capture_read_begin(visu_ctxt, attempt);
+                update_time = visu_ctxt->buffer_update_time;
+
+                int32_t latency_ms = visu_ctxt->latency;
+                delta_ms = visualizer_get_delta_time_ms_from_updated_time(&update_time);
+                latency_ms -= delta_ms;
+                if (latency_ms < 0) {
+                    latency_ms = 0;
+                }
+                const uint32_t delta_smp =
+                        context->config.inputCfg.samplingRate * latency_ms / 1000;
+
+                int32_t capture_point = visu_ctxt->capture_idx - capture_size - delta_smp;
+                int32_t size_left = capture_size;
+                if (capture_point < 0) {
+                    int32_t size = -capture_point;
+                    if (size > size_left)
+                        size = size_left;
+
+                    memcpy(reply,
+                           visu_ctxt->capture_buf + CAPTURE_BUF_SIZE + capture_point,
+                           size);
+                    reply += size;
+                    size_left -= size;
+                    capture_point = 0;
+                }
+                memcpy(reply,
+                       visu_ctxt->capture_buf + capture_point,
+                       size_left);
+            } while (capture_read_retry(visu_ctxt, seq, ++attempt));
 
             /* if audio framework has stopped playing audio although the effect is still
-             * active we must clear the capture buffer to return silence */
-            if ((visu_ctxt->last_capture_idx == visu_ctxt->capture_idx) &&
-                    (visu_ctxt->buffer_update_time.tv_sec != 0)) {
-                if (delta_ms > MAX_STALL_TIME_MS) {
-                    ALOGV("%s capture going to idle", __func__);
-                    visu_ctxt->buffer_update_time.tv_sec = 0;
-                    memset(pReplyData, 0x80, visu_ctxt->capture_size);
-                }
+             * active we must return silence */
+            if (update_time.tv_sec != 0 && delta_ms > MAX_STALL_TIME_MS) {
+                ALOGV("%s capture idle", __func__);
+                memset(pReplyData, 0x80, capture_size);
             }
-            visu_ctxt->last_capture_idx = visu_ctxt->capture_idx;
         } else {
-            memset(pReplyData, 0x80, visu_ctxt->capture_size);
+            memset(pReplyData, 0x80, capture_size);
         }
-        break;
+        } break;
 
     case VISUALIZER_CMD_MEASURE: {
-        uint16_t peak_u16 = 0;
-        float sum_rms_squared = 0.0f;
-        uint8_t nb_valid_meas = 0;
-        /* reset measurements if last measurement was too long ago (which implies stored
-         * measurements aren't relevant anymore and shouldn't bias the new one) */
-        const int32_t delay_ms = visualizer_get_delta_time_ms_from_updated_time(visu_ctxt);
-        if (delay_ms > DISCARD_MEASUREMENTS_TIME_MS) {
-            uint32_t i;
-            ALOGV("Discarding measurements, last measurement is %dms old", delay_ms);
-            for (i=0 ; i<visu_ctxt->meas_wndw_size_in_buffers ; i++) {
-                visu_ctxt->past_meas[i].is_valid = false;
-                visu_ctxt->past_meas[i].peak_u16 = 0;
-                visu_ctxt->past_meas[i].rms_squared = 0;
-            }
-            visu_ctxt->meas_buffer_idx = 0;
-        } else {
-            /* only use actual measurements, otherwise the first RMS measure happening before
-             * MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS have been played will always be artificially
-             * low */
-            uint32_t i;
-            for (i=0 ; i < visu_ctxt->meas_wndw_size_in_buffers ; i++) {
-                if (visu_ctxt->past_meas[i].is_valid) {
-                    if (visu_ctxt->past_meas[i].peak_u16 > peak_u16) {
-                        peak_u16 = visu_ctxt->past_meas[i].peak_u16;
+        uint16_t peak_u16;
+        float sum_rms_squared;
+        uint8_t nb_valid_meas;
+        int32_t seq;
+        int attempt = 0;
+
+        if (pReplyData == NULL || *replySize < (sizeof(int32_t) * MEASUREMENT_COUNT)) {
+            ALOGV("%s VISUALIZER_CMD_MEASURE error *replySize %d", __func__, *replySize);
+            return -EINVAL;
+        }
+
+        do {
+            seq = capture_read_begin(visu_ctxt, attempt);
+            peak_u16 = 0;
+            sum_rms_squared = 0.0f;
+            nb_valid_meas = 0;
+
+            /* ignore measurements if last measurement was too long ago (which implies stored
+             * measurements aren't relevant anymore and shouldn't bias the new one), the
+             * capture thread discards them when playback resumes */
+            struct timespec update_time = visu_ctxt->buffer_update_time;
+            const int32_t delay_ms = visualizer_get_delta_time_ms_from_updated_time(&update_time);
+            if (delay_ms > DISCARD_MEASUREMENTS_TIME_MS) {
+                ALOGV("Ignoring measurements, last measurement is %dms old", delay_ms);
+            } else {
+                /* only use actual measurements, otherwise the first RMS measure happening
+                 * before MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS have been played will always
+                 * be artificially low */
+                uint32_t i;
+                for (i=0 ; i < visu_ctxt->meas_wndw_size_in_buffers ; i++) {
+                    if (visu_ctxt->past_meas[i].is_valid) {
+                        if (visu_ctxt->past_meas[i].peak_u16 > peak_u16) {
+                            peak_u16 = visu_ctxt->past_meas[i].peak_u16;
+                        }
+                        sum_rms_squared += visu_ctxt->past_meas[i].rms_squared;
+                        nb_valid_meas++;
                     }
-                    sum_rms_squared += visu_ctxt->past_meas[i].rms_squared;
-                    nb_valid_meas++;
                 }
             }
-        }
+        } while (capture_read_retry(visu_ctxt, seq, ++attempt));
+
         float rms = nb_valid_meas == 0 ? 0.0f : sqrtf(sum_rms_squared / nb_valid_meas);
         int32_t* p_int_reply_data = (int32_t*)pReplyData;
         /* convert from I16 sample values to mB and write results */
@@ -1061,6 +1101,17 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
     int retsize;
     int status = 0;
 
+    /* capture and measure are polled at display rate and only read the state published by
+     * the capture thread, keep them off lock. The framework never releases an effect while
+     * one of its commands is in flight. */
+    if (cmdCode == VISUALIZER_CMD_CAPTURE || cmdCode == VISUALIZER_CMD_MEASURE) {
+        if (context == NULL || context->state == EFFECT_STATE_UNINITIALIZED ||
+                context->ops.command == NULL)
+            return -EINVAL;
+        return context->ops.command(context, cmdCode, cmdSize,
+                                    pCmdData, replySize, pReplyData);
+    }
+
     pthread_mutex_lock(&lock);
 
     if (!effect_exists(context)) {
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks and times the visualizer kernels.
+ *
+ *   visualizer-kernels-test
+ *       compares the kernels with the scalar loops visualizer_process()
+ *       used before them, on random buffers of every amplitude and on
+ *       silent and full scale ones, for lengths that leave a tail to the
+ *       C code as well as for the 768 frames of a capture buffer
+ *   visualizer-kernels-test -b seconds
+ *       times both on 768 frame buffers for about that long each
+ *
+ * The capture bytes and the normalized shift must be identical. The peak
+ * must be too, but for a full scale negative sample, which the old loop
+ * wrapped and which is now reported as 32767. The old loop summed squares
+ * in a float, so rms_squared only has to agree to TEST_MAX_RMS_ERROR.
+ *
+ * Exits non zero when a check fails.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "visualizer_kernels.h"
+
+#define TEST_MAX_FRAMES         1024
+#define TEST_BUFFERS            4000
+#define TEST_MAX_RMS_ERROR      1e-4
+#define BENCH_FRAMES            768
+#define SHIFT_MIN               4
+#define SHIFT_MAX               9
+
+static const uint32_t test_frames[] = { 768, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 383, 1023 };
+
+static uint32_t rand_state = 1;
+
+static uint32_t test_rand(void)
+{
+    rand_state = rand_state * 1664525 + 1013904223;
+    return rand_state >> 8;
+}
+
+/* the measurement loop visualizer_process() had */
+static void old_measure(const int16_t *in, uint32_t count, uint16_t *peak,
+                        float *rms_squared)
+{
+    uint32_t inIdx;
+    int16_t max_sample = 0;
+    float rms_squared_acc = 0;
+
+    for (inIdx = 0; inIdx < count; inIdx++) {
+        if (in[inIdx] > max_sample) {
+            max_sample = in[inIdx];
+        } else if (-in[inIdx] > max_sample) {
+            max_sample = -in[inIdx];
+        }
+        rms_squared_acc += (in[inIdx] * in[inIdx]);
+    }
+    *peak = (uint16_t)max_sample;
+    *rms_squared = rms_squared_acc / count;
+}
+
+/* the normalized scaling loop, without the clz of 0 it left undefined */
+static int32_t old_clz(const int16_t *in, uint32_t len)
+{
+    int32_t shift = 32;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        int32_t smp = in[i];
+        if (smp < 0) smp = -smp - 1;
+        int32_t clz = smp ? __builtin_clz(smp) : 32;
+        if (shift > clz) shift = clz;
+    }
+    return shift;
+}
+
+/* the downmix loop, without the wrap of the capture buffer */
+static void old_downmix(const int16_t *in, uint8_t *out, uint32_t frames,
+                        int32_t shift)
+{
+    uint32_t i;
+
+    for (i = 0; i < frames; i++) {
+        int32_t smp = in[2 * i] + in[2 * i + 1];
+        smp = smp >> shift;
+        out[i] = ((uint8_t)smp)^0x80;
+    }
+}
+
+static void fill(int16_t *in, uint32_t count, int kind)
+{
+    uint32_t i;
+    int bits;
+
+    switch (kind) {
+    case 0:
+        memset(in, 0, count * sizeof(int16_t));
+        break;
+    case 1:
+        for (i = 0; i < count; i++)
+            in[i] = (i & 1) ? 32767 : -32768;
+        break;
+    case 2:
+        for (i = 0; i < count; i++)
+            in[i] = 32767;
+        break;
+    default:
+        /* anything from 1 to 16 bits, so every shift comes up */
+        bits = 1 + test_rand() % 16;
+        for (i = 0; i < count; i++)
+            in[i] = (int16_t)(test_rand() >> (24 - bits));
+        break;
+    }
+}
+
+static bool has_min(const int16_t *in, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (in[i] == -32768)
+            return true;
+    }
+    return false;
+}
+
+static int check_buffer(const int16_t *in, uint32_t frames)
+{
+    uint32_t count = frames * 2;
+    visualizer_scan_t scan;
+    uint8_t old_out[TEST_MAX_FRAMES], out[TEST_MAX_FRAMES];
+    uint16_t old_peak, peak;
+    float old_rms, rms;
+    int32_t clz, shift;
+
+    visualizer_scan(in, count, &scan);
+
+    old_measure(in, count, &old_peak, &old_rms);
+    peak = scan.peak > 32767 ? 32767 : (uint16_t)scan.peak;
+    rms = (float)scan.sum_squares / count;
+    if (peak != old_peak && !has_min(in, count)) {
+        printf("%u frames: peak %u, was %u\n", frames, peak, old_peak);
+        return 1;
+    }
+    if (fabs(rms - old_rms) > TEST_MAX_RMS_ERROR * old_rms) {
+        printf("%u frames: rms squared %f, was %f\n", frames, rms, old_rms);
+        return 1;
+    }
+
+    clz = scan.mag_bits ? __builtin_clz(scan.mag_bits) : 32;
+    if (clz != old_clz(in, count)) {
+        printf("%u frames: clz %d, was %d\n", frames, clz, old_clz(in, count));
+        return 1;
+    }
+
+    for (shift = SHIFT_MIN; shift <= SHIFT_MAX; shift++) {
+        old_downmix(in, old_out, frames, shift);
+        visualizer_downmix(in, out, frames, shift);
+        if (memcmp(out, old_out, frames) != 0) {
+            printf("%u frames: capture differs at shift %d\n", frames, shift);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_tests(void)
+{
+    int16_t in[TEST_MAX_FRAMES * 2];
+    int failed = 0;
+    size_t f;
+    int b;
+
+    printf("visualizer, %s kernels\n", visualizer_kernels());
+    for (f = 0; f < sizeof(test_frames) / sizeof(test_frames[0]); f++) {
+        int bad = 0;
+
+        for (b = 0; b < TEST_BUFFERS && !bad; b++) {
+            fill(in, test_frames[f] * 2, b);
+            bad = check_buffer(in, test_frames[f]);
+        }
+        printf("%4u frames: %s\n", test_frames[f], bad ? "FAILED" : "ok");
+        failed |= bad;
+    }
+    return failed ? 1 : 0;
+}
+
+static double bench_seconds(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int run_benchmark(double seconds)
+{
+    int16_t in[BENCH_FRAMES * 2];
+    uint8_t out[BENCH_FRAMES];
+    visualizer_scan_t scan;
+    struct timespec start;
+    volatile uint32_t sink = 0;
+    uint16_t peak;
+    float rms;
+    double elapsed;
+    long n;
+
+    fill(in, BENCH_FRAMES * 2, 3);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; (elapsed = bench_seconds(&start)) < seconds; n++) {
+        old_measure(in, BENCH_FRAMES * 2, &peak, &rms);
+        sink += old_clz(in, BENCH_FRAMES * 2);
+        old_downmix(in, out, BENCH_FRAMES, SHIFT_MIN);
+        sink += peak + out[n % BENCH_FRAMES];
+    }
+    printf("old loops: %.3f us per %d frame buffer\n",
+           n ? elapsed * 1e6 / n : 0.0, BENCH_FRAMES);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; (elapsed = bench_seconds(&start)) < seconds; n++) {
+        visualizer_scan(in, BENCH_FRAMES * 2, &scan);
+        visualizer_downmix(in, out, BENCH_FRAMES, SHIFT_MIN);
+        sink += scan.peak + out[n % BENCH_FRAMES];
+    }
+    printf("%s kernels: %.3f us per %d frame buffer\n", visualizer_kernels(),
+           n ? elapsed * 1e6 / n : 0.0, BENCH_FRAMES);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+        case 'b':
+            return run_benchmark(atof(optarg));
+        default:
+            fprintf(stderr, "usage: %s [-b seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+    return run_tests();
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "visualizer_kernels.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VISUALIZER_KERNELS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VISUALIZER_KERNELS_SSE2
+#endif
+
+void visualizer_scan(const int16_t *in, uint32_t count, visualizer_scan_t *scan)
+{
+    uint32_t peak = 0, mag_bits = 0;
+    uint64_t sum_squares = 0;
+    uint32_t i = 0;
+
+#if defined(VISUALIZER_KERNELS_NEON)
+    uint16x8_t vpeak = vdupq_n_u16(0);
+    int16x8_t vbits = vdupq_n_s16(0);
+    uint64x2_t vsum = vdupq_n_u64(0);
+
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t lo = vmull_s16(vget_low_s16(x), vget_low_s16(x));
+        int32x4_t hi = vmull_s16(vget_high_s16(x), vget_high_s16(x));
+
+        /* vabs wraps -32768 onto itself, which reads as 32768 unsigned */
+        vpeak = vmaxq_u16(vpeak, vreinterpretq_u16_s16(vabsq_s16(x)));
+        vbits = vorrq_s16(vbits, veorq_s16(x, vshrq_n_s16(x, 15)));
+        /* squares reach 2^30, two of them still fit an unsigned lane */
+        vsum = vpadalq_u32(vsum, vaddq_u32(vreinterpretq_u32_s32(lo),
+                                           vreinterpretq_u32_s32(hi)));
+    }
+    {
+        uint16x4_t p = vmax_u16(vget_low_u16(vpeak), vget_high_u16(vpeak));
+        int16x4_t b = vorr_s16(vget_low_s16(vbits), vget_high_s16(vbits));
+
+        p = vpmax_u16(p, p);
+        p = vpmax_u16(p, p);
+        peak = vget_lane_u16(p, 0);
+        mag_bits = (uint16_t)(vget_lane_s16(b, 0) | vget_lane_s16(b, 1) |
+                              vget_lane_s16(b, 2) | vget_lane_s16(b, 3));
+        sum_squares = vgetq_lane_u64(vsum, 0) + vgetq_lane_u64(vsum, 1);
+    }
+#elif defined(VISUALIZER_KERNELS_SSE2)
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vpeak = bias;       /* 0 in the biased domain */
+    __m128i vbits = zero;
+    __m128i vsum = zero;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i sign = _mm_srai_epi16(x, 15);
+        __m128i t = _mm_xor_si128(x, sign);
+        /* |x| = t + 1 for negatives, unsigned max through the signed one */
+        __m128i mag = _mm_sub_epi16(t, sign);
+        /* pairs of squares reach 2^31, only valid as unsigned */
+        __m128i sq = _mm_madd_epi16(x, x);
+
+        vpeak = _mm_max_epi16(vpeak, _mm_xor_si128(mag, bias));
+        vbits = _mm_or_si128(vbits, t);
+        vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(sq, zero));
+        vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(sq, zero));
+    }
+    {
+        int16_t lanes[8];
+        uint64_t sums[2];
+        int k;
+
+        _mm_storeu_si128((__m128i *)lanes, _mm_xor_si128(vpeak, bias));
+        for (k = 0; k < 8; k++) {
+            if ((uint16_t)lanes[k] > peak)
+                peak = (uint16_t)lanes[k];
+        }
+        _mm_storeu_si128((__m128i *)lanes, vbits);
+        for (k = 0; k < 8; k++)
+            mag_bits |= (uint16_t)lanes[k];
+        _mm_storeu_si128((__m128i *)sums, vsum);
+        sum_squares = sums[0] + sums[1];
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t x = in[i];
+        uint32_t mag = x < 0 ? -x : x;
+
+        if (mag > peak)
+            peak = mag;
+        mag_bits |= x < 0 ? -x - 1 : x;
+        sum_squares += (uint32_t)(x * x);
+    }
+
+    scan->peak = peak;
+    scan->sum_squares = sum_squares;
+    scan->mag_bits = mag_bits;
+}
+
+void visualizer_downmix(const int16_t *in, uint8_t *out, uint32_t frames,
+                        int32_t shift)
+{
+    uint32_t i = 0;
+
+#if defined(VISUALIZER_KERNELS_NEON)
+    /* halving add is (l + r) >> 1 without overflow, shift is at least 4 */
+    int16x8_t vshift = vdupq_n_s16(-(shift - 1));
+    uint8x8_t offset = vdup_n_u8(0x80);
+
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t lr = vld2q_s16(in + 2 * i);
+        int16x8_t smp = vshlq_s16(vhaddq_s16(lr.val[0], lr.val[1]), vshift);
+
+        vst1_u8(out + i, veor_u8(vreinterpret_u8_s8(vmovn_s16(smp)), offset));
+    }
+#elif defined(VISUALIZER_KERNELS_SSE2)
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i low_byte = _mm_set1_epi16(0xff);
+    const __m128i offset = _mm_set1_epi8((char)0x80);
+    __m128i count = _mm_cvtsi32_si128(shift);
+
+    for (; i + 8 <= frames; i += 8) {
+        /* madd against ones sums each frame's pair exactly in 32 bits */
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(in + 2 * i)), ones);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(in + 2 * i + 8)), ones);
+        /* shifted sums fit 13 bits, packing does not saturate */
+        __m128i smp = _mm_packs_epi32(_mm_sra_epi32(a, count), _mm_sra_epi32(b, count));
+
+        smp = _mm_packus_epi16(_mm_and_si128(smp, low_byte), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i *)(out + i), _mm_xor_si128(smp, offset));
+    }
+#endif
+    for (; i < frames; i++) {
+        int32_t smp = in[2 * i] + in[2 * i + 1];
+
+        smp = smp >> shift;
+        out[i] = ((uint8_t)smp)^0x80;
+    }
+}
+
+const char *visualizer_kernels(void)
+{
+#if defined(VISUALIZER_KERNELS_NEON)
+    return "neon";
+#elif defined(VISUALIZER_KERNELS_SSE2)
+    return "sse2";
+#else
+    return "c";
+#endif
+}
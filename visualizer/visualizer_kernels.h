@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef VISUALIZER_KERNELS_H
+#define VISUALIZER_KERNELS_H
+
+#include <stdint.h>
+
+/*
+ * The per buffer passes of visualizer_process(), with NEON and SSE2
+ * versions and a C one for the rest. As in hal/audio_extn/ssr_engine.c the
+ * version is fixed at build time: NEON is part of every arm ABI the effect
+ * is built for and SSE2 of every x86 one. There is no AVX2 version and no
+ * runtime dispatch: a 768 frame buffer comes every 16 ms and takes about
+ * 2 us with SSE2, which leaves nothing for either to win back.
+ * test/visualizer_kernels_test checks them against the loops they replaced.
+ */
+
+/* what one pass over a buffer gathers for the measurements and the scaling */
+typedef struct visualizer_scan_s {
+    uint32_t peak;          /* largest magnitude, 32768 for a full scale negative */
+    uint64_t sum_squares;
+    uint32_t mag_bits;      /* OR of x or ~x, its top bit sets the normalized shift */
+} visualizer_scan_t;
+
+void visualizer_scan(const int16_t *in, uint32_t count, visualizer_scan_t *scan);
+
+/* sums stereo frames into offset 8 bit samples, (l + r) >> shift */
+void visualizer_downmix(const int16_t *in, uint8_t *out, uint32_t frames,
+                        int32_t shift);
+
+/* "neon", "sse2" or "c", whichever kernels were built */
+const char *visualizer_kernels(void);
+
+#endif /* VISUALIZER_KERNELS_H */